@@ -0,0 +1,13 @@
+#ifndef _W25QXX_LINUX_CMSIS_OS_H
+#define _W25QXX_LINUX_CMSIS_OS_H
+
+// _W25QXX_USE_FREERTOS on Linux: the driver only needs osDelay() and a critical section,
+// one process wide mutex here
+
+#include <stdint.h>
+
+void osDelay(uint32_t millisec);
+void taskENTER_CRITICAL(void);
+void taskEXIT_CRITICAL(void);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef _W25QXX_LINUX_MAIN_H
+#define _W25QXX_LINUX_MAIN_H
+
+/*
+  The part of the STM32 HAL the driver uses, for Linux userspace. Put this directory in
+  the include path before building w25qxx.c on the host, see w25qxxSpidev.h.
+
+  SPI handle and CS port are both the spidev device, the CS pin is not used.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct w25qxx_spidev_s SPI_HandleTypeDef;
+typedef struct w25qxx_spidev_s GPIO_TypeDef;
+
+typedef enum
+{
+	GPIO_PIN_RESET = 0,
+	GPIO_PIN_SET,
+
+} GPIO_PinState;
+
+typedef enum
+{
+	HAL_OK = 0,
+	HAL_ERROR,
+	HAL_BUSY,
+	HAL_TIMEOUT,
+
+} HAL_StatusTypeDef;
+
+typedef enum
+{
+	HAL_SPI_STATE_RESET = 0,
+	HAL_SPI_STATE_READY,
+	HAL_SPI_STATE_BUSY,
+
+} HAL_SPI_StateTypeDef;
+
+// _W25QXX_SPI, _W25QXX_CS_GPIO and _W25QXX_CS_PIN of w25qxxConf.h
+extern SPI_HandleTypeDef hspi1;
+#define FLASH_CS_GPIO_Port (&hspi1)
+#define FLASH_CS_Pin 0
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_Receive_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size);
+HAL_SPI_StateTypeDef HAL_SPI_GetState(SPI_HandleTypeDef *hspi);
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+
+#endif
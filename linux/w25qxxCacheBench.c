@@ -0,0 +1,193 @@
+/*
+  w25qxx-cachebench: hit rate and read time of the read cache (_W25QXX_READ_CACHE_SLOTS) for
+  small reads with a Zipf distribution over the pages, on a Linux host.
+
+    w25qxx-cachebench [-p pages] [-n reads] [-z skew] DEVICE
+
+  Pages pages from address 0 on are written with known data, then reads of 16 bytes go to
+  page k with a probability of 1 / (k + 1)^skew, at a random place in the page. Every
+  1000 reads a byte is written and its sector erased, the cache has to follow. The same
+  reads run again spread evenly over the pages. Every read is checked against a copy in RAM.
+
+  DEVICE is /dev/spidevX.Y or a file used as simulated chip (see w25qxxSpidev.h), times
+  on a simulated chip are simulated. Build with -D_W25QXX_READ_CACHE_SLOTS=0 to compare
+  without the cache.
+
+  Exit code 0 when every read returns the right data, 1 on differences or commands the busy
+  simulated chip ignored, 2 on errors.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "w25qxx.h"
+#include "w25qxxSpidev.h"
+
+#define CACHEBENCH_READ 16 // bytes per read
+
+typedef struct
+{
+	uint32_t Pages;
+	uint32_t Reads;
+	uint32_t Seed;
+	double *Cdf; // of the page numbers
+	uint8_t *Model; // what the pages hold
+	uint32_t Differ; // reads
+	uint32_t Ignored; // commands the busy simulated chip ignored
+
+} cachebench_t;
+
+static cachebench_t CacheBench;
+
+//###################################################################################################################
+static uint32_t CacheBench_Random(void)
+{
+	CacheBench.Seed ^= CacheBench.Seed << 13;
+	CacheBench.Seed ^= CacheBench.Seed >> 17;
+	CacheBench.Seed ^= CacheBench.Seed << 5;
+	return CacheBench.Seed;
+}
+//###################################################################################################################
+// the page of the next read, binary search in the distribution
+static uint32_t CacheBench_Page(void)
+{
+	double Pick = (CacheBench_Random() / 4294967296.0) * CacheBench.Cdf[CacheBench.Pages - 1];
+	uint32_t Low = 0, High = CacheBench.Pages - 1, Mid;
+	while (Low < High)
+	{
+		Mid = (Low + High) / 2;
+		if (CacheBench.Cdf[Mid] < Pick)
+			Low = Mid + 1;
+		else
+			High = Mid;
+	}
+	return Low;
+}
+//###################################################################################################################
+static void CacheBench_Distribution(double Skew)
+{
+	double Sum = 0;
+	for (uint32_t i = 0; i < CacheBench.Pages; i++)
+	{
+		Sum += 1.0 / pow(i + 1, Skew);
+		CacheBench.Cdf[i] = Sum;
+	}
+}
+//###################################################################################################################
+static void CacheBench_Run(const char *Name)
+{
+	uint8_t Data[CACHEBENCH_READ], Byte;
+	uint32_t Address, Sector;
+	uint64_t Start, Time;
+	W25QXX_SpidevStats_t Stats;
+#if (_W25QXX_READ_CACHE_SLOTS > 0)
+	W25QXX_CacheStats_t Cache;
+	W25qxx_ReadCacheStats(NULL, true);
+#endif
+	CacheBench.Seed = 1;
+	W25qxx_SpidevStats(&hspi1, NULL, true);
+	Start = W25qxx_SpidevMicros();
+	for (uint32_t n = 0; n < CacheBench.Reads; n++)
+	{
+		Address = CacheBench_Page() * w25qxx.PageSize + CacheBench_Random() % (w25qxx.PageSize - CACHEBENCH_READ);
+		W25qxx_ReadBytes(Data, Address, CACHEBENCH_READ);
+		if (memcmp(Data, &CacheBench.Model[Address], CACHEBENCH_READ) != 0)
+			CacheBench.Differ++;
+		if ((n % 1000) != 999)
+			continue;
+		// a write and an erase the cache has to see
+		W25qxx_WriteByte(0x00, Address);
+		CacheBench.Model[Address] = 0x00;
+		W25qxx_ReadByte(&Byte, Address);
+		if (Byte != 0x00)
+			CacheBench.Differ++;
+		Sector = Address / w25qxx.SectorSize;
+		W25qxx_EraseSector(Sector);
+		memset(&CacheBench.Model[Sector * w25qxx.SectorSize], 0xFF, w25qxx.SectorSize);
+		W25qxx_ReadByte(&Byte, Address);
+		if (Byte != 0xFF)
+			CacheBench.Differ++;
+	}
+	Time = W25qxx_SpidevMicros() - Start;
+	W25qxx_SpidevStats(&hspi1, &Stats, false);
+#if (_W25QXX_READ_CACHE_SLOTS > 0)
+	W25qxx_ReadCacheStats(&Cache, false);
+	printf("%s: %u hits, %u misses (%.1f %%), ", Name, Cache.Hits, Cache.Misses, 100.0 * Cache.Hits / ((Cache.Hits + Cache.Misses > 0) ? Cache.Hits + Cache.Misses : 1));
+#else
+	printf("%s: no cache, ", Name);
+#endif
+	printf("%.0f reads/s, %.1f bus bytes per read\n", CacheBench.Reads / ((Time > 0) ? Time / 1e6 : 1e-6), (double)Stats.Bytes / CacheBench.Reads);
+	CacheBench.Ignored += Stats.Ignored;
+}
+//###################################################################################################################
+static int CacheBench_Usage(void)
+{
+	fprintf(stderr, "usage: w25qxx-cachebench [-p pages] [-n reads] [-z skew] DEVICE\n"
+					"  DEVICE is /dev/spidevX.Y or a file used as simulated chip, the pages from address 0 on are overwritten\n");
+	return 2;
+}
+//###################################################################################################################
+int main(int argc, char **argv)
+{
+	uint32_t Sectors;
+	double Skew = 1.1;
+	char Name[32];
+	int Opt;
+	CacheBench.Pages = 1024;
+	CacheBench.Reads = 20000;
+	while ((Opt = getopt(argc, argv, "p:n:z:")) != -1)
+	{
+		if (Opt == 'p')
+			CacheBench.Pages = strtoul(optarg, NULL, 0);
+		else if (Opt == 'n')
+			CacheBench.Reads = strtoul(optarg, NULL, 0);
+		else if (Opt == 'z')
+			Skew = strtod(optarg, NULL);
+		else
+			return CacheBench_Usage();
+	}
+	if ((argc - optind != 1) || (CacheBench.Pages == 0) || (CacheBench.Reads == 0))
+		return CacheBench_Usage();
+	if (W25qxx_SpidevOpen(&hspi1, argv[optind], 20000000) == false)
+	{
+		perror(argv[optind]);
+		return 2;
+	}
+	if (W25qxx_Init() == false)
+	{
+		fprintf(stderr, "%s: no w25qxx found\n", argv[optind]);
+		return 2;
+	}
+	Sectors = (CacheBench.Pages * w25qxx.PageSize + w25qxx.SectorSize - 1) / w25qxx.SectorSize;
+	if (Sectors > w25qxx.SectorCount)
+	{
+		fprintf(stderr, "%u pages do not fit the chip\n", CacheBench.Pages);
+		return 2;
+	}
+	CacheBench.Cdf = malloc(CacheBench.Pages * sizeof(double));
+	CacheBench.Model = malloc(Sectors * w25qxx.SectorSize);
+	if ((CacheBench.Cdf == NULL) || (CacheBench.Model == NULL))
+		return 2;
+	memset(CacheBench.Model, 0xFF, Sectors * w25qxx.SectorSize);
+	for (uint32_t i = 0; i < CacheBench.Pages * w25qxx.PageSize; i++)
+		CacheBench.Model[i] = (uint8_t)(i * 31 + 7);
+	for (uint32_t s = 0; s < Sectors; s++)
+		W25qxx_EraseSector(s);
+	for (uint32_t p = 0; p < CacheBench.Pages; p++)
+		W25qxx_WritePage(&CacheBench.Model[p * w25qxx.PageSize], p, 0, w25qxx.PageSize);
+	printf("%u reads of %u bytes over %u pages, %u cache slots\n", CacheBench.Reads, CACHEBENCH_READ, CacheBench.Pages, _W25QXX_READ_CACHE_SLOTS);
+	CacheBench_Distribution(Skew);
+	snprintf(Name, sizeof(Name), "zipf %.2f", Skew);
+	CacheBench_Run(Name);
+	CacheBench_Distribution(0);
+	CacheBench_Run("uniform");
+	printf("%u reads differ, %u commands ignored while busy\n", CacheBench.Differ, CacheBench.Ignored);
+	W25qxx_SpidevClose(&hspi1);
+	free(CacheBench.Cdf);
+	free(CacheBench.Model);
+	return ((CacheBench.Differ > 0) || (CacheBench.Ignored > 0)) ? 1 : 0;
+}
+//###################################################################################################################
@@ -0,0 +1,37 @@
+#ifndef _W25QXXCONFIG_H
+#define _W25QXXCONFIG_H
+
+// w25qxxConf.h of the test and benchmark tools, the Makefile passes it with -include so
+// ../w25qxxConf.h is skipped. Every option is on, -D on the command line changes one.
+
+#define _W25QXX_SPI                   hspi1
+#define _W25QXX_CS_GPIO               FLASH_CS_GPIO_Port
+#define _W25QXX_CS_PIN                FLASH_CS_Pin
+#define _W25QXX_USE_FREERTOS          1
+#define _W25QXX_DEBUG                 0
+#ifndef _W25QXX_USE_DMA
+#define _W25QXX_USE_DMA               0
+#endif
+#ifndef _W25QXX_USE_SECTOR_MAP
+#define _W25QXX_USE_SECTOR_MAP        1
+#endif
+#define _W25QXX_SECTOR_MAP_SECTORS    65536 // w25q02
+#ifndef _W25QXX_USE_SMART_WRITE
+#define _W25QXX_USE_SMART_WRITE       1
+#endif
+#ifndef _W25QXX_READ_CACHE_SLOTS
+#define _W25QXX_READ_CACHE_SLOTS      16
+#endif
+#ifndef _W25QXX_USE_WRITE_BUFFER
+#define _W25QXX_USE_WRITE_BUFFER      1
+#endif
+#define _W25QXX_WRITE_BUFFER_TIMEOUT  100
+#ifndef _W25QXX_USE_ERASE_SUSPEND
+#define _W25QXX_USE_ERASE_SUSPEND     1
+#endif
+#ifndef _W25QXX_USE_HEALTH
+#define _W25QXX_USE_HEALTH            1
+#endif
+#define _W25QXX_STREAM_BUFFER_SIZE    256
+
+#endif
@@ -0,0 +1,196 @@
+/*
+  w25qxx-dietest: test of the stacked die parts (w25q01, w25q02, w25m512) on a simulated chip.
+
+    w25qxx-dietest [-m] DEVICE
+
+  A 128 MB file is a w25q01, 256 MB a w25q02, a 64 MB file with -m a w25m512 (see
+  w25qxxSpidev.h). At every die boundary data is written across it with WriteBytes and
+  read back with ReadBytes, ReadV and a stream, and the file is checked for the data at the
+  right place: a die select that is not sent leaves it on the wrong die. Then a sector of
+  one die is erased in the background while the die before it is read, which must not
+  suspend it, and a chip erase has to blank every die. No command may be ignored by a busy
+  die.
+
+  DEVICE is a file used as simulated chip, it is overwritten.
+
+  Exit code 0 when every check passes, 1 when one fails, 2 on errors.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "w25qxx.h"
+#include "w25qxxSpidev.h"
+
+#define DIETEST_SPAN 12000 // bytes written across a boundary
+
+typedef struct
+{
+	uint32_t DieSize;
+	uint32_t Checks;
+	uint32_t Failed;
+
+} dietest_t;
+
+static dietest_t DieTest;
+
+//###################################################################################################################
+static void DieTest_Check(bool Ok, const char *What)
+{
+	DieTest.Checks++;
+	if (Ok == false)
+		DieTest.Failed++;
+	printf("%s: %s\n", (Ok == true) ? "ok  " : "FAIL", What);
+}
+//###################################################################################################################
+static void DieTest_Fill(uint8_t *Data, uint32_t Size, uint32_t Seed)
+{
+	for (uint32_t i = 0; i < Size; i++)
+		Data[i] = (uint8_t)((i + Seed) * 131 + (i >> 8));
+}
+//###################################################################################################################
+static bool DieTest_Blank(const uint8_t *Data, uint32_t Size)
+{
+	for (uint32_t i = 0; i < Size; i++)
+		if (Data[i] != 0xFF)
+			return false;
+	return true;
+}
+//###################################################################################################################
+static void DieTest_Boundary(uint8_t Die)
+{
+	static uint8_t Data[DIETEST_SPAN], Back[DIETEST_SPAN];
+	uint32_t Address = Die * DieTest.DieSize - DIETEST_SPAN / 2, Got = 0, Chunk;
+	W25QXX_IoVec_t Iov[3] = {{Back, 1000}, {&Back[1000], DIETEST_SPAN / 2 - 1000 + 7}, {&Back[DIETEST_SPAN / 2 + 7], DIETEST_SPAN / 2 - 7}};
+	W25qxx_Stream_t Stream;
+	char Text[128];
+	for (uint32_t s = Address / w25qxx.SectorSize; s <= (Address + DIETEST_SPAN - 1) / w25qxx.SectorSize; s++)
+		W25qxx_EraseSector(s);
+	DieTest_Fill(Data, sizeof(Data), Die);
+	W25qxx_WriteBytes(Data, Address, sizeof(Data));
+	W25qxx_WriteFlush();
+	W25qxx_WaitReady();
+	snprintf(Text, sizeof(Text), "die %u boundary: written to the right dies", Die);
+	DieTest_Check(memcmp(&hspi1.Sim[Address], Data, sizeof(Data)) == 0, Text);
+	memset(Back, 0, sizeof(Back));
+	W25qxx_ReadBytes(Back, Address, sizeof(Back));
+	snprintf(Text, sizeof(Text), "die %u boundary: ReadBytes", Die);
+	DieTest_Check(memcmp(Back, Data, sizeof(Data)) == 0, Text);
+	memset(Back, 0, sizeof(Back));
+	W25qxx_ReadV(Address, Iov, 3);
+	snprintf(Text, sizeof(Text), "die %u boundary: ReadV", Die);
+	DieTest_Check(memcmp(Back, Data, sizeof(Data)) == 0, Text);
+	memset(Back, 0, sizeof(Back));
+	W25qxx_StreamOpen(&Stream, Address);
+	while (Got < sizeof(Back))
+	{
+		Chunk = (sizeof(Back) - Got > 1000) ? 1000 : sizeof(Back) - Got;
+		Chunk = W25qxx_StreamRead(&Stream, &Back[Got], Chunk);
+		if (Chunk == 0)
+			break;
+		Got += Chunk;
+	}
+	W25qxx_StreamClose(&Stream);
+	snprintf(Text, sizeof(Text), "die %u boundary: stream, %u headers", Die, Stream.Headers);
+	DieTest_Check((Got == sizeof(Back)) && (memcmp(Back, Data, sizeof(Data)) == 0), Text);
+}
+//###################################################################################################################
+// a background erase on one die, reads of the die before it do not suspend it
+static void DieTest_Background(uint8_t Die)
+{
+	uint8_t Data[256], Back[256];
+	uint32_t Sector = Die * DieTest.DieSize / w25qxx.SectorSize + 3, Other = (Die - 1) * DieTest.DieSize / w25qxx.SectorSize + 3;
+	uint32_t Differ = 0;
+	bool Erasing;
+	W25QXX_SpidevStats_t Before, After;
+	char Text[128];
+	W25qxx_EraseSector(Other);
+	W25qxx_EraseSector(Sector);
+	DieTest_Fill(Data, sizeof(Data), Die + 100);
+	W25qxx_WritePage(Data, Other * (w25qxx.SectorSize / w25qxx.PageSize), 0, w25qxx.PageSize);
+	W25qxx_WritePage(Data, Sector * (w25qxx.SectorSize / w25qxx.PageSize), 0, w25qxx.PageSize);
+	W25qxx_WaitReady();
+	W25qxx_SpidevStats(&hspi1, &Before, false);
+	W25qxx_EraseSectorBackground(Sector);
+	for (uint32_t i = 0; i < 20; i++)
+	{
+		W25qxx_ReadPage(Back, Other * (w25qxx.SectorSize / w25qxx.PageSize), 0, w25qxx.PageSize);
+		if (memcmp(Back, Data, sizeof(Data)) != 0)
+			Differ++;
+		HAL_Delay(1);
+	}
+	Erasing = W25qxx_IsErasing(Sector);
+	W25qxx_WaitReady();
+	W25qxx_SpidevStats(&hspi1, &After, false);
+	snprintf(Text, sizeof(Text), "die %u erasing, die %u read: %u reads differ, %u suspends", Die, Die - 1, Differ, After.Suspends - Before.Suspends);
+	DieTest_Check((Differ == 0) && (After.Suspends == Before.Suspends) && (Erasing == true) && (DieTest_Blank(&hspi1.Sim[Sector * w25qxx.SectorSize], w25qxx.SectorSize) == true),
+				  Text);
+}
+//###################################################################################################################
+static int DieTest_Usage(void)
+{
+	fprintf(stderr, "usage: w25qxx-dietest [-m] DEVICE\n"
+					"  DEVICE is a file used as simulated chip, 128 MB or 256 MB, 64 MB with -m (w25m512), it is overwritten\n");
+	return 2;
+}
+//###################################################################################################################
+int main(int argc, char **argv)
+{
+	uint8_t Data[256], Back[256];
+	bool M512 = false, Blank = true;
+	W25QXX_SpidevStats_t Stats;
+	char Text[128];
+	int Opt;
+	while ((Opt = getopt(argc, argv, "m")) != -1)
+	{
+		if (Opt == 'm')
+			M512 = true;
+		else
+			return DieTest_Usage();
+	}
+	if (argc - optind != 1)
+		return DieTest_Usage();
+	if ((W25qxx_SpidevOpen(&hspi1, argv[optind], 20000000) == false) || (hspi1.Sim == NULL))
+	{
+		fprintf(stderr, "%s: no file for a simulated chip\n", argv[optind]);
+		return 2;
+	}
+	if ((M512 == true) && (hspi1.SimSize == 0x4000000))
+		hspi1.SimDies = 2;
+	if ((W25qxx_Init() == false) || (hspi1.SimDies < 2))
+	{
+		fprintf(stderr, "%s: no stacked die part\n", argv[optind]);
+		return 2;
+	}
+	DieTest.DieSize = hspi1.SimSize / hspi1.SimDies;
+	snprintf(Text, sizeof(Text), "%u dies of %u MB found", w25qxx.DieCount, (unsigned)(w25qxx.SectorCount * w25qxx.SectorSize / w25qxx.DieCount >> 20));
+	DieTest_Check((w25qxx.DieCount == hspi1.SimDies) && (w25qxx.SectorCount * w25qxx.SectorSize == hspi1.SimSize) &&
+					  (w25qxx.ID == ((M512 == true) ? W25M512 : (hspi1.SimDies == 2) ? W25Q01 : W25Q02)),
+				  Text);
+	W25qxx_SpidevStats(&hspi1, NULL, true);
+	for (uint8_t Die = 1; Die < w25qxx.DieCount; Die++)
+		DieTest_Boundary(Die);
+	for (uint8_t Die = 1; Die < w25qxx.DieCount; Die++)
+		DieTest_Background(Die);
+	// something on every die, a chip erase takes it all
+	DieTest_Fill(Data, sizeof(Data), 7);
+	for (uint8_t Die = 0; Die < w25qxx.DieCount; Die++)
+		W25qxx_WritePage(Data, (Die * DieTest.DieSize + 0x10000) / w25qxx.PageSize, 0, w25qxx.PageSize);
+	W25qxx_EraseChip();
+	for (uint8_t Die = 0; Die < w25qxx.DieCount; Die++)
+	{
+		W25qxx_ReadPage(Back, (Die * DieTest.DieSize + 0x10000) / w25qxx.PageSize, 0, w25qxx.PageSize);
+		if (DieTest_Blank(Back, sizeof(Back)) == false)
+			Blank = false;
+	}
+	DieTest_Check((Blank == true) && (DieTest_Blank(hspi1.Sim, hspi1.SimSize) == true), "chip erase blanks every die");
+	W25qxx_SpidevStats(&hspi1, &Stats, false);
+	snprintf(Text, sizeof(Text), "%u commands ignored by a busy die", Stats.Ignored);
+	DieTest_Check(Stats.Ignored == 0, Text);
+	printf("%u checks, %u failed\n", DieTest.Checks, DieTest.Failed);
+	W25qxx_SpidevClose(&hspi1);
+	return (DieTest.Failed > 0) ? 1 : 0;
+}
+//###################################################################################################################
@@ -0,0 +1,208 @@
+/*
+  w25qxx-healthtest: test of the health table (_W25QXX_USE_HEALTH) on a simulated chip.
+
+    w25qxx-healthtest DEVICE
+
+  Erase times are taken from the chip's timing model: a sector erase takes 45 ms, one
+  sector is made slow and one refuses its erase (SimSlowSector, SimFailSector in
+  w25qxxSpidev.h). The test checks the recorded times and failures, an erase found done
+  long after it was started, an erase suspended and resumed by reads, the degrading list,
+  save and load of the table with a broken copy, and a table per block. The table is
+  saved to the last sectors of the chip.
+
+  DEVICE is a file used as simulated chip (see w25qxxSpidev.h) of 256 KB or more, it is
+  overwritten.
+
+  Exit code 0 when every check passes, 1 when one fails, 2 on errors.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "w25qxx.h"
+#include "w25qxxSpidev.h"
+
+typedef struct
+{
+	uint32_t Checks;
+	uint32_t Failed;
+
+} healthtest_t;
+
+static healthtest_t HealthTest;
+
+//###################################################################################################################
+static void HealthTest_Check(bool Ok, const char *What)
+{
+	HealthTest.Checks++;
+	if (Ok == false)
+		HealthTest.Failed++;
+	printf("%s: %s\n", (Ok == true) ? "ok  " : "FAIL", What);
+}
+//###################################################################################################################
+// data in the sector, the sector map would skip the erase of an erased one
+static void HealthTest_Dirty(uint32_t Sector)
+{
+	uint8_t Page[256];
+	memset(Page, 0x5A, sizeof(Page));
+	W25qxx_WritePage(Page, Sector * (w25qxx.SectorSize / w25qxx.PageSize), 0, w25qxx.PageSize);
+}
+//###################################################################################################################
+static void HealthTest_Erases(void)
+{
+	W25QXX_HealthEntry_t Entry;
+	char Text[128];
+	HealthTest_Dirty(5);
+	W25qxx_EraseSector(5);
+	W25qxx_HealthGet(5, &Entry);
+	snprintf(Text, sizeof(Text), "sector erase: %u erase, last %u ms, max %u ms", Entry.EraseCount, Entry.EraseLast, Entry.EraseMax);
+	HealthTest_Check((Entry.EraseCount == 1) && (Entry.EraseLast >= 44) && (Entry.EraseLast <= 48) && (Entry.EraseFails == 0), Text);
+	hspi1.SimSlowSector = 7;
+	hspi1.SimSlowTime = 120;
+	HealthTest_Dirty(7);
+	W25qxx_EraseSector(7);
+	W25qxx_HealthGet(7, &Entry);
+	snprintf(Text, sizeof(Text), "slow sector: last %u ms", Entry.EraseLast);
+	HealthTest_Check((Entry.EraseLast >= 119) && (Entry.EraseLast <= 124), Text);
+	hspi1.SimFailSector = 9;
+	HealthTest_Dirty(9);
+	W25qxx_EraseSector(9);
+	W25qxx_HealthGet(9, &Entry);
+	snprintf(Text, sizeof(Text), "refused erase: %u erase fails", Entry.EraseFails);
+	HealthTest_Check(Entry.EraseFails == 1, Text);
+	hspi1.SimFailSector = 0xFFFFFFFF;
+	// found done much later: counted, not timed
+	HealthTest_Dirty(11);
+	W25qxx_EraseSectorStart(11);
+	HAL_Delay(300);
+	W25qxx_WaitReady();
+	W25qxx_HealthGet(11, &Entry);
+	snprintf(Text, sizeof(Text), "erase found done late: %u erase, last %u ms", Entry.EraseCount, Entry.EraseLast);
+	HealthTest_Check((Entry.EraseCount == 1) && (Entry.EraseLast == 0), Text);
+	HealthTest_Dirty(11);
+	W25qxx_EraseSector(11);
+	W25qxx_HealthGet(11, &Entry);
+	snprintf(Text, sizeof(Text), "erase waited for: %u erases, last %u ms", Entry.EraseCount, Entry.EraseLast);
+	HealthTest_Check((Entry.EraseCount == 2) && (Entry.EraseLast >= 44) && (Entry.EraseLast <= 48), Text);
+}
+//###################################################################################################################
+#if (_W25QXX_USE_ERASE_SUSPEND == 1)
+// suspended time is not erase time
+static void HealthTest_Suspend(void)
+{
+	W25QXX_HealthEntry_t Entry;
+	W25QXX_SpidevStats_t Stats;
+	uint8_t Data[16];
+	char Text[128];
+	HealthTest_Dirty(13);
+	W25qxx_SpidevStats(&hspi1, NULL, true);
+	W25qxx_EraseSectorBackground(13);
+	for (uint32_t i = 0; i < 10; i++)
+	{
+		HAL_Delay(3);
+		W25qxx_ReadBytes(Data, (20 + i) * w25qxx.SectorSize, sizeof(Data));
+		HAL_Delay(5);
+		W25qxx_EraseResume();
+	}
+	W25qxx_WaitReady();
+	W25qxx_HealthGet(13, &Entry);
+	W25qxx_SpidevStats(&hspi1, &Stats, false);
+	snprintf(Text, sizeof(Text), "suspended erase: %u suspends, last %u ms", Stats.Suspends, Entry.EraseLast);
+	HealthTest_Check((Stats.Suspends >= 5) && (Entry.EraseLast >= 44) && (Entry.EraseLast <= 52), Text);
+}
+#endif
+//###################################################################################################################
+static void HealthTest_SaveLoad(W25QXX_HealthEntry_t *Table, W25QXX_HealthEntry_t *Loaded)
+{
+	static W25QXX_Health_t Health;
+	uint32_t Count = w25qxx.SectorCount;
+	uint32_t Sectors = W25QXX_HEALTH_SAVE_SECTORS(Count), Start = w25qxx.SectorCount - Sectors;
+	bool Ok;
+	char Text[128];
+	W25QXX_Health_t *Saved = w25qxx.Health;
+	Ok = (W25qxx_HealthSave(Start, Sectors) == true);
+	Table[5].EraseMax = 777;
+	Ok = Ok && (W25qxx_HealthSave(Start, Sectors) == true);
+	snprintf(Text, sizeof(Text), "save %u entries twice to %u sectors", Count, Sectors);
+	HealthTest_Check(Ok, Text);
+	Ok = (W25qxx_HealthInit(&Health, Loaded, Count) == true) && (W25qxx_HealthLoad(Start, Sectors) == true);
+	HealthTest_Check(Ok && (memcmp(Loaded, Table, Count * sizeof(W25QXX_HealthEntry_t)) == 0) && (Health.Sequence == 2), "load the newer copy");
+	// the newer copy broken: the older one is taken
+	hspi1.Sim[Start * w25qxx.SectorSize + sizeof(W25QXX_HealthHeader_t) + 100] ^= 0xFF;
+	Ok = (W25qxx_HealthInit(&Health, Loaded, Count) == true) && (W25qxx_HealthLoad(Start, Sectors) == true);
+	HealthTest_Check(Ok && (Health.Sequence == 1) && (Loaded[5].EraseMax != 777), "newer copy broken, load the older one");
+	// the next save goes over the broken copy
+	Ok = (W25qxx_HealthSave(Start, Sectors) == true) && (W25qxx_HealthInit(&Health, Loaded, Count) == true) && (W25qxx_HealthLoad(Start, Sectors) == true);
+	HealthTest_Check(Ok && (Health.Sequence == 2), "save over the broken copy");
+	memset(&hspi1.Sim[Start * w25qxx.SectorSize], 0, w25qxx.SectorSize);
+	memset(&hspi1.Sim[(Start + Sectors / 2) * w25qxx.SectorSize], 0, w25qxx.SectorSize);
+	Ok = (W25qxx_HealthInit(&Health, Loaded, Count) == true) && (W25qxx_HealthLoad(Start, Sectors) == false);
+	HealthTest_Check(Ok && (Loaded[5].EraseCount == 0), "both copies broken, an empty table");
+	w25qxx.Health = Saved;
+}
+//###################################################################################################################
+static int HealthTest_Usage(void)
+{
+	fprintf(stderr, "usage: w25qxx-healthtest DEVICE\n"
+					"  DEVICE is a file used as simulated chip, it is overwritten\n");
+	return 2;
+}
+//###################################################################################################################
+int main(int argc, char **argv)
+{
+	static W25QXX_Health_t Health, BlockHealth;
+	W25QXX_HealthEntry_t *Table, *Loaded, *BlockTable, Entry;
+	uint32_t Sectors[8], Found;
+	char Text[128];
+	if (argc != 2)
+		return HealthTest_Usage();
+	if ((W25qxx_SpidevOpen(&hspi1, argv[1], 20000000) == false) || (hspi1.Sim == NULL))
+	{
+		fprintf(stderr, "%s: no file for a simulated chip\n", argv[1]);
+		return 2;
+	}
+	if ((W25qxx_Init() == false) || (w25qxx.SectorCount < 64))
+	{
+		fprintf(stderr, "%s: no w25qxx of 256 KB or more found\n", argv[1]);
+		return 2;
+	}
+	Table = malloc(w25qxx.SectorCount * sizeof(W25QXX_HealthEntry_t));
+	Loaded = malloc(w25qxx.SectorCount * sizeof(W25QXX_HealthEntry_t));
+	BlockTable = malloc(w25qxx.BlockCount * sizeof(W25QXX_HealthEntry_t));
+	if ((Table == NULL) || (Loaded == NULL) || (BlockTable == NULL))
+		return 2;
+	W25qxx_EraseChip();
+	HealthTest_Check(W25qxx_HealthInit(&Health, Table, w25qxx.SectorCount / 2 + 1) == false, "no table of a count the sectors do not divide into");
+	HealthTest_Check(W25qxx_HealthInit(&Health, Table, w25qxx.SectorCount) == true, "table per sector");
+	HealthTest_Erases();
+#if (_W25QXX_USE_ERASE_SUSPEND == 1)
+	HealthTest_Suspend();
+#endif
+	Found = W25qxx_HealthDegrading(Sectors, 8, 100);
+	snprintf(Text, sizeof(Text), "degrading: %u sectors", Found);
+	HealthTest_Check((Found == 2) && (Sectors[0] == 7) && (Sectors[1] == 9), Text);
+	W25qxx_EraseChip();
+	W25qxx_HealthGet(30, &Entry);
+	HealthTest_Check(Entry.EraseCount == 1, "chip erase counts in every entry");
+	HealthTest_SaveLoad(Table, Loaded);
+	// sectors 16 to 31 are one entry
+	HealthTest_Check(W25qxx_HealthInit(&BlockHealth, BlockTable, w25qxx.BlockCount) == true, "table per block");
+	HealthTest_Dirty(17);
+	W25qxx_EraseSector(17);
+	HealthTest_Dirty(18);
+	W25qxx_EraseSector(18);
+	HealthTest_Dirty(19);
+	W25qxx_EraseBlock(1);
+	W25qxx_HealthGet(20, &Entry);
+	snprintf(Text, sizeof(Text), "block 1: %u erases, last %u ms", Entry.EraseCount, Entry.EraseLast);
+	HealthTest_Check(Entry.EraseCount == 3, Text);
+	printf("%u checks, %u failed\n", HealthTest.Checks, HealthTest.Failed);
+	free(Table);
+	free(Loaded);
+	free(BlockTable);
+	W25qxx_SpidevClose(&hspi1);
+	return (HealthTest.Failed > 0) ? 1 : 0;
+}
+//###################################################################################################################
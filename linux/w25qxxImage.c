@@ -0,0 +1,435 @@
+/*
+  w25qxx-image: dump, program and verify whole flash images from a Linux host.
+
+    w25qxx-image [-s Hz] [-o offset] [-n size] DEVICE dump FILE
+    w25qxx-image [-s Hz] [-o offset] DEVICE program FILE
+    w25qxx-image [-s Hz] [-o offset] DEVICE verify FILE
+
+  DEVICE is /dev/spidevX.Y or a file used as simulated chip (see w25qxxSpidev.h). The
+  image is mapped with mmap(). The chip is read one 64 KB block at a time through the
+  driver while a second thread does the host work on the block read before: CRC32,
+  copying to the dump file, comparing with the image. program reads before it writes:
+  sectors that are equal are skipped, blank image sectors are only erased, sectors that
+  only need bits cleared are programmed without erase, whole blocks are erased at once.
+  Programmed sectors are read back. Images are padded with 0xFF to whole sectors.
+
+  Exit code 0 when done and equal, 1 on differences or failed sectors, 2 on errors.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "w25qxx.h"
+#include "w25qxxSpidev.h"
+
+#define IMAGE_CHUNK 0x10000 // one block per read
+#define IMAGE_SECTOR 0x1000
+#define IMAGE_PAGE 0x100
+
+typedef enum
+{
+	IMAGE_DUMP = 0,
+	IMAGE_PROGRAM,
+	IMAGE_VERIFY,
+
+} image_mode_t;
+
+typedef enum
+{
+	IMAGE_SKIP = 0, // equal
+	IMAGE_ERASE, // image sector blank
+	IMAGE_WRITE, // only bits to clear
+	IMAGE_ERASE_WRITE,
+
+} image_action_t;
+
+typedef struct
+{
+	uint32_t Address; // on the chip
+	uint32_t Size;
+	uint8_t Data[IMAGE_CHUNK]; // read from the chip
+	uint8_t Pad[IMAGE_CHUNK]; // last image part, filled up with 0xFF
+	const uint8_t *Want; // image content for Data
+	image_action_t Action[IMAGE_CHUNK / IMAGE_SECTOR];
+
+} image_slot_t;
+
+typedef struct
+{
+	image_mode_t Mode;
+	uint8_t *Image; // mapped image or dump file
+	uint32_t ImageSize;
+	uint32_t Offset; // chip address of the image start
+	image_slot_t Slot[2];
+	// host work thread
+	pthread_t Thread;
+	pthread_mutex_t Mutex;
+	pthread_cond_t Cond;
+	uint32_t Posted; // chunks read
+	uint32_t Checked; // chunks done by the thread
+	uint32_t Crc;
+	uint32_t Differ; // sectors, verify
+	uint32_t FirstDiffer;
+	// program
+	uint32_t Sectors;
+	uint32_t Unchanged;
+	uint32_t Erased;
+	uint32_t Written;
+	uint32_t WrittenNoErase;
+	uint32_t BlockErases;
+	uint32_t Failed;
+	uint8_t Check[IMAGE_SECTOR];
+
+} image_t;
+
+static uint32_t ImageCrcTable[256];
+
+//###################################################################################################################
+static void Image_CrcInit(void)
+{
+	uint32_t Crc;
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		Crc = i;
+		for (uint8_t j = 0; j < 8; j++)
+			Crc = (Crc >> 1) ^ (0xEDB88320 & (0 - (Crc & 1)));
+		ImageCrcTable[i] = Crc;
+	}
+}
+//###################################################################################################################
+static uint32_t Image_Crc(uint32_t Crc, const uint8_t *pData, uint32_t Size)
+{
+	Crc = ~Crc;
+	while (Size-- > 0)
+		Crc = ImageCrcTable[(Crc ^ *pData++) & 0xFF] ^ (Crc >> 8);
+	return ~Crc;
+}
+//###################################################################################################################
+static bool Image_IsBlank(const uint8_t *pData, uint32_t Size)
+{
+	for (uint32_t i = 0; i < Size; i++)
+	{
+		if (pData[i] != 0xFF)
+			return false;
+	}
+	return true;
+}
+//###################################################################################################################
+static image_action_t Image_Classify(const uint8_t *pChip, const uint8_t *pWant)
+{
+	uint32_t i;
+	if (memcmp(pChip, pWant, IMAGE_SECTOR) == 0)
+		return IMAGE_SKIP;
+	if (Image_IsBlank(pWant, IMAGE_SECTOR) == true)
+		return IMAGE_ERASE;
+	for (i = 0; (i < IMAGE_SECTOR) && ((pChip[i] & pWant[i]) == pWant[i]); i++)
+		;
+	return (i == IMAGE_SECTOR) ? IMAGE_WRITE : IMAGE_ERASE_WRITE;
+}
+//###################################################################################################################
+// host work on one chunk, runs beside the next chip read
+static void Image_Check(image_t *Image, image_slot_t *Slot)
+{
+	uint32_t Base = Slot->Address - Image->Offset;
+	switch (Image->Mode)
+	{
+	case IMAGE_DUMP:
+		memcpy(&Image->Image[Base], Slot->Data, Slot->Size);
+		Image->Crc = Image_Crc(Image->Crc, Slot->Data, Slot->Size);
+		break;
+	case IMAGE_VERIFY:
+		Image->Crc = Image_Crc(Image->Crc, Slot->Data, Slot->Size);
+		for (uint32_t i = 0; i < Slot->Size; i += IMAGE_SECTOR)
+		{
+			if (memcmp(&Slot->Data[i], &Image->Image[Base + i], (Slot->Size - i < IMAGE_SECTOR) ? Slot->Size - i : IMAGE_SECTOR) != 0)
+			{
+				if (Image->Differ++ == 0)
+					Image->FirstDiffer = Slot->Address + i;
+			}
+		}
+		break;
+	case IMAGE_PROGRAM:
+		Slot->Want = &Image->Image[Base];
+		// the crc is of the image file, same as dump and verify of its size give
+		if (Base + Slot->Size > Image->ImageSize)
+		{
+			memset(Slot->Pad, 0xFF, Slot->Size);
+			memcpy(Slot->Pad, &Image->Image[Base], Image->ImageSize - Base);
+			Slot->Want = Slot->Pad;
+			Image->Crc = Image_Crc(Image->Crc, Slot->Want, Image->ImageSize - Base);
+		}
+		else
+			Image->Crc = Image_Crc(Image->Crc, Slot->Want, Slot->Size);
+		for (uint32_t i = 0; i < Slot->Size / IMAGE_SECTOR; i++)
+			Slot->Action[i] = Image_Classify(&Slot->Data[i * IMAGE_SECTOR], &Slot->Want[i * IMAGE_SECTOR]);
+		break;
+	}
+}
+//###################################################################################################################
+static void *Image_Thread(void *Context)
+{
+	image_t *Image = Context;
+	pthread_mutex_lock(&Image->Mutex);
+	for (;;)
+	{
+		while (Image->Checked == Image->Posted)
+			pthread_cond_wait(&Image->Cond, &Image->Mutex);
+		if (Image->Posted == 0xFFFFFFFF)
+			break;
+		pthread_mutex_unlock(&Image->Mutex);
+		Image_Check(Image, &Image->Slot[Image->Checked % 2]);
+		pthread_mutex_lock(&Image->Mutex);
+		Image->Checked++;
+		pthread_cond_broadcast(&Image->Cond);
+	}
+	pthread_mutex_unlock(&Image->Mutex);
+	return NULL;
+}
+//###################################################################################################################
+static void Image_WaitChecked(image_t *Image, uint32_t Count)
+{
+	pthread_mutex_lock(&Image->Mutex);
+	while (Image->Checked < Count)
+		pthread_cond_wait(&Image->Cond, &Image->Mutex);
+	pthread_mutex_unlock(&Image->Mutex);
+}
+//###################################################################################################################
+static bool Image_Producer(uint8_t *pPage, uint32_t Index, void *Context)
+{
+	memcpy(pPage, (const uint8_t *)Context + Index * IMAGE_PAGE, IMAGE_PAGE);
+	return true;
+}
+//###################################################################################################################
+// programs the pages of one sector that differ from the chip content, in runs
+static void Image_WriteSector(image_t *Image, const uint8_t *pChip, const uint8_t *pWant, uint32_t Address)
+{
+	uint8_t Work[2 * IMAGE_PAGE];
+	uint32_t Page = 0, Run;
+	while (Page < IMAGE_SECTOR / IMAGE_PAGE)
+	{
+		for (Run = 0; Page + Run < IMAGE_SECTOR / IMAGE_PAGE; Run++)
+		{
+			if ((pChip != NULL) ? (memcmp(&pChip[(Page + Run) * IMAGE_PAGE], &pWant[(Page + Run) * IMAGE_PAGE], IMAGE_PAGE) == 0)
+								: Image_IsBlank(&pWant[(Page + Run) * IMAGE_PAGE], IMAGE_PAGE))
+				break;
+		}
+		if (Run > 0)
+			W25qxx_WritePipeline(Address / IMAGE_PAGE + Page, Run, Image_Producer, (void *)&pWant[Page * IMAGE_PAGE], Work);
+		Page += Run + 1;
+	}
+	W25qxx_ReadBytes(Image->Check, Address, IMAGE_SECTOR);
+	if (memcmp(Image->Check, pWant, IMAGE_SECTOR) != 0)
+	{
+		Image->Failed++;
+		fprintf(stderr, "sector at 0x%08X: program failed\n", Address);
+	}
+}
+//###################################################################################################################
+// the chip side of program for one checked chunk
+static void Image_Apply(image_t *Image, image_slot_t *Slot)
+{
+	uint32_t Sectors = Slot->Size / IMAGE_SECTOR;
+	uint32_t Erases = 0, Address;
+	bool Block;
+	for (uint32_t i = 0; i < Sectors; i++)
+	{
+		if ((Slot->Action[i] == IMAGE_ERASE) || (Slot->Action[i] == IMAGE_ERASE_WRITE))
+			Erases++;
+	}
+	Block = (Sectors == IMAGE_CHUNK / IMAGE_SECTOR) && (Erases == Sectors) && ((Slot->Address % IMAGE_CHUNK) == 0);
+	if (Block == true)
+	{
+		W25qxx_EraseBlock(Slot->Address / IMAGE_CHUNK);
+		Image->BlockErases++;
+	}
+	for (uint32_t i = 0; i < Sectors; i++)
+	{
+		Address = Slot->Address + i * IMAGE_SECTOR;
+		Image->Sectors++;
+		switch (Slot->Action[i])
+		{
+		case IMAGE_SKIP:
+			Image->Unchanged++;
+			break;
+		case IMAGE_ERASE:
+			if (Block == false)
+				W25qxx_EraseSector(Address / IMAGE_SECTOR);
+			Image->Erased++;
+			break;
+		case IMAGE_WRITE:
+			Image_WriteSector(Image, &Slot->Data[i * IMAGE_SECTOR], &Slot->Want[i * IMAGE_SECTOR], Address);
+			Image->WrittenNoErase++;
+			break;
+		case IMAGE_ERASE_WRITE:
+			if (Block == false)
+				W25qxx_EraseSector(Address / IMAGE_SECTOR);
+			Image_WriteSector(Image, NULL, &Slot->Want[i * IMAGE_SECTOR], Address);
+			Image->Written++;
+			break;
+		}
+	}
+}
+//###################################################################################################################
+// reads chunk n while the thread checks chunk n - 1, then applies chunk n - 1 while the thread checks chunk n
+static void Image_Run(image_t *Image, uint32_t Size)
+{
+	uint32_t Chunks = (Size + IMAGE_CHUNK - 1) / IMAGE_CHUNK;
+	image_slot_t *Slot;
+	pthread_mutex_init(&Image->Mutex, NULL);
+	pthread_cond_init(&Image->Cond, NULL);
+	pthread_create(&Image->Thread, NULL, Image_Thread, Image);
+	for (uint32_t n = 0; n < Chunks; n++)
+	{
+		if (n >= 2)
+			Image_WaitChecked(Image, n - 1);
+		Slot = &Image->Slot[n % 2];
+		Slot->Address = Image->Offset + n * IMAGE_CHUNK;
+		Slot->Size = ((n + 1) * IMAGE_CHUNK <= Size) ? IMAGE_CHUNK : Size - n * IMAGE_CHUNK;
+		W25qxx_ReadBytes(Slot->Data, Slot->Address, Slot->Size);
+		pthread_mutex_lock(&Image->Mutex);
+		Image->Posted++;
+		pthread_cond_broadcast(&Image->Cond);
+		pthread_mutex_unlock(&Image->Mutex);
+		if ((Image->Mode == IMAGE_PROGRAM) && (n >= 1))
+		{
+			Image_WaitChecked(Image, n);
+			Image_Apply(Image, &Image->Slot[(n - 1) % 2]);
+		}
+	}
+	Image_WaitChecked(Image, Chunks);
+	if ((Image->Mode == IMAGE_PROGRAM) && (Chunks >= 1))
+		Image_Apply(Image, &Image->Slot[(Chunks - 1) % 2]);
+	pthread_mutex_lock(&Image->Mutex);
+	Image->Posted = 0xFFFFFFFF;
+	pthread_cond_broadcast(&Image->Cond);
+	pthread_mutex_unlock(&Image->Mutex);
+	pthread_join(Image->Thread, NULL);
+}
+//###################################################################################################################
+static int Image_Usage(void)
+{
+	fprintf(stderr, "usage: w25qxx-image [-s Hz] [-o offset] [-n size] DEVICE dump|program|verify FILE\n"
+					"  DEVICE is /dev/spidevX.Y or a file used as simulated chip\n");
+	return 2;
+}
+//###################################################################################################################
+int main(int argc, char **argv)
+{
+	static image_t Image;
+	uint32_t Speed = 10000000, Size = 0, Capacity, Start, Time;
+	int Opt, Fd;
+	struct stat St;
+	W25QXX_SpidevStats_t Stats;
+	while ((Opt = getopt(argc, argv, "s:o:n:")) != -1)
+	{
+		if (Opt == 's')
+			Speed = strtoul(optarg, NULL, 0);
+		else if (Opt == 'o')
+			Image.Offset = strtoul(optarg, NULL, 0);
+		else if (Opt == 'n')
+			Size = strtoul(optarg, NULL, 0);
+		else
+			return Image_Usage();
+	}
+	if (argc - optind != 3)
+		return Image_Usage();
+	if (strcmp(argv[optind + 1], "dump") == 0)
+		Image.Mode = IMAGE_DUMP;
+	else if (strcmp(argv[optind + 1], "program") == 0)
+		Image.Mode = IMAGE_PROGRAM;
+	else if (strcmp(argv[optind + 1], "verify") == 0)
+		Image.Mode = IMAGE_VERIFY;
+	else
+		return Image_Usage();
+	if (W25qxx_SpidevOpen(&hspi1, argv[optind], Speed) == false)
+	{
+		perror(argv[optind]);
+		return 2;
+	}
+	if (W25qxx_Init() == false)
+	{
+		fprintf(stderr, "%s: no w25qxx found\n", argv[optind]);
+		return 2;
+	}
+	Capacity = w25qxx.SectorCount * w25qxx.SectorSize;
+	if ((Image.Offset >= Capacity) || ((Image.Mode == IMAGE_PROGRAM) && ((Image.Offset % IMAGE_SECTOR) != 0)))
+	{
+		fprintf(stderr, "offset 0x%X outside the chip or not sector aligned\n", Image.Offset);
+		return 2;
+	}
+	// map the image, a new one for dump
+	if (Image.Mode == IMAGE_DUMP)
+	{
+		if ((Size == 0) || (Size > Capacity - Image.Offset))
+			Size = Capacity - Image.Offset;
+		Fd = open(argv[optind + 2], O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if ((Fd < 0) || (ftruncate(Fd, Size) < 0))
+		{
+			perror(argv[optind + 2]);
+			return 2;
+		}
+		Image.Image = mmap(NULL, Size, PROT_READ | PROT_WRITE, MAP_SHARED, Fd, 0);
+	}
+	else
+	{
+		Fd = open(argv[optind + 2], O_RDONLY);
+		if ((Fd < 0) || (fstat(Fd, &St) < 0) || (St.st_size == 0))
+		{
+			fprintf(stderr, "%s: can not open or empty\n", argv[optind + 2]);
+			return 2;
+		}
+		if ((uint64_t)St.st_size > Capacity - Image.Offset)
+		{
+			fprintf(stderr, "%s: bigger than the chip\n", argv[optind + 2]);
+			return 2;
+		}
+		Size = St.st_size;
+		Image.Image = mmap(NULL, Size, PROT_READ, MAP_PRIVATE, Fd, 0);
+		// program works on whole sectors
+		if (Image.Mode == IMAGE_PROGRAM)
+			Size = (Size + IMAGE_SECTOR - 1) / IMAGE_SECTOR * IMAGE_SECTOR;
+	}
+	if (Image.Image == MAP_FAILED)
+	{
+		perror(argv[optind + 2]);
+		return 2;
+	}
+	Image.ImageSize = (Image.Mode == IMAGE_PROGRAM) ? (uint32_t)St.st_size : Size;
+	Image_CrcInit();
+	Start = HAL_GetTick();
+	Image_Run(&Image, Size);
+	Time = HAL_GetTick() - Start;
+	W25qxx_SpidevStats(&hspi1, &Stats, false);
+	switch (Image.Mode)
+	{
+	case IMAGE_DUMP:
+		msync(Image.Image, Size, MS_SYNC);
+		printf("dump: %u bytes from 0x%08X, crc32 0x%08X\n", Size, Image.Offset, Image.Crc);
+		break;
+	case IMAGE_VERIFY:
+		printf("verify: %u bytes at 0x%08X, crc32 0x%08X, %u sectors differ", Size, Image.Offset, Image.Crc, Image.Differ);
+		if (Image.Differ > 0)
+			printf(", first at 0x%08X", Image.FirstDiffer);
+		printf("\n");
+		break;
+	case IMAGE_PROGRAM:
+		printf("program: %u sectors, %u unchanged, %u erased, %u programmed (%u without erase), %u block erases, %u failed, crc32 0x%08X\n",
+			   Image.Sectors, Image.Unchanged, Image.Erased, Image.Written + Image.WrittenNoErase, Image.WrittenNoErase, Image.BlockErases,
+			   Image.Failed, Image.Crc);
+		break;
+	}
+	printf("%u ms, %u spi messages, %llu bytes on the bus, %u errors\n", Time, Stats.Messages, (unsigned long long)Stats.Bytes, Stats.Errors);
+	munmap(Image.Image, Size);
+	close(Fd);
+	W25qxx_SpidevClose(&hspi1);
+	if (Stats.Errors > 0)
+		return 2;
+	return ((Image.Differ > 0) || (Image.Failed > 0)) ? 1 : 0;
+}
+//###################################################################################################################
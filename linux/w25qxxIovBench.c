@@ -0,0 +1,210 @@
+/*
+  w25qxx-iovbench: records of three parts written and read with a staging buffer and with
+  W25qxx_WriteV()/W25qxx_ReadV(), copies, bus traffic and time, on a Linux host.
+
+    w25qxx-iovbench [-n records] DEVICE
+
+  A record is a 16 byte header, a payload of 1 to 700 bytes and a 4 byte trailer, each in
+  its own buffer, the records go back to back from address 0 on. Staged: the parts are
+  copied into one buffer for W25qxx_WriteBytes() and out of it after W25qxx_ReadBytes().
+  Vectored: W25qxx_WriteV() and W25qxx_ReadV() take the parts where they are. Both runs
+  count the bytes the caller copies, page programs, SPI messages and transfers, and check
+  the data read back. WriteV has to program every page a record touches once.
+
+  DEVICE is /dev/spidevX.Y or a file used as simulated chip (see w25qxxSpidev.h), times
+  and programs are counted on a simulated chip only.
+
+  Exit code 0 when the records read back right, 1 on differences, programs other than one
+  per page or commands the busy simulated chip ignored, 2 on errors.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "w25qxx.h"
+#include "w25qxxSpidev.h"
+
+#define IOVBENCH_HEADER 16
+#define IOVBENCH_PAYLOAD 700 // at most
+#define IOVBENCH_TRAILER 4
+#define IOVBENCH_RECORD (IOVBENCH_HEADER + IOVBENCH_PAYLOAD + IOVBENCH_TRAILER)
+
+typedef struct
+{
+	uint32_t Records;
+	uint32_t *Length; // of the payloads
+	uint32_t Bytes; // of all records
+	uint32_t Pages; // a record touches, summed up
+	uint32_t Differ; // records
+	uint32_t Ignored; // commands the busy simulated chip ignored
+	uint64_t Copied; // bytes copied by the caller
+	uint8_t Header[IOVBENCH_HEADER];
+	uint8_t Payload[IOVBENCH_PAYLOAD];
+	uint8_t Trailer[IOVBENCH_TRAILER];
+	uint8_t Back[3][IOVBENCH_PAYLOAD];
+	uint8_t Stage[IOVBENCH_RECORD];
+
+} iovbench_t;
+
+static iovbench_t IovBench;
+
+//###################################################################################################################
+static void IovBench_Fill(uint32_t Record)
+{
+	for (uint32_t i = 0; i < IOVBENCH_HEADER; i++)
+		IovBench.Header[i] = (uint8_t)(Record >> (8 * (i % 4)));
+	for (uint32_t i = 0; i < IovBench.Length[Record]; i++)
+		IovBench.Payload[i] = (uint8_t)(Record * 7 + i * 13);
+	for (uint32_t i = 0; i < IOVBENCH_TRAILER; i++)
+		IovBench.Trailer[i] = (uint8_t)~Record;
+}
+//###################################################################################################################
+static void IovBench_Compare(uint32_t Record)
+{
+	if ((memcmp(IovBench.Back[0], IovBench.Header, IOVBENCH_HEADER) != 0) || (memcmp(IovBench.Back[1], IovBench.Payload, IovBench.Length[Record]) != 0) ||
+		(memcmp(IovBench.Back[2], IovBench.Trailer, IOVBENCH_TRAILER) != 0))
+		IovBench.Differ++;
+}
+//###################################################################################################################
+static void IovBench_Run(bool Vectored)
+{
+	W25QXX_IoVec_t Iov[3];
+	W25QXX_SpidevStats_t Write, Read;
+	uint32_t Address, Length;
+	uint64_t Start, WriteTime, ReadTime;
+	for (uint32_t s = 0; s < (IovBench.Bytes + w25qxx.SectorSize - 1) / w25qxx.SectorSize; s++)
+		W25qxx_EraseSector(s);
+	IovBench.Copied = 0;
+	W25qxx_SpidevStats(&hspi1, NULL, true);
+	Start = W25qxx_SpidevMicros();
+	Address = 0;
+	for (uint32_t r = 0; r < IovBench.Records; r++)
+	{
+		IovBench_Fill(r);
+		Length = IOVBENCH_HEADER + IovBench.Length[r] + IOVBENCH_TRAILER;
+		if (Vectored == true)
+		{
+			Iov[0].Buffer = IovBench.Header;
+			Iov[0].Length = IOVBENCH_HEADER;
+			Iov[1].Buffer = IovBench.Payload;
+			Iov[1].Length = IovBench.Length[r];
+			Iov[2].Buffer = IovBench.Trailer;
+			Iov[2].Length = IOVBENCH_TRAILER;
+			W25qxx_WriteV(Address, Iov, 3);
+		}
+		else
+		{
+			memcpy(IovBench.Stage, IovBench.Header, IOVBENCH_HEADER);
+			memcpy(&IovBench.Stage[IOVBENCH_HEADER], IovBench.Payload, IovBench.Length[r]);
+			memcpy(&IovBench.Stage[IOVBENCH_HEADER + IovBench.Length[r]], IovBench.Trailer, IOVBENCH_TRAILER);
+			IovBench.Copied += Length;
+			W25qxx_WriteBytes(IovBench.Stage, Address, Length);
+		}
+		Address += Length;
+	}
+	W25qxx_WriteFlush();
+	W25qxx_WaitReady();
+	WriteTime = W25qxx_SpidevMicros() - Start;
+	W25qxx_SpidevStats(&hspi1, &Write, true);
+	Start = W25qxx_SpidevMicros();
+	Address = 0;
+	for (uint32_t r = 0; r < IovBench.Records; r++)
+	{
+		Length = IOVBENCH_HEADER + IovBench.Length[r] + IOVBENCH_TRAILER;
+		if (Vectored == true)
+		{
+			Iov[0].Buffer = IovBench.Back[0];
+			Iov[0].Length = IOVBENCH_HEADER;
+			Iov[1].Buffer = IovBench.Back[1];
+			Iov[1].Length = IovBench.Length[r];
+			Iov[2].Buffer = IovBench.Back[2];
+			Iov[2].Length = IOVBENCH_TRAILER;
+			W25qxx_ReadV(Address, Iov, 3);
+		}
+		else
+		{
+			W25qxx_ReadBytes(IovBench.Stage, Address, Length);
+			memcpy(IovBench.Back[0], IovBench.Stage, IOVBENCH_HEADER);
+			memcpy(IovBench.Back[1], &IovBench.Stage[IOVBENCH_HEADER], IovBench.Length[r]);
+			memcpy(IovBench.Back[2], &IovBench.Stage[IOVBENCH_HEADER + IovBench.Length[r]], IOVBENCH_TRAILER);
+			IovBench.Copied += Length;
+		}
+		IovBench_Fill(r);
+		IovBench_Compare(r);
+		Address += Length;
+	}
+	ReadTime = W25qxx_SpidevMicros() - Start;
+	W25qxx_SpidevStats(&hspi1, &Read, false);
+	printf("%-8s write: %.0f ms, %u programs, %.1f messages and %.1f transfers per record\n", (Vectored == true) ? "vectored" : "staged", WriteTime / 1000.0,
+		   Write.Programs, (double)Write.Messages / IovBench.Records, (double)Write.Transfers / IovBench.Records);
+	printf("%-8s read:  %.0f ms, %.1f messages and %.1f transfers per record, %.1f copied bytes per record\n", (Vectored == true) ? "vectored" : "staged",
+		   ReadTime / 1000.0, (double)Read.Messages / IovBench.Records, (double)Read.Transfers / IovBench.Records, (double)IovBench.Copied / IovBench.Records);
+	IovBench.Ignored += Write.Ignored + Read.Ignored;
+	// one program per page a record touches, simulated chips only
+	if ((Vectored == true) && (hspi1.Sim != NULL) && (Write.Programs != IovBench.Pages))
+	{
+		printf("%u programs, %u pages touched\n", Write.Programs, IovBench.Pages);
+		IovBench.Differ++;
+	}
+}
+//###################################################################################################################
+static int IovBench_Usage(void)
+{
+	fprintf(stderr, "usage: w25qxx-iovbench [-n records] DEVICE\n"
+					"  DEVICE is /dev/spidevX.Y or a file used as simulated chip, the records from address 0 on are overwritten\n");
+	return 2;
+}
+//###################################################################################################################
+int main(int argc, char **argv)
+{
+	uint32_t Seed = 5, Length;
+	int Opt;
+	IovBench.Records = 200;
+	while ((Opt = getopt(argc, argv, "n:")) != -1)
+	{
+		if (Opt == 'n')
+			IovBench.Records = strtoul(optarg, NULL, 0);
+		else
+			return IovBench_Usage();
+	}
+	if ((argc - optind != 1) || (IovBench.Records == 0))
+		return IovBench_Usage();
+	if (W25qxx_SpidevOpen(&hspi1, argv[optind], 20000000) == false)
+	{
+		perror(argv[optind]);
+		return 2;
+	}
+	if (W25qxx_Init() == false)
+	{
+		fprintf(stderr, "%s: no w25qxx found\n", argv[optind]);
+		return 2;
+	}
+	IovBench.Length = malloc(IovBench.Records * sizeof(uint32_t));
+	if (IovBench.Length == NULL)
+		return 2;
+	for (uint32_t r = 0; r < IovBench.Records; r++)
+	{
+		Seed ^= Seed << 13;
+		Seed ^= Seed >> 17;
+		Seed ^= Seed << 5;
+		IovBench.Length[r] = 1 + Seed % IOVBENCH_PAYLOAD;
+		Length = IOVBENCH_HEADER + IovBench.Length[r] + IOVBENCH_TRAILER;
+		IovBench.Pages += (IovBench.Bytes + Length - 1) / w25qxx.PageSize - IovBench.Bytes / w25qxx.PageSize + 1;
+		IovBench.Bytes += Length;
+	}
+	if (IovBench.Bytes > w25qxx.SectorCount * w25qxx.SectorSize)
+	{
+		fprintf(stderr, "%u records do not fit the chip\n", IovBench.Records);
+		return 2;
+	}
+	printf("%u records, %u bytes\n", IovBench.Records, IovBench.Bytes);
+	IovBench_Run(false);
+	IovBench_Run(true);
+	printf("%u records differ, %u commands ignored while busy\n", IovBench.Differ, IovBench.Ignored);
+	W25qxx_SpidevClose(&hspi1);
+	free(IovBench.Length);
+	return ((IovBench.Differ > 0) || (IovBench.Ignored > 0)) ? 1 : 0;
+}
+//###################################################################################################################
@@ -0,0 +1,247 @@
+/*
+  w25qxx-logstress: stress test of the log queue (w25qxxLogQueue.h) on a Linux host.
+
+    w25qxx-logstress [-t threads] [-n records] [-r slots] DEVICE
+
+  Producer threads push records numbered per thread as fast as they can, retrying when
+  the ring is full. A timer signal stands in for an interrupt: its handler pushes records
+  of its own in the middle of the pushes of the first thread and does not retry. One thread
+  drains into the chip. The log is read back after: every accepted record must be there
+  once, intact and in the order of its producer.
+
+  DEVICE is /dev/spidevX.Y or a file used as simulated chip (see w25qxxSpidev.h). The
+  sectors the log needs from address 0 on are erased first.
+
+  Exit code 0 when the log is right, 1 on lost, doubled or broken records, 2 on errors.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/time.h>
+
+#include "w25qxx.h"
+#include "w25qxxLogQueue.h"
+#include "w25qxxSpidev.h"
+
+#define LOGSTRESS_MAGIC 0x5A17
+#define LOGSTRESS_THREADS 64
+#define LOGSTRESS_TIMER_US 100
+
+typedef struct
+{
+	uint16_t Producer; // thread, LogStress.Threads for the timer signal
+	uint16_t Magic;
+	uint32_t Seq; // per producer, counts the accepted records
+	uint32_t Check[2];
+
+} logstress_record_t;
+
+typedef struct
+{
+	w25qxx_logqueue_t Queue;
+	uint32_t *Storage;
+	uint32_t Threads;
+	uint32_t Records; // per thread
+	uint32_t Accepted[LOGSTRESS_THREADS + 1]; // last one by the timer signal
+	uint32_t SignalDropped;
+	volatile int Stop;
+	// read back
+	uint32_t Found[LOGSTRESS_THREADS + 1];
+	uint32_t Broken;
+	uint32_t OutOfOrder;
+
+} logstress_t;
+
+static logstress_t LogStress;
+
+//###################################################################################################################
+static void LogStress_Fill(logstress_record_t *Record, uint16_t Producer, uint32_t Seq)
+{
+	Record->Producer = Producer;
+	Record->Magic = LOGSTRESS_MAGIC;
+	Record->Seq = Seq;
+	Record->Check[0] = Seq * 2654435761u + Producer;
+	Record->Check[1] = ~Record->Check[0];
+}
+//###################################################################################################################
+// the "interrupt", only the first producer takes it, a push in progress there included
+static void LogStress_Signal(int Signal)
+{
+	logstress_record_t Record;
+	(void)Signal;
+	// as many as a thread at most, the log region is sized for that
+	if (LogStress.Accepted[LogStress.Threads] == LogStress.Records)
+		return;
+	LogStress_Fill(&Record, LogStress.Threads, LogStress.Accepted[LogStress.Threads]);
+	if (W25qxx_LogPush(&LogStress.Queue, &Record) == true)
+		LogStress.Accepted[LogStress.Threads]++;
+	else
+		LogStress.SignalDropped++;
+}
+//###################################################################################################################
+static void *LogStress_Producer(void *Arg)
+{
+	uint16_t Producer = (uint16_t)(uintptr_t)Arg;
+	logstress_record_t Record;
+	sigset_t Signals;
+	if (Producer == 0)
+	{
+		sigemptyset(&Signals);
+		sigaddset(&Signals, SIGALRM);
+		pthread_sigmask(SIG_UNBLOCK, &Signals, NULL);
+	}
+	for (uint32_t Seq = 0; Seq < LogStress.Records; Seq++)
+	{
+		LogStress_Fill(&Record, Producer, Seq);
+		while (W25qxx_LogPush(&LogStress.Queue, &Record) == false)
+			sched_yield();
+		LogStress.Accepted[Producer]++;
+	}
+	return NULL;
+}
+//###################################################################################################################
+static void *LogStress_Drain(void *Arg)
+{
+	(void)Arg;
+	while (LogStress.Stop == 0)
+	{
+		if (W25qxx_LogDrain(&LogStress.Queue, false) == 0)
+			usleep(50);
+	}
+	return NULL;
+}
+//###################################################################################################################
+// pages from the start of the log to Pages
+static void LogStress_Check(uint32_t Pages)
+{
+	uint8_t Page[256];
+	logstress_record_t Record;
+	uint32_t PerPage = w25qxx.PageSize / sizeof(logstress_record_t);
+	for (uint32_t p = 0; p < Pages; p++)
+	{
+		W25qxx_ReadBytes(Page, p * w25qxx.PageSize, w25qxx.PageSize);
+		for (uint32_t i = 0; i < PerPage; i++)
+		{
+			memcpy(&Record, &Page[i * sizeof(Record)], sizeof(Record));
+			if ((Record.Producer == 0xFFFF) && (Record.Magic == 0xFFFF))
+				continue;
+			if ((Record.Magic != LOGSTRESS_MAGIC) || (Record.Producer > LogStress.Threads) || (Record.Check[0] != Record.Seq * 2654435761u + Record.Producer) ||
+				(Record.Check[1] != ~Record.Check[0]))
+			{
+				LogStress.Broken++;
+				continue;
+			}
+			if (Record.Seq != LogStress.Found[Record.Producer])
+				LogStress.OutOfOrder++;
+			LogStress.Found[Record.Producer] = Record.Seq + 1;
+		}
+	}
+}
+//###################################################################################################################
+static int LogStress_Usage(void)
+{
+	fprintf(stderr, "usage: w25qxx-logstress [-t threads] [-n records] [-r slots] DEVICE\n"
+					"  DEVICE is /dev/spidevX.Y or a file used as simulated chip, the log region is erased\n");
+	return 2;
+}
+//###################################################################################################################
+int main(int argc, char **argv)
+{
+	pthread_t Producer[LOGSTRESS_THREADS], Drain;
+	uint32_t Slots = 1024, Sectors, Total, Lost = 0, Start, Time;
+	struct sigaction Action;
+	struct itimerval Timer;
+	sigset_t Signals;
+	W25QXX_LogQueueStats_t Stats;
+	int Opt;
+	LogStress.Threads = 8;
+	LogStress.Records = 10000;
+	while ((Opt = getopt(argc, argv, "t:n:r:")) != -1)
+	{
+		if (Opt == 't')
+			LogStress.Threads = strtoul(optarg, NULL, 0);
+		else if (Opt == 'n')
+			LogStress.Records = strtoul(optarg, NULL, 0);
+		else if (Opt == 'r')
+			Slots = strtoul(optarg, NULL, 0);
+		else
+			return LogStress_Usage();
+	}
+	if ((argc - optind != 1) || (LogStress.Threads == 0) || (LogStress.Threads > LOGSTRESS_THREADS))
+		return LogStress_Usage();
+	if (W25qxx_SpidevOpen(&hspi1, argv[optind], 20000000) == false)
+	{
+		perror(argv[optind]);
+		return 2;
+	}
+	if (W25qxx_Init() == false)
+	{
+		fprintf(stderr, "%s: no w25qxx found\n", argv[optind]);
+		return 2;
+	}
+	// the timer signal is one producer more
+	Total = (LogStress.Threads + 1) * LogStress.Records;
+	Sectors = Total / (w25qxx.SectorSize / sizeof(logstress_record_t)) + 2;
+	if (Sectors > w25qxx.SectorCount)
+	{
+		fprintf(stderr, "%u records do not fit the chip\n", Total);
+		return 2;
+	}
+	for (uint32_t s = 0; s < Sectors; s++)
+		W25qxx_EraseSector(s);
+	LogStress.Storage = malloc(W25QXX_LOGQ_STORAGE_WORDS(Slots, sizeof(logstress_record_t)) * sizeof(uint32_t));
+	if ((LogStress.Storage == NULL) || (W25qxx_LogQueueInit(&LogStress.Queue, LogStress.Storage, Slots, sizeof(logstress_record_t), 0, Sectors) == false))
+	{
+		fprintf(stderr, "ring of %u slots not possible (power of 2)\n", Slots);
+		return 2;
+	}
+	memset(&Action, 0, sizeof(Action));
+	Action.sa_handler = LogStress_Signal;
+	Action.sa_flags = SA_RESTART;
+	sigaction(SIGALRM, &Action, NULL);
+	// blocked in every thread but the first producer
+	sigemptyset(&Signals);
+	sigaddset(&Signals, SIGALRM);
+	pthread_sigmask(SIG_BLOCK, &Signals, NULL);
+	Start = HAL_GetTick();
+	pthread_create(&Drain, NULL, LogStress_Drain, NULL);
+	for (uint32_t t = 0; t < LogStress.Threads; t++)
+		pthread_create(&Producer[t], NULL, LogStress_Producer, (void *)(uintptr_t)t);
+	Timer.it_interval.tv_sec = 0;
+	Timer.it_interval.tv_usec = LOGSTRESS_TIMER_US;
+	Timer.it_value = Timer.it_interval;
+	setitimer(ITIMER_REAL, &Timer, NULL);
+	for (uint32_t t = 0; t < LogStress.Threads; t++)
+		pthread_join(Producer[t], NULL);
+	memset(&Timer, 0, sizeof(Timer));
+	setitimer(ITIMER_REAL, &Timer, NULL);
+	while (W25qxx_LogLevel(&LogStress.Queue) > 0)
+		usleep(100);
+	LogStress.Stop = 1;
+	pthread_join(Drain, NULL);
+	W25qxx_LogDrain(&LogStress.Queue, true);
+	Time = HAL_GetTick() - Start;
+	W25qxx_LogQueueStats(&LogStress.Queue, &Stats, false);
+	LogStress_Check(LogStress.Queue.Page + ((LogStress.Queue.Used > 0) ? 1 : 0));
+	Total = 0;
+	for (uint32_t p = 0; p <= LogStress.Threads; p++)
+	{
+		Total += LogStress.Accepted[p];
+		if (LogStress.Found[p] != LogStress.Accepted[p])
+			Lost++;
+	}
+	printf("%u records from %u threads and %u from the timer signal (%u dropped there), %u ms, %.0f records/s\n", Total - LogStress.Accepted[LogStress.Threads],
+		   LogStress.Threads, LogStress.Accepted[LogStress.Threads], LogStress.SignalDropped, Time, Total * 1000.0 / ((Time > 0) ? Time : 1));
+	printf("queue: %u pushed, %u full, %u drained, %u pages, %u erases, at most %u waiting\n", Stats.Pushed, Stats.Dropped, Stats.Drained, Stats.Pages,
+		   Stats.Erases, Stats.HighWater);
+	printf("log: %u producers with lost records, %u out of order, %u broken\n", Lost, LogStress.OutOfOrder, LogStress.Broken);
+	free(LogStress.Storage);
+	W25qxx_SpidevClose(&hspi1);
+	return ((Lost > 0) || (LogStress.OutOfOrder > 0) || (LogStress.Broken > 0) || (Stats.Pushed != Total) || (Stats.Drained != Total)) ? 1 : 0;
+}
+//###################################################################################################################
@@ -0,0 +1,218 @@
+/*
+  w25qxx-lzbench: compression ratio, capacity and throughput of the compressed chunk log
+  (w25qxxLz.h) for four kinds of data, on a Linux host.
+
+    w25qxx-lzbench [-c chunk] [-n chunks] DEVICE
+
+  Chunks chunks of Chunk bytes are written with W25qxx_WriteBytes() as they are and with
+  W25qxx_LzWrite(), then read back all, with W25qxx_ReadBytes() and W25qxx_LzRead(). The
+  data: binary records of 32 bytes (time stamp and eight slow 16 bit values), CSV lines
+  of the same kind, random bytes and a flat fill. The log is mounted again after each kind
+  and has to find all its chunks. The log takes the sectors from 0 on, the plain copy the
+  same number of sectors after it.
+
+  DEVICE is /dev/spidevX.Y or a file used as simulated chip (see w25qxxSpidev.h), times
+  on a simulated chip are simulated.
+
+  Exit code 0 when every chunk reads back right, 1 on differences or commands the busy
+  simulated chip ignored, 2 on errors.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "w25qxxLz.h"
+#include "w25qxxSpidev.h"
+
+typedef struct
+{
+	uint16_t Chunk; // bytes
+	uint32_t Chunks;
+	uint32_t Sectors; // of the log, as many for the plain copy
+	uint32_t Seed;
+	uint8_t *Data;
+	uint8_t *Back;
+	uint16_t *Work;
+	uint32_t Differ; // chunks
+	uint32_t Ignored; // commands the busy simulated chip ignored
+
+} lzbench_t;
+
+static lzbench_t LzBench;
+
+//###################################################################################################################
+static uint32_t LzBench_Random(void)
+{
+	LzBench.Seed ^= LzBench.Seed << 13;
+	LzBench.Seed ^= LzBench.Seed >> 17;
+	LzBench.Seed ^= LzBench.Seed << 5;
+	return LzBench.Seed;
+}
+//###################################################################################################################
+static void LzBench_Generate(uint8_t Kind)
+{
+	uint32_t Size = LzBench.Chunk * LzBench.Chunks, Offset = 0, Time = 100000, Record = 0, Length;
+	uint8_t Line[96];
+	int16_t Value;
+	while (Offset < Size)
+	{
+		if (Kind == 0)
+		{
+			memset(Line, 0, 32);
+			memcpy(Line, &Time, 4);
+			for (uint32_t k = 0; k < 8; k++)
+			{
+				Value = (int16_t)(1000 * sin((Record + k * 13) / 50.0)) + LzBench_Random() % 4;
+				memcpy(&Line[4 + 2 * k], &Value, 2);
+			}
+			Line[20] = 1;
+			Line[21] = (uint8_t)Record;
+			Length = 32;
+		}
+		else if (Kind == 1)
+			Length = snprintf((char *)Line, sizeof(Line), "%u,%.2f,%.2f,%.1f,OK\n", Time, 20.0 + sin(Record / 100.0) * 3 + (LzBench_Random() % 10) / 100.0,
+							  1013.25 + cos(Record / 300.0), 45.0 + (LzBench_Random() % 5) / 10.0);
+		else if (Kind == 2)
+		{
+			Line[0] = (uint8_t)LzBench_Random();
+			Length = 1;
+		}
+		else
+		{
+			Line[0] = (uint8_t)(Offset / LzBench.Chunk);
+			Length = 1;
+		}
+		if (Length > Size - Offset)
+			Length = Size - Offset;
+		memcpy(&LzBench.Data[Offset], Line, Length);
+		Offset += Length;
+		Time += 10;
+		Record++;
+	}
+}
+//###################################################################################################################
+static double LzBench_Rate(uint32_t Bytes, uint64_t Time)
+{
+	return Bytes / 1024.0 / ((Time > 0) ? Time / 1e6 : 1e-6);
+}
+//###################################################################################################################
+static void LzBench_Run(uint8_t Kind)
+{
+	static const char *Name[4] = {"binary", "csv", "random", "flat"};
+	w25qxx_lz_t Lz, Mounted;
+	W25QXX_LzStats_t Stats;
+	W25QXX_SpidevStats_t Spi;
+	uint32_t Size = LzBench.Chunk * LzBench.Chunks, Raw = LzBench.Sectors * w25qxx.SectorSize;
+	uint64_t Start, RawWrite, RawRead, LzWrite, LzRead;
+	LzBench.Seed = 1;
+	LzBench_Generate(Kind);
+	for (uint32_t s = 0; s < LzBench.Sectors; s++)
+		W25qxx_EraseSector(LzBench.Sectors + s);
+	if (W25qxx_LzInit(&Lz, 0, LzBench.Sectors, LzBench.Chunk, (uint8_t *)LzBench.Work) == false)
+	{
+		LzBench.Differ++;
+		return;
+	}
+	W25qxx_LzFormat(&Lz);
+	W25qxx_SpidevStats(&hspi1, NULL, true);
+	Start = W25qxx_SpidevMicros();
+	W25qxx_WriteBytes(LzBench.Data, Raw, Size);
+	W25qxx_WriteFlush();
+	W25qxx_WaitReady();
+	RawWrite = W25qxx_SpidevMicros() - Start;
+	Start = W25qxx_SpidevMicros();
+	for (uint32_t c = 0; c < LzBench.Chunks; c++)
+		if (W25qxx_LzWrite(&Lz, &LzBench.Data[c * LzBench.Chunk]) != c)
+			LzBench.Differ++;
+	W25qxx_LzFlush(&Lz);
+	W25qxx_WaitReady();
+	LzWrite = W25qxx_SpidevMicros() - Start;
+	W25qxx_LzStats(&Lz, &Stats, false);
+	Start = W25qxx_SpidevMicros();
+	for (uint32_t c = 0; c < LzBench.Chunks; c++)
+		W25qxx_ReadBytes(&LzBench.Back[c * LzBench.Chunk], Raw + c * LzBench.Chunk, LzBench.Chunk);
+	RawRead = W25qxx_SpidevMicros() - Start;
+	if (memcmp(LzBench.Back, LzBench.Data, Size) != 0)
+		LzBench.Differ++;
+	memset(LzBench.Back, 0, Size);
+	Start = W25qxx_SpidevMicros();
+	for (uint32_t c = 0; c < LzBench.Chunks; c++)
+		if (W25qxx_LzRead(&Lz, c, &LzBench.Back[c * LzBench.Chunk]) == false)
+			LzBench.Differ++;
+	LzRead = W25qxx_SpidevMicros() - Start;
+	for (uint32_t c = 0; c < LzBench.Chunks; c++)
+		if (memcmp(&LzBench.Back[c * LzBench.Chunk], &LzBench.Data[c * LzBench.Chunk], LzBench.Chunk) != 0)
+			LzBench.Differ++;
+	W25qxx_SpidevStats(&hspi1, &Spi, false);
+	LzBench.Ignored += Spi.Ignored;
+	printf("%-6s: ratio %.2f, %u chunks stored, %u sectors against %u, write %.0f KB/s against %.0f, read %.0f KB/s against %.0f\n", Name[Kind],
+		   (double)Stats.InBytes / Stats.OutBytes, Stats.StoredChunks, Lz.Sector - Lz.FirstSector + 1, (Size + w25qxx.SectorSize - 1) / w25qxx.SectorSize,
+		   LzBench_Rate(Size, LzWrite), LzBench_Rate(Size, RawWrite), LzBench_Rate(Size, LzRead), LzBench_Rate(Size, RawRead));
+	// mounted again, the log finds where it ends
+	if ((W25qxx_LzInit(&Mounted, 0, LzBench.Sectors, LzBench.Chunk, (uint8_t *)LzBench.Work) == false) || (Mounted.ChunkCount != Lz.ChunkCount) ||
+		(Mounted.Sector != Lz.Sector) || (Mounted.Used != Lz.Used))
+	{
+		printf("%s: mount found %u chunks, %u were written\n", Name[Kind], Mounted.ChunkCount, Lz.ChunkCount);
+		LzBench.Differ++;
+	}
+}
+//###################################################################################################################
+static int LzBench_Usage(void)
+{
+	fprintf(stderr, "usage: w25qxx-lzbench [-c chunk] [-n chunks] DEVICE\n"
+					"  DEVICE is /dev/spidevX.Y or a file used as simulated chip, twice the sectors the chunks take from address 0 on are overwritten\n");
+	return 2;
+}
+//###################################################################################################################
+int main(int argc, char **argv)
+{
+	int Opt;
+	LzBench.Chunk = 1024;
+	LzBench.Chunks = 400;
+	while ((Opt = getopt(argc, argv, "c:n:")) != -1)
+	{
+		if (Opt == 'c')
+			LzBench.Chunk = strtoul(optarg, NULL, 0);
+		else if (Opt == 'n')
+			LzBench.Chunks = strtoul(optarg, NULL, 0);
+		else
+			return LzBench_Usage();
+	}
+	if ((argc - optind != 1) || (LzBench.Chunk == 0) || (LzBench.Chunks == 0))
+		return LzBench_Usage();
+	if (W25qxx_SpidevOpen(&hspi1, argv[optind], 20000000) == false)
+	{
+		perror(argv[optind]);
+		return 2;
+	}
+	if (W25qxx_Init() == false)
+	{
+		fprintf(stderr, "%s: no w25qxx found\n", argv[optind]);
+		return 2;
+	}
+	// stored chunks take a little more than their size
+	LzBench.Sectors = (LzBench.Chunk * LzBench.Chunks) / (w25qxx.SectorSize - W25QXX_LZ_HEADER_SIZE - 2 * LzBench.Chunk / 256) + 2;
+	if ((LzBench.Chunk > w25qxx.SectorSize - W25QXX_LZ_HEADER_SIZE) || (2 * LzBench.Sectors > w25qxx.SectorCount))
+	{
+		fprintf(stderr, "%u chunks of %u bytes do not fit the chip\n", LzBench.Chunks, LzBench.Chunk);
+		return 2;
+	}
+	LzBench.Data = malloc(LzBench.Chunk * LzBench.Chunks);
+	LzBench.Back = malloc(LzBench.Chunk * LzBench.Chunks);
+	LzBench.Work = malloc(W25QXX_LZ_WORK_SIZE(LzBench.Chunk));
+	if ((LzBench.Data == NULL) || (LzBench.Back == NULL) || (LzBench.Work == NULL))
+		return 2;
+	printf("%u chunks of %u bytes\n", LzBench.Chunks, LzBench.Chunk);
+	for (uint8_t Kind = 0; Kind < 4; Kind++)
+		LzBench_Run(Kind);
+	printf("%u chunks differ, %u commands ignored while busy\n", LzBench.Differ, LzBench.Ignored);
+	W25qxx_SpidevClose(&hspi1);
+	free(LzBench.Data);
+	free(LzBench.Back);
+	free(LzBench.Work);
+	return ((LzBench.Differ > 0) || (LzBench.Ignored > 0)) ? 1 : 0;
+}
+//###################################################################################################################
@@ -0,0 +1,157 @@
+/*
+  w25qxx-pipebench: pipelined page programming (W25qxx_WritePipeline) against one page
+  program after the other, on a Linux host.
+
+    w25qxx-pipebench [-n pages] [-r rounds] DEVICE
+
+  Every page comes from a CPU heavy transform, Rounds passes of an xorshift keystream and
+  a CRC-32 over the page, standing in for compression or encryption. The same pages are
+  written twice from address 0 on: produce a page, then W25qxx_WritePage(), and
+  W25qxx_WritePipeline(), which produces page N+1 while page N programs. Both runs are
+  read back.
+
+  DEVICE is /dev/spidevX.Y or a file used as simulated chip (see w25qxxSpidev.h). On a
+  simulated chip the times are simulated: program and SPI time from its timing model, the
+  transforms take their host time.
+
+  Exit code 0 when both runs read back right, 1 on differences or commands the busy
+  simulated chip ignored, 2 on errors.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "w25qxx.h"
+#include "w25qxxSpidev.h"
+
+typedef struct
+{
+	uint32_t Rounds;
+	uint64_t ProduceTime; // us
+
+} pipebench_t;
+
+static pipebench_t PipeBench;
+
+//###################################################################################################################
+static bool PipeBench_Produce(uint8_t *Page, uint32_t PageIndex, void *Context)
+{
+	uint64_t Start = W25qxx_SpidevMicros();
+	uint32_t Key = PageIndex * 2654435761u + 1, Crc = 0xFFFFFFFF;
+	(void)Context;
+	for (uint32_t i = 0; i < w25qxx.PageSize; i++)
+		Page[i] = (uint8_t)(PageIndex + i * 7);
+	for (uint32_t r = 0; r < PipeBench.Rounds; r++)
+	{
+		for (uint32_t i = 0; i < w25qxx.PageSize; i++)
+		{
+			Key ^= Key << 13;
+			Key ^= Key >> 17;
+			Key ^= Key << 5;
+			Page[i] ^= (uint8_t)Key;
+			Crc ^= Page[i];
+			for (uint8_t b = 0; b < 8; b++)
+				Crc = (Crc >> 1) ^ (0xEDB88320 & (0 - (Crc & 1)));
+		}
+		Page[r % w25qxx.PageSize] ^= (uint8_t)Crc;
+	}
+	PipeBench.ProduceTime += W25qxx_SpidevMicros() - Start;
+	return true;
+}
+//###################################################################################################################
+static void PipeBench_Erase(uint32_t Pages)
+{
+	uint32_t PerSector = w25qxx.SectorSize / w25qxx.PageSize;
+	for (uint32_t s = 0; s < (Pages + PerSector - 1) / PerSector; s++)
+		W25qxx_EraseSector(s);
+}
+//###################################################################################################################
+static uint32_t PipeBench_Check(uint32_t Pages)
+{
+	uint8_t Want[256], Got[256];
+	uint32_t Differ = 0;
+	for (uint32_t p = 0; p < Pages; p++)
+	{
+		PipeBench_Produce(Want, p, NULL);
+		W25qxx_ReadPage(Got, p, 0, w25qxx.PageSize);
+		if (memcmp(Want, Got, w25qxx.PageSize) != 0)
+			Differ++;
+	}
+	return Differ;
+}
+//###################################################################################################################
+static int PipeBench_Usage(void)
+{
+	fprintf(stderr, "usage: w25qxx-pipebench [-n pages] [-r rounds] DEVICE\n"
+					"  DEVICE is /dev/spidevX.Y or a file used as simulated chip, the pages from address 0 on are erased\n");
+	return 2;
+}
+//###################################################################################################################
+int main(int argc, char **argv)
+{
+	static uint8_t Page[256], Work[512];
+	uint32_t Pages = 256, Differ[2], Done;
+	uint64_t Start, Time[2], Produce[2];
+	W25QXX_SpidevStats_t Stats;
+	int Opt;
+	PipeBench.Rounds = 128;
+	while ((Opt = getopt(argc, argv, "n:r:")) != -1)
+	{
+		if (Opt == 'n')
+			Pages = strtoul(optarg, NULL, 0);
+		else if (Opt == 'r')
+			PipeBench.Rounds = strtoul(optarg, NULL, 0);
+		else
+			return PipeBench_Usage();
+	}
+	if ((argc - optind != 1) || (Pages == 0))
+		return PipeBench_Usage();
+	if (W25qxx_SpidevOpen(&hspi1, argv[optind], 20000000) == false)
+	{
+		perror(argv[optind]);
+		return 2;
+	}
+	if (W25qxx_Init() == false)
+	{
+		fprintf(stderr, "%s: no w25qxx found\n", argv[optind]);
+		return 2;
+	}
+	if (Pages > w25qxx.PageCount)
+	{
+		fprintf(stderr, "%u pages do not fit the chip\n", Pages);
+		return 2;
+	}
+	// produce, then program
+	PipeBench_Erase(Pages);
+	W25qxx_WaitReady();
+	W25qxx_SpidevStats(&hspi1, NULL, true);
+	PipeBench.ProduceTime = 0;
+	Start = W25qxx_SpidevMicros();
+	for (uint32_t p = 0; p < Pages; p++)
+	{
+		PipeBench_Produce(Page, p, NULL);
+		W25qxx_WritePage(Page, p, 0, w25qxx.PageSize);
+	}
+	Time[0] = W25qxx_SpidevMicros() - Start;
+	Produce[0] = PipeBench.ProduceTime;
+	Differ[0] = PipeBench_Check(Pages);
+	// pipelined
+	PipeBench_Erase(Pages);
+	W25qxx_WaitReady();
+	PipeBench.ProduceTime = 0;
+	Start = W25qxx_SpidevMicros();
+	Done = W25qxx_WritePipeline(0, Pages, PipeBench_Produce, NULL, Work);
+	Time[1] = W25qxx_SpidevMicros() - Start;
+	Produce[1] = PipeBench.ProduceTime;
+	Differ[1] = PipeBench_Check(Pages);
+	W25qxx_SpidevStats(&hspi1, &Stats, false);
+	printf("%u pages, transform %.0f us per page\n", Pages, (double)(Produce[0] + Produce[1]) / (2.0 * Pages));
+	printf("produce then WritePage: %.1f KB/s, %u pages differ\n", Pages * w25qxx.PageSize / 1024.0 / (Time[0] / 1e6), Differ[0]);
+	printf("WritePipeline:          %.1f KB/s, %u pages differ, %u pages written\n", Pages * w25qxx.PageSize / 1024.0 / (Time[1] / 1e6), Differ[1], Done);
+	printf("%u programs, %u erases, %u commands ignored while busy\n", Stats.Programs, Stats.Erases, Stats.Ignored);
+	W25qxx_SpidevClose(&hspi1);
+	return ((Differ[0] > 0) || (Differ[1] > 0) || (Done != Pages) || (Stats.Ignored > 0)) ? 1 : 0;
+}
+//###################################################################################################################
@@ -0,0 +1,173 @@
+/*
+  w25qxx-preerasebench: write latency of an append writer with inline erases and with the
+  pre-erase pool (w25qxxPreErase.h), on a Linux host.
+
+    w25qxx-preerasebench [-n sectors] [-d depth] [-l laps] [-i ms] DEVICE
+
+  The writer programs one page every Interval ms into a ring of Sectors sectors from
+  address 0 on, Laps times around, and reads every page back. Every sector holds data
+  before, so each one needs an erase. Inline: the writer erases a sector when it gets
+  there. Pool: W25qxx_PreEraseNext() hands it the next sector and W25qxx_PreEraseIdle()
+  runs once per idle ms. The worst time of one page, erase included, is reported.
+
+  DEVICE is /dev/spidevX.Y or a file used as simulated chip (see w25qxxSpidev.h), times
+  on a simulated chip are simulated. Built with _W25QXX_USE_ERASE_SUSPEND the writer's
+  program suspends the background erase.
+
+  Exit code 0 when the pages read back right and the pool never stalled the writer, 1 on
+  differences, stalls or commands the busy simulated chip ignored, 2 on errors.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "w25qxx.h"
+#include "w25qxxPreErase.h"
+#include "w25qxxSpidev.h"
+
+typedef struct
+{
+	uint32_t Sectors;
+	uint32_t Laps;
+	uint32_t Interval; // ms between pages
+	uint32_t Pages; // written
+	uint32_t Differ;
+	uint64_t Worst; // us, one page with what it waited for
+	uint64_t Time; // us, whole run
+
+} preerasebench_t;
+
+//###################################################################################################################
+static void PreEraseBench_Fill(preerasebench_t *Bench, uint8_t *Page, uint32_t Index)
+{
+	(void)Bench;
+	for (uint32_t i = 0; i < w25qxx.PageSize; i++)
+		Page[i] = (uint8_t)(Index * 3 + i);
+}
+//###################################################################################################################
+// old data in every sector of the ring
+static void PreEraseBench_Dirty(preerasebench_t *Bench)
+{
+	uint8_t Page[256];
+	memset(Page, 0x11, sizeof(Page));
+	for (uint32_t s = 0; s < Bench->Sectors; s++)
+		W25qxx_WritePage(Page, s * (w25qxx.SectorSize / w25qxx.PageSize), 0, w25qxx.PageSize);
+}
+//###################################################################################################################
+static void PreEraseBench_Run(preerasebench_t *Bench, w25qxx_preerase_t *Pool)
+{
+	uint8_t Page[256], Back[256];
+	uint32_t PerSector = w25qxx.SectorSize / w25qxx.PageSize;
+	uint32_t Sector = 0, InSector = 0;
+	uint64_t Start = W25qxx_SpidevMicros(), Write;
+	Bench->Pages = 0;
+	Bench->Differ = 0;
+	Bench->Worst = 0;
+	for (uint32_t n = 0; n < Bench->Sectors * PerSector * Bench->Laps; n++)
+	{
+		Write = W25qxx_SpidevMicros();
+		if ((n > 0) && (InSector == PerSector))
+		{
+			Sector = (Pool != NULL) ? W25qxx_PreEraseNext(Pool) : (Sector + 1) % Bench->Sectors;
+			InSector = 0;
+		}
+		if ((Pool == NULL) && (InSector == 0))
+			W25qxx_EraseSector(Sector);
+		PreEraseBench_Fill(Bench, Page, n);
+		W25qxx_WritePage(Page, Sector * PerSector + InSector, 0, w25qxx.PageSize);
+		Write = W25qxx_SpidevMicros() - Write;
+		if (Write > Bench->Worst)
+			Bench->Worst = Write;
+		W25qxx_ReadPage(Back, Sector * PerSector + InSector, 0, w25qxx.PageSize);
+		if (memcmp(Page, Back, w25qxx.PageSize) != 0)
+			Bench->Differ++;
+		InSector++;
+		Bench->Pages++;
+		for (uint32_t i = 0; i < Bench->Interval; i++)
+		{
+			HAL_Delay(1);
+			if (Pool != NULL)
+				W25qxx_PreEraseIdle(Pool);
+		}
+	}
+	Bench->Time = W25qxx_SpidevMicros() - Start;
+}
+//###################################################################################################################
+static int PreEraseBench_Usage(void)
+{
+	fprintf(stderr, "usage: w25qxx-preerasebench [-n sectors] [-d depth] [-l laps] [-i ms] DEVICE\n"
+					"  DEVICE is /dev/spidevX.Y or a file used as simulated chip, the sectors from address 0 on are overwritten\n");
+	return 2;
+}
+//###################################################################################################################
+int main(int argc, char **argv)
+{
+	static preerasebench_t Bench;
+	static w25qxx_preerase_t Pool;
+	uint32_t Depth = 4;
+	uint64_t InlineWorst, InlineTime;
+	uint32_t InlineDiffer;
+	W25QXX_PreEraseStats_t Stats;
+	W25QXX_SpidevStats_t Spi;
+	int Opt;
+	Bench.Sectors = 64;
+	Bench.Laps = 3;
+	Bench.Interval = 6;
+	while ((Opt = getopt(argc, argv, "n:d:l:i:")) != -1)
+	{
+		if (Opt == 'n')
+			Bench.Sectors = strtoul(optarg, NULL, 0);
+		else if (Opt == 'd')
+			Depth = strtoul(optarg, NULL, 0);
+		else if (Opt == 'l')
+			Bench.Laps = strtoul(optarg, NULL, 0);
+		else if (Opt == 'i')
+			Bench.Interval = strtoul(optarg, NULL, 0);
+		else
+			return PreEraseBench_Usage();
+	}
+	if ((argc - optind != 1) || (Bench.Laps == 0))
+		return PreEraseBench_Usage();
+	if (W25qxx_SpidevOpen(&hspi1, argv[optind], 20000000) == false)
+	{
+		perror(argv[optind]);
+		return 2;
+	}
+	if (W25qxx_Init() == false)
+	{
+		fprintf(stderr, "%s: no w25qxx found\n", argv[optind]);
+		return 2;
+	}
+	if (Bench.Sectors > w25qxx.SectorCount)
+	{
+		fprintf(stderr, "%u sectors do not fit the chip\n", Bench.Sectors);
+		return 2;
+	}
+	W25qxx_SpidevStats(&hspi1, NULL, true);
+	PreEraseBench_Dirty(&Bench);
+	PreEraseBench_Run(&Bench, NULL);
+	InlineWorst = Bench.Worst;
+	InlineTime = Bench.Time;
+	InlineDiffer = Bench.Differ;
+	PreEraseBench_Dirty(&Bench);
+	W25qxx_EraseSector(0);
+	if (W25qxx_PreEraseInit(&Pool, 0, Bench.Sectors, Depth, 0) == false)
+	{
+		fprintf(stderr, "no pool of depth %u in %u sectors\n", Depth, Bench.Sectors);
+		return 2;
+	}
+	PreEraseBench_Run(&Bench, &Pool);
+	W25qxx_PreEraseStats(&Pool, &Stats, false);
+	W25qxx_SpidevStats(&hspi1, &Spi, false);
+	printf("%u pages, one every %u ms, %u sectors %u times\n", Bench.Pages, Bench.Interval, Bench.Sectors, Bench.Laps);
+	printf("inline erase: worst page %.1f ms, %.1f s, %u pages differ\n", InlineWorst / 1000.0, InlineTime / 1e6, InlineDiffer);
+	printf("pool depth %u: worst page %.1f ms, %.1f s, %u pages differ\n", Depth, Bench.Worst / 1000.0, Bench.Time / 1e6, Bench.Differ);
+	printf("pool: %u advances, %u stalls (%u ms, at most %u ms), %u erased, %u found blank, at least %u ready\n", Stats.Advances, Stats.Stalls, Stats.StallTime,
+		   Stats.StallTimeMax, Stats.Erased, Stats.Skipped, Stats.MinReady);
+	printf("%u erases, %u suspends, %u commands ignored while busy\n", Spi.Erases, Spi.Suspends, Spi.Ignored);
+	W25qxx_SpidevClose(&hspi1);
+	return ((InlineDiffer > 0) || (Bench.Differ > 0) || (Stats.Stalls > 0) || (Spi.Ignored > 0)) ? 1 : 0;
+}
+//###################################################################################################################
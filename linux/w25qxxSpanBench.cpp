@@ -0,0 +1,235 @@
+/*
+  w25qxx-spanbench: binary searches with std::lower_bound on a table in flash through
+  w25q::flash_span (w25qxxSpan.hpp), for caches of 256 bytes to 16 KB, on a Linux host.
+
+    w25qxx-spanbench [-n entries] [-l lookups] DEVICE
+
+  A sorted table of entries (8 bytes, key and value) is written from 1 MB on, then Lookups
+  random keys are searched, half of them in the table. For each cache size and line size
+  the bus bytes and chip reads per lookup, the hit rate and lookups per second are
+  reported, first for a plain binary search with one W25qxx_ReadBytes() per probe. Then a
+  std::find_if over part of the table must not push out the lines the searches use.
+
+  DEVICE is /dev/spidevX.Y or a file used as simulated chip (see w25qxxSpidev.h), the SPI
+  clock is 8 MHz, times on a simulated chip are simulated.
+
+  Exit code 0 when every lookup finds the right entry, 1 on wrong results or commands the
+  busy simulated chip ignored, 2 on errors.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#include "w25qxxSpan.hpp"
+#include "w25qxxSpidev.h"
+
+#define SPANBENCH_BASE 0x100000
+
+struct spanbench_entry_t
+{
+	uint32_t Key;
+	uint32_t Value;
+};
+
+typedef struct
+{
+	uint32_t Entries;
+	uint32_t Lookups;
+	uint32_t *Keys;
+	uint32_t Wrong; // lookups
+	uint32_t Ignored; // commands the busy simulated chip ignored
+
+} spanbench_t;
+
+static spanbench_t SpanBench;
+
+//###################################################################################################################
+static bool SpanBench_Less(const spanbench_entry_t &Entry, uint32_t Key)
+{
+	return Entry.Key < Key;
+}
+//###################################################################################################################
+static void SpanBench_Report(const char *Name, uint64_t Start, uint32_t Reads, const w25q::flash_cache_stats *Cache)
+{
+	W25QXX_SpidevStats_t Stats;
+	uint64_t Time = W25qxx_SpidevMicros() - Start;
+	W25qxx_SpidevStats(&hspi1, &Stats, true);
+	printf("%-24s %6.1f bus bytes, %5.2f reads per lookup, ", Name, (double)Stats.Bytes / SpanBench.Lookups, (double)Reads / SpanBench.Lookups);
+	if (Cache != NULL)
+		printf("hit %4.1f %%, ", 100.0 * Cache->Hits / ((Cache->Hits + Cache->Misses > 0) ? Cache->Hits + Cache->Misses : 1));
+	printf("%6.0f lookups/s\n", SpanBench.Lookups / ((Time > 0) ? Time / 1e6 : 1e-6));
+	SpanBench.Ignored += Stats.Ignored;
+}
+//###################################################################################################################
+// keys are even, odd ones are not in the table
+static void SpanBench_Found(uint32_t Lookup, bool Found, uint32_t Value)
+{
+	uint32_t Key = SpanBench.Keys[Lookup];
+	if ((Found != ((Key & 1) == 0)) || ((Found == true) && (Value != Key * 3)))
+		SpanBench.Wrong++;
+}
+//###################################################################################################################
+static void SpanBench_Plain(void)
+{
+	spanbench_entry_t Entry;
+	uint32_t Low, High, Mid, Reads = 0;
+	uint64_t Start;
+	W25qxx_SpidevStats(&hspi1, NULL, true);
+	Start = W25qxx_SpidevMicros();
+	for (uint32_t i = 0; i < SpanBench.Lookups; i++)
+	{
+		Low = 0;
+		High = SpanBench.Entries;
+		while (Low < High)
+		{
+			Mid = (Low + High) / 2;
+			W25qxx_ReadBytes((uint8_t *)&Entry, SPANBENCH_BASE + Mid * sizeof(Entry), sizeof(Entry));
+			Reads++;
+			if (Entry.Key < SpanBench.Keys[i])
+				Low = Mid + 1;
+			else
+				High = Mid;
+		}
+		if (Low < SpanBench.Entries)
+			W25qxx_ReadBytes((uint8_t *)&Entry, SPANBENCH_BASE + Low * sizeof(Entry), sizeof(Entry));
+		SpanBench_Found(i, (Low < SpanBench.Entries) && (Entry.Key == SpanBench.Keys[i]), Entry.Value);
+	}
+	SpanBench_Report("ReadBytes per probe", Start, Reads, NULL);
+}
+//###################################################################################################################
+template <size_t CacheBytes, size_t LineBytes>
+static void SpanBench_Run(void)
+{
+	static w25q::flash_block_cache<CacheBytes, LineBytes> Cache;
+	w25q::flash_span<spanbench_entry_t> Table(SPANBENCH_BASE, SpanBench.Entries, Cache);
+	w25q::flash_cache_stats Stats;
+	uint64_t Start;
+	char Name[32];
+	Cache.invalidate();
+	Cache.stats(NULL, true);
+	W25qxx_SpidevStats(&hspi1, NULL, true);
+	Start = W25qxx_SpidevMicros();
+	for (uint32_t i = 0; i < SpanBench.Lookups; i++)
+	{
+		auto It = std::lower_bound(Table.begin(), Table.end(), SpanBench.Keys[i], SpanBench_Less);
+		bool Found = (It != Table.end()) && (It->Key == SpanBench.Keys[i]);
+		SpanBench_Found(i, Found, (Found == true) ? It->Value : 0);
+	}
+	Cache.stats(&Stats, false);
+	snprintf(Name, sizeof(Name), "cache %5u B, line %2u:", (unsigned)CacheBytes, (unsigned)LineBytes);
+	SpanBench_Report(Name, Start, Stats.Misses, &Stats);
+}
+//###################################################################################################################
+// a scan over part of the table, the lines of the searches stay
+static void SpanBench_Scan(void)
+{
+	static w25q::flash_block_cache<1024> Cache;
+	w25q::flash_span<spanbench_entry_t> Table(SPANBENCH_BASE, SpanBench.Entries, Cache);
+	w25q::flash_cache_stats Before, After;
+	uint32_t Scanned = SpanBench.Entries / 5, Searches = (SpanBench.Lookups < 200) ? SpanBench.Lookups : 200;
+	Cache.invalidate();
+	for (uint32_t i = 0; i < Searches; i++)
+		std::lower_bound(Table.begin(), Table.end(), SpanBench.Keys[i], SpanBench_Less);
+	for (uint32_t i = 0; i < Searches; i++)
+		std::lower_bound(Table.begin(), Table.end(), SpanBench.Keys[i], SpanBench_Less);
+	Cache.stats(&Before, true);
+	auto It = std::find_if(Table.begin(), Table.end(), [Scanned](const spanbench_entry_t &Entry) { return Entry.Key == Scanned * 2; });
+	if (It.index() != Scanned)
+		SpanBench.Wrong++;
+	Cache.stats(NULL, true);
+	for (uint32_t i = 0; i < Searches; i++)
+		std::lower_bound(Table.begin(), Table.end(), SpanBench.Keys[i], SpanBench_Less);
+	Cache.stats(&After, true);
+	printf("find_if over %u entries: %u searches hit %.1f %% before, %.1f %% after\n", Scanned, Searches,
+		   100.0 * Before.Hits / ((Before.Hits + Before.Misses > 0) ? Before.Hits + Before.Misses : 1),
+		   100.0 * After.Hits / ((After.Hits + After.Misses > 0) ? After.Hits + After.Misses : 1));
+}
+//###################################################################################################################
+static int SpanBench_Usage(void)
+{
+	fprintf(stderr, "usage: w25qxx-spanbench [-n entries] [-l lookups] DEVICE\n"
+					"  DEVICE is /dev/spidevX.Y or a file used as simulated chip, the table from 1 MB on is overwritten\n");
+	return 2;
+}
+//###################################################################################################################
+int main(int argc, char **argv)
+{
+	spanbench_entry_t Page[32];
+	uint32_t Seed = 7, Bytes;
+	int Opt;
+	SpanBench.Entries = 512 * 1024;
+	SpanBench.Lookups = 20000;
+	while ((Opt = getopt(argc, argv, "n:l:")) != -1)
+	{
+		if (Opt == 'n')
+			SpanBench.Entries = strtoul(optarg, NULL, 0);
+		else if (Opt == 'l')
+			SpanBench.Lookups = strtoul(optarg, NULL, 0);
+		else
+			return SpanBench_Usage();
+	}
+	if ((argc - optind != 1) || (SpanBench.Entries < 32) || (SpanBench.Lookups == 0))
+		return SpanBench_Usage();
+	if (W25qxx_SpidevOpen(&hspi1, argv[optind], 8000000) == false)
+	{
+		perror(argv[optind]);
+		return 2;
+	}
+	if (W25qxx_Init() == false)
+	{
+		fprintf(stderr, "%s: no w25qxx found\n", argv[optind]);
+		return 2;
+	}
+	SpanBench.Entries &= ~31u;
+	Bytes = SpanBench.Entries * sizeof(spanbench_entry_t);
+	if (SPANBENCH_BASE + Bytes > w25qxx.SectorCount * w25qxx.SectorSize)
+	{
+		fprintf(stderr, "%u entries do not fit the chip\n", SpanBench.Entries);
+		return 2;
+	}
+	SpanBench.Keys = (uint32_t *)malloc(SpanBench.Lookups * sizeof(uint32_t));
+	if (SpanBench.Keys == NULL)
+		return 2;
+	for (uint32_t i = 0; i < SpanBench.Lookups; i++)
+	{
+		Seed ^= Seed << 13;
+		Seed ^= Seed >> 17;
+		Seed ^= Seed << 5;
+		SpanBench.Keys[i] = Seed % (2 * SpanBench.Entries);
+	}
+	for (uint32_t s = 0; s < (Bytes + w25qxx.SectorSize - 1) / w25qxx.SectorSize; s++)
+		W25qxx_EraseSector(SPANBENCH_BASE / w25qxx.SectorSize + s);
+	for (uint32_t p = 0; p < SpanBench.Entries / 32; p++)
+	{
+		for (uint32_t i = 0; i < 32; i++)
+		{
+			Page[i].Key = (p * 32 + i) * 2;
+			Page[i].Value = Page[i].Key * 3;
+		}
+		W25qxx_WritePage((uint8_t *)Page, SPANBENCH_BASE / w25qxx.PageSize + p, 0, w25qxx.PageSize);
+	}
+	printf("%u lookups in %u entries, SPI at 8 MHz\n", SpanBench.Lookups, SpanBench.Entries);
+	SpanBench_Plain();
+	SpanBench_Run<256, 8>();
+	SpanBench_Run<256, 16>();
+	SpanBench_Run<256, 32>();
+	SpanBench_Run<1024, 8>();
+	SpanBench_Run<1024, 16>();
+	SpanBench_Run<1024, 32>();
+	SpanBench_Run<4096, 8>();
+	SpanBench_Run<4096, 16>();
+	SpanBench_Run<4096, 32>();
+	SpanBench_Run<16384, 8>();
+	SpanBench_Run<16384, 16>();
+	SpanBench_Run<16384, 32>();
+	SpanBench_Run<16384, 64>();
+	SpanBench_Scan();
+	printf("%u lookups wrong, %u commands ignored while busy\n", SpanBench.Wrong, SpanBench.Ignored);
+	W25qxx_SpidevClose(&hspi1);
+	free(SpanBench.Keys);
+	return ((SpanBench.Wrong > 0) || (SpanBench.Ignored > 0)) ? 1 : 0;
+}
+//###################################################################################################################
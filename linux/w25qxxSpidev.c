@@ -0,0 +1,601 @@
+
+#include "w25qxxSpidev.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+w25qxx_spidev_t hspi1;
+
+static bool W25qxx_SpidevSimulated; // a simulated chip was opened, delays do not sleep
+static _Atomic uint64_t W25qxx_SpidevSkipped; // ns of SPI time and delays not waited for
+
+// W25qxx_SpidevTasks(): the task holding the CPU runs, the others wait for it
+static pthread_mutex_t W25qxx_SpidevCpu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t W25qxx_SpidevCpuChange = PTHREAD_COND_INITIALIZER;
+static uint32_t W25qxx_SpidevTaskCount; // 0: no tasks
+static uint32_t W25qxx_SpidevTaskAlive; // bit per task not ended
+static uint32_t W25qxx_SpidevTaskRunning;
+static uint32_t W25qxx_SpidevTaskSeed;
+static uint32_t W25qxx_SpidevTaskSwitches;
+static __thread int32_t W25qxx_SpidevTaskSelf = -1;
+
+//###################################################################################################################
+static uint32_t W25qxx_SpidevBufSize(void)
+{
+	unsigned int Size = 0;
+	FILE *File = fopen("/sys/module/spidev/parameters/bufsiz", "r");
+	if (File != NULL)
+	{
+		if (fscanf(File, "%u", &Size) != 1)
+			Size = 0;
+		fclose(File);
+	}
+	return (Size != 0) ? Size : 4096;
+}
+//###################################################################################################################
+static uint64_t W25qxx_SpidevNanos(void)
+{
+	struct timespec Now;
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+	return (uint64_t)Now.tv_sec * 1000000000 + Now.tv_nsec + atomic_load(&W25qxx_SpidevSkipped);
+}
+//###################################################################################################################
+static bool W25qxx_SpidevSimBusy(w25qxx_spidev_t *Dev)
+{
+	return W25qxx_SpidevNanos() < Dev->SimReady[Dev->SimDie];
+}
+//###################################################################################################################
+// counts the programs and erases down to the power cut, true when this one is cut
+static bool W25qxx_SpidevSimCut(w25qxx_spidev_t *Dev)
+{
+	if (Dev->SimCut < 0)
+		return false;
+	if (Dev->SimCut > 0)
+	{
+		Dev->SimCut--;
+		return false;
+	}
+	Dev->SimCut = -1;
+	Dev->SimDead = 1;
+	return true;
+}
+//###################################################################################################################
+static uint8_t W25qxx_SpidevSimAddrLen(uint8_t Cmd)
+{
+	return ((Cmd == 0x0C) || (Cmd == 0x12) || (Cmd == 0x13) || (Cmd == 0x21) || (Cmd == 0xDC)) ? 4 : 3;
+}
+//###################################################################################################################
+// file offset of Address on the selected die, addresses wrap around in the die
+static uint32_t W25qxx_SpidevSimOffset(w25qxx_spidev_t *Dev, uint32_t Address)
+{
+	uint32_t DieSize = Dev->SimSize / Dev->SimDies;
+	return Dev->SimDie * DieSize + Address % DieSize;
+}
+//###################################################################################################################
+static uint8_t W25qxx_SpidevSimByte(w25qxx_spidev_t *Dev, uint8_t Data)
+{
+	uint8_t Ret = 0xFF;
+	uint32_t AddrLen = W25qxx_SpidevSimAddrLen(Dev->SimCmd);
+	uint32_t Pos = Dev->SimPos++;
+	if (Dev->Speed > 0)
+		atomic_fetch_add(&W25qxx_SpidevSkipped, 8000000000ULL / Dev->Speed);
+	if (Dev->SimDead == 1)
+		return 0x00;
+	if (Pos == 0)
+	{
+		Dev->SimCmd = Data;
+		Dev->SimAddr = 0;
+		// a busy die only takes status reads, suspend and die select
+		Dev->SimIgnore = 0;
+		if ((W25qxx_SpidevSimBusy(Dev) == true) && (Data != 0x05) && (Data != 0x35) && (Data != 0x15) && (Data != 0x75) && (Data != 0xC2))
+		{
+			Dev->SimIgnore = 1;
+			Dev->Stats.Ignored++;
+		}
+		return Ret;
+	}
+	if (Dev->SimIgnore == 1)
+		return Ret;
+	switch (Dev->SimCmd)
+	{
+	case 0x9F:
+		if (Pos == 1)
+			Ret = 0xEF;
+		else if (Pos == 2)
+			Ret = ((Dev->SimDies == 2) && (Dev->SimSize == 0x4000000)) ? 0x71 : 0x40;
+		else if (Pos == 3)
+		{
+			// capacity byte is log2 of the size, w25q512 and up count on from 0x20, w25m512 is a w25q256
+			for (Ret = 0; (1UL << Ret) < Dev->SimSize / ((Dev->SimSize == 0x4000000) ? Dev->SimDies : 1); Ret++)
+				;
+			if (Ret >= 26)
+				Ret = 0x20 + Ret - 26;
+		}
+		break;
+	case 0x4B:
+		if (Pos > 4)
+			Ret = (uint8_t)(0xA0 + Pos);
+		break;
+	case 0x05:
+		Ret = ((W25qxx_SpidevSimBusy(Dev) == true) ? 0x01 : 0x00) | ((Dev->SimWel[Dev->SimDie] == 1) ? 0x02 : 0x00);
+		break;
+	case 0x35:
+		Ret = Dev->SimSr2[Dev->SimDie];
+		break;
+	case 0x15:
+		Ret = 0;
+		break;
+	case 0x03:
+	case 0x13:
+	case 0x0B:
+	case 0x0C:
+		if (Pos <= AddrLen)
+			Dev->SimAddr = (Dev->SimAddr << 8) | Data;
+		else if ((Pos > AddrLen + 1) || (Dev->SimCmd == 0x03) || (Dev->SimCmd == 0x13))
+			Ret = Dev->Sim[W25qxx_SpidevSimOffset(Dev, Dev->SimAddr++)];
+		break;
+	case 0x02:
+	case 0x12:
+		if (Pos <= AddrLen)
+		{
+			Dev->SimAddr = (Dev->SimAddr << 8) | Data;
+			// the page as it was, for a power cut
+			if (Pos == AddrLen)
+			{
+				Dev->SimSavePage = W25qxx_SpidevSimOffset(Dev, Dev->SimAddr) & ~0xFFUL;
+				memcpy(Dev->SimSave, &Dev->Sim[Dev->SimSavePage], sizeof(Dev->SimSave));
+			}
+		}
+		else if (Dev->SimWel[Dev->SimDie] == 1)
+		{
+			// wraps around in the page like the chip
+			Dev->Sim[W25qxx_SpidevSimOffset(Dev, Dev->SimAddr)] &= Data;
+			Dev->SimAddr = (Dev->SimAddr & ~0xFFUL) | ((Dev->SimAddr + 1) & 0xFF);
+		}
+		break;
+	case 0x20:
+	case 0x21:
+	case 0x52:
+	case 0xD8:
+	case 0xDC:
+		if (Pos <= AddrLen)
+			Dev->SimAddr = (Dev->SimAddr << 8) | Data;
+		break;
+	case 0xC2:
+		if (Pos == 1)
+			Dev->SimAddr = Data;
+		break;
+	}
+	return Ret;
+}
+//###################################################################################################################
+// CS high: erases, write enable and die select take effect, programs and erases keep the die busy
+static void W25qxx_SpidevSimEnd(w25qxx_spidev_t *Dev)
+{
+	uint32_t DieSize = Dev->SimSize / Dev->SimDies, Size = 0, Time = 0;
+	uint32_t Pos = Dev->SimPos;
+	uint8_t AddrLen = W25qxx_SpidevSimAddrLen(Dev->SimCmd);
+	uint64_t Now = W25qxx_SpidevNanos();
+	Dev->SimPos = 0;
+	if ((Pos == 0) || (Dev->SimIgnore == 1) || (Dev->SimDead == 1))
+		return;
+	switch (Dev->SimCmd)
+	{
+	case 0x06:
+		Dev->SimWel[Dev->SimDie] = 1;
+		break;
+	case 0x04:
+		Dev->SimWel[Dev->SimDie] = 0;
+		break;
+	case 0xC2:
+		if ((Pos > 1) && (Dev->SimAddr < Dev->SimDies))
+			Dev->SimDie = Dev->SimAddr;
+		break;
+	case 0x02:
+	case 0x12:
+		if ((Dev->SimWel[Dev->SimDie] == 1) && (Pos > AddrLen + 1U) && (W25qxx_SpidevSimCut(Dev) == true))
+		{
+			// the bytes went in while they were clocked, what the cut leaves undone gets its old content back
+			if (Dev->SimCutKeep == 0)
+				memcpy(&Dev->Sim[Dev->SimSavePage], Dev->SimSave, sizeof(Dev->SimSave));
+			else if (Dev->SimCutKeep == 1)
+				memcpy(&Dev->Sim[Dev->SimSavePage + 128], &Dev->SimSave[128], 128);
+		}
+		else if ((Dev->SimWel[Dev->SimDie] == 1) && (Pos > AddrLen + 1U))
+		{
+			Dev->SimReady[Dev->SimDie] = Now + 700000;
+			Dev->SimErasing[Dev->SimDie] = 0;
+			Dev->Stats.Programs++;
+		}
+		Dev->SimWel[Dev->SimDie] = 0;
+		break;
+	case 0x75:
+		// erase suspend, ready again after tSUS
+		if ((Now < Dev->SimReady[Dev->SimDie]) && (Dev->SimErasing[Dev->SimDie] == 1) && ((Dev->SimSr2[Dev->SimDie] & 0x80) == 0))
+		{
+			Dev->SimLeft[Dev->SimDie] = Dev->SimReady[Dev->SimDie] - Now;
+			Dev->SimReady[Dev->SimDie] = Now + 20000;
+			Dev->SimSr2[Dev->SimDie] |= 0x80;
+			Dev->Stats.Suspends++;
+		}
+		break;
+	case 0x7A:
+		if ((Dev->SimSr2[Dev->SimDie] & 0x80) == 0x80)
+		{
+			Dev->SimSr2[Dev->SimDie] &= ~0x80;
+			Dev->SimReady[Dev->SimDie] = Now + Dev->SimLeft[Dev->SimDie];
+			Dev->SimErasing[Dev->SimDie] = 1;
+		}
+		break;
+	case 0x20:
+	case 0x21:
+		Size = 0x1000;
+		Time = 45;
+		break;
+	case 0x52:
+		Size = 0x8000;
+		Time = 120;
+		break;
+	case 0xD8:
+	case 0xDC:
+		Size = 0x10000;
+		Time = 150;
+		break;
+	case 0xC7:
+	case 0x60:
+		// the selected die
+		Size = DieSize;
+		Time = DieSize / 0x1000 * 10;
+		break;
+	}
+	if ((Size == 0) || (Dev->SimWel[Dev->SimDie] == 0) || ((Size != DieSize) && (Pos <= AddrLen)))
+		return;
+	// no erase while one is suspended
+	if ((Dev->SimSr2[Dev->SimDie] & 0x80) == 0x80)
+	{
+		Dev->Stats.Ignored++;
+		return;
+	}
+	if ((Size == 0x1000) && (W25qxx_SpidevSimOffset(Dev, Dev->SimAddr) / Size == Dev->SimFailSector))
+		return;
+	if ((Size == 0x1000) && (W25qxx_SpidevSimOffset(Dev, Dev->SimAddr) / Size == Dev->SimSlowSector))
+		Time = Dev->SimSlowTime;
+	if (W25qxx_SpidevSimCut(Dev) == true)
+	{
+		if (Dev->SimCutKeep > 0)
+			memset(&Dev->Sim[W25qxx_SpidevSimOffset(Dev, Dev->SimAddr) & ~(Size - 1)], 0xFF, (Dev->SimCutKeep == 1) ? Size / 2 : Size);
+		return;
+	}
+	memset(&Dev->Sim[W25qxx_SpidevSimOffset(Dev, Dev->SimAddr) & ~(Size - 1)], 0xFF, Size);
+	Dev->SimWel[Dev->SimDie] = 0;
+	Dev->SimReady[Dev->SimDie] = Now + (uint64_t)Time * 1000000;
+	Dev->SimErasing[Dev->SimDie] = 1;
+	Dev->Stats.Erases++;
+}
+//###################################################################################################################
+static void W25qxx_SpidevSimMessage(w25qxx_spidev_t *Dev, struct spi_ioc_transfer *Xfer, uint32_t Count)
+{
+	uint8_t *pTx, *pRx;
+	uint8_t Data;
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		pTx = (uint8_t *)(uintptr_t)Xfer[i].tx_buf;
+		pRx = (uint8_t *)(uintptr_t)Xfer[i].rx_buf;
+		for (uint32_t j = 0; j < Xfer[i].len; j++)
+		{
+			Data = W25qxx_SpidevSimByte(Dev, (pTx != NULL) ? pTx[j] : 0);
+			if (pRx != NULL)
+				pRx[j] = Data;
+		}
+		// cs_change: CS high after this transfer, on the last one: stay low
+		if ((Xfer[i].cs_change != 0) != (i == Count - 1))
+			W25qxx_SpidevSimEnd(Dev);
+	}
+}
+//###################################################################################################################
+static void W25qxx_SpidevSend(w25qxx_spidev_t *Dev, struct spi_ioc_transfer *Xfer, uint32_t Count, bool Hold)
+{
+	Xfer[Count - 1].cs_change = (Hold == true) ? 1 : 0;
+	Dev->Stats.Messages++;
+	Dev->Stats.Transfers += Count;
+	for (uint32_t i = 0; i < Count; i++)
+		Dev->Stats.Bytes += Xfer[i].len;
+	if (Dev->Fd < 0)
+		W25qxx_SpidevSimMessage(Dev, Xfer, Count);
+	else if (ioctl(Dev->Fd, SPI_IOC_MESSAGE(Count), Xfer) < 0)
+		Dev->Stats.Errors++;
+}
+//###################################################################################################################
+// sends the queue, as several messages when it is bigger than the spidev buffer
+static void W25qxx_SpidevFlush(w25qxx_spidev_t *Dev, bool Hold)
+{
+	uint32_t First = 0, Size = 0;
+	for (uint32_t i = 0; i < Dev->XferCount; i++)
+	{
+		if ((i > First) && (Size + Dev->Xfer[i].len > Dev->MaxMessage))
+		{
+			W25qxx_SpidevSend(Dev, &Dev->Xfer[First], i - First, true);
+			First = i;
+			Size = 0;
+		}
+		Size += Dev->Xfer[i].len;
+	}
+	if (Dev->XferCount > First)
+		W25qxx_SpidevSend(Dev, &Dev->Xfer[First], Dev->XferCount - First, Hold);
+	Dev->XferCount = 0;
+	Dev->TxUsed = 0;
+	Dev->Held = (Hold == true) ? 1 : 0;
+}
+//###################################################################################################################
+// pTx is copied, pRx must stay valid until the next flush
+static void W25qxx_SpidevQueue(w25qxx_spidev_t *Dev, const uint8_t *pTx, uint8_t *pRx, uint32_t Size)
+{
+	struct spi_ioc_transfer *Xfer;
+	uint32_t Chunk;
+	do
+	{
+		Chunk = (Size > Dev->MaxMessage) ? Dev->MaxMessage : Size;
+		if ((pTx != NULL) && (Chunk > sizeof(Dev->Tx)))
+			Chunk = sizeof(Dev->Tx);
+		if ((Dev->XferCount == W25QXX_SPIDEV_XFERS) || ((pTx != NULL) && (Dev->TxUsed + Chunk > sizeof(Dev->Tx))))
+			W25qxx_SpidevFlush(Dev, true);
+		Xfer = &Dev->Xfer[Dev->XferCount++];
+		memset(Xfer, 0, sizeof(struct spi_ioc_transfer));
+		if (pTx != NULL)
+		{
+			memcpy(&Dev->Tx[Dev->TxUsed], pTx, Chunk);
+			Xfer->tx_buf = (uintptr_t)&Dev->Tx[Dev->TxUsed];
+			Dev->TxUsed += Chunk;
+			pTx += Chunk;
+		}
+		if (pRx != NULL)
+		{
+			Xfer->rx_buf = (uintptr_t)pRx;
+			pRx += Chunk;
+		}
+		Xfer->len = Chunk;
+		Xfer->speed_hz = Dev->Speed;
+		Xfer->bits_per_word = 8;
+		Size -= Chunk;
+	} while (Size > 0);
+}
+//###################################################################################################################
+bool W25qxx_SpidevOpen(w25qxx_spidev_t *Dev, const char *Path, uint32_t Speed)
+{
+	struct stat St;
+	uint8_t Mode = SPI_MODE_0, Bits = 8;
+	memset(Dev, 0, sizeof(w25qxx_spidev_t));
+	Dev->Fd = open(Path, O_RDWR);
+	if ((Dev->Fd < 0) || (fstat(Dev->Fd, &St) < 0))
+		goto fail;
+	Dev->Speed = Speed;
+	if (S_ISREG(St.st_mode))
+	{
+		if ((St.st_size < 0x20000) || (St.st_size > 0x10000000) || ((St.st_size & (St.st_size - 1)) != 0))
+			goto fail;
+		Dev->Sim = mmap(NULL, St.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, Dev->Fd, 0);
+		if (Dev->Sim == MAP_FAILED)
+		{
+			Dev->Sim = NULL;
+			goto fail;
+		}
+		Dev->SimSize = St.st_size;
+		Dev->SimDies = (St.st_size > 0x4000000) ? St.st_size / 0x4000000 : 1;
+		Dev->SimSlowSector = 0xFFFFFFFF;
+		Dev->SimFailSector = 0xFFFFFFFF;
+		Dev->SimCut = -1;
+		W25qxx_SpidevSimulated = true;
+		close(Dev->Fd);
+		Dev->Fd = -1;
+		Dev->MaxMessage = 4096;
+		return true;
+	}
+	if ((ioctl(Dev->Fd, SPI_IOC_WR_MODE, &Mode) < 0) || (ioctl(Dev->Fd, SPI_IOC_WR_BITS_PER_WORD, &Bits) < 0) ||
+		(ioctl(Dev->Fd, SPI_IOC_WR_MAX_SPEED_HZ, &Speed) < 0))
+		goto fail;
+	Dev->MaxMessage = W25qxx_SpidevBufSize();
+	return true;
+fail:
+	if (Dev->Fd >= 0)
+		close(Dev->Fd);
+	Dev->Fd = -1;
+	return false;
+}
+//###################################################################################################################
+void W25qxx_SpidevClose(w25qxx_spidev_t *Dev)
+{
+	HAL_GPIO_WritePin(Dev, 0, GPIO_PIN_SET);
+	if (Dev->Sim != NULL)
+	{
+		msync(Dev->Sim, Dev->SimSize, MS_SYNC);
+		munmap(Dev->Sim, Dev->SimSize);
+		Dev->Sim = NULL;
+	}
+	if (Dev->Fd >= 0)
+		close(Dev->Fd);
+	Dev->Fd = -1;
+}
+//###################################################################################################################
+void W25qxx_SpidevStats(w25qxx_spidev_t *Dev, W25QXX_SpidevStats_t *Stats, bool Reset)
+{
+	if (Stats != NULL)
+		*Stats = Dev->Stats;
+	if (Reset)
+		memset(&Dev->Stats, 0, sizeof(W25QXX_SpidevStats_t));
+}
+//###################################################################################################################
+void W25qxx_SpidevPowerCycle(w25qxx_spidev_t *Dev)
+{
+	Dev->SimDead = 0;
+	Dev->SimCut = -1;
+	Dev->SimDie = 0;
+	Dev->SimPos = 0;
+	Dev->XferCount = 0;
+	Dev->TxUsed = 0;
+	Dev->Held = 0;
+	memset(Dev->SimWel, 0, sizeof(Dev->SimWel));
+	memset(Dev->SimReady, 0, sizeof(Dev->SimReady));
+	memset(Dev->SimErasing, 0, sizeof(Dev->SimErasing));
+	memset(Dev->SimSr2, 0, sizeof(Dev->SimSr2));
+	memset(Dev->SimLeft, 0, sizeof(Dev->SimLeft));
+}
+//###################################################################################################################
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+	(void)GPIO_Pin;
+	// CS goes low with the first message
+	if (PinState == GPIO_PIN_RESET)
+		return;
+	if ((GPIOx->XferCount == 0) && (GPIOx->Held == 1))
+		W25qxx_SpidevQueue(GPIOx, NULL, NULL, 0);
+	if (GPIOx->XferCount > 0)
+		W25qxx_SpidevFlush(GPIOx, false);
+}
+//###################################################################################################################
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+	(void)Timeout;
+	W25qxx_SpidevQueue(hspi, pData, NULL, Size);
+	return HAL_OK;
+}
+//###################################################################################################################
+HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+	uint32_t Errors = hspi->Stats.Errors;
+	(void)Timeout;
+	W25qxx_SpidevQueue(hspi, NULL, pData, Size);
+	W25qxx_SpidevFlush(hspi, true);
+	return (hspi->Stats.Errors == Errors) ? HAL_OK : HAL_ERROR;
+}
+//###################################################################################################################
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData, uint16_t Size, uint32_t Timeout)
+{
+	uint32_t Errors = hspi->Stats.Errors;
+	(void)Timeout;
+	W25qxx_SpidevQueue(hspi, pTxData, pRxData, Size);
+	W25qxx_SpidevFlush(hspi, true);
+	return (hspi->Stats.Errors == Errors) ? HAL_OK : HAL_ERROR;
+}
+//###################################################################################################################
+HAL_StatusTypeDef HAL_SPI_Receive_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size)
+{
+	return HAL_SPI_Receive(hspi, pData, Size, 0);
+}
+//###################################################################################################################
+HAL_SPI_StateTypeDef HAL_SPI_GetState(SPI_HandleTypeDef *hspi)
+{
+	(void)hspi;
+	return HAL_SPI_STATE_READY;
+}
+//###################################################################################################################
+uint64_t W25qxx_SpidevMicros(void)
+{
+	return W25qxx_SpidevNanos() / 1000;
+}
+//###################################################################################################################
+uint32_t HAL_GetTick(void)
+{
+	return (uint32_t)(W25qxx_SpidevNanos() / 1000000);
+}
+//###################################################################################################################
+void HAL_Delay(uint32_t Delay)
+{
+	if (W25qxx_SpidevSimulated == false)
+	{
+		usleep(Delay * 1000);
+		return;
+	}
+	// simulated time goes on at once, other threads still get their turn
+	atomic_fetch_add(&W25qxx_SpidevSkipped, (uint64_t)Delay * 1000000);
+	sched_yield();
+}
+//###################################################################################################################
+// hands the CPU to a task picked with the seed, maybe the caller again, and waits to get it back
+static void W25qxx_SpidevTaskSwitch(bool Ended)
+{
+	uint32_t Next;
+	pthread_mutex_lock(&W25qxx_SpidevCpu);
+	if (Ended == true)
+		W25qxx_SpidevTaskAlive &= ~(1UL << W25qxx_SpidevTaskSelf);
+	if (W25qxx_SpidevTaskAlive != 0)
+	{
+		do
+		{
+			W25qxx_SpidevTaskSeed ^= W25qxx_SpidevTaskSeed << 13;
+			W25qxx_SpidevTaskSeed ^= W25qxx_SpidevTaskSeed >> 17;
+			W25qxx_SpidevTaskSeed ^= W25qxx_SpidevTaskSeed << 5;
+			Next = W25qxx_SpidevTaskSeed % W25qxx_SpidevTaskCount;
+		} while ((W25qxx_SpidevTaskAlive & (1UL << Next)) == 0);
+		if (Next != W25qxx_SpidevTaskRunning)
+			W25qxx_SpidevTaskSwitches++;
+		W25qxx_SpidevTaskRunning = Next;
+		pthread_cond_broadcast(&W25qxx_SpidevCpuChange);
+	}
+	while ((Ended == false) && (W25qxx_SpidevTaskRunning != (uint32_t)W25qxx_SpidevTaskSelf))
+		pthread_cond_wait(&W25qxx_SpidevCpuChange, &W25qxx_SpidevCpu);
+	pthread_mutex_unlock(&W25qxx_SpidevCpu);
+}
+//###################################################################################################################
+void osDelay(uint32_t millisec)
+{
+	HAL_Delay(millisec);
+	if ((W25qxx_SpidevTaskCount > 0) && (W25qxx_SpidevTaskSelf >= 0))
+		W25qxx_SpidevTaskSwitch(false);
+}
+//###################################################################################################################
+static void (*W25qxx_SpidevTaskFunction)(uint32_t Index, void *Context);
+static void *W25qxx_SpidevTaskContext;
+
+static void *W25qxx_SpidevTaskMain(void *Arg)
+{
+	W25qxx_SpidevTaskSelf = (int32_t)(uintptr_t)Arg;
+	pthread_mutex_lock(&W25qxx_SpidevCpu);
+	while (W25qxx_SpidevTaskRunning != (uint32_t)W25qxx_SpidevTaskSelf)
+		pthread_cond_wait(&W25qxx_SpidevCpuChange, &W25qxx_SpidevCpu);
+	pthread_mutex_unlock(&W25qxx_SpidevCpu);
+	W25qxx_SpidevTaskFunction(W25qxx_SpidevTaskSelf, W25qxx_SpidevTaskContext);
+	W25qxx_SpidevTaskSwitch(true);
+	return NULL;
+}
+//###################################################################################################################
+uint32_t W25qxx_SpidevTasks(uint32_t Count, void (*Task)(uint32_t Index, void *Context), void *Context, uint32_t Seed)
+{
+	pthread_t Thread[W25QXX_SPIDEV_TASKS];
+	if (Count > W25QXX_SPIDEV_TASKS)
+		Count = W25QXX_SPIDEV_TASKS;
+	W25qxx_SpidevTaskFunction = Task;
+	W25qxx_SpidevTaskContext = Context;
+	W25qxx_SpidevTaskSeed = (Seed != 0) ? Seed : 0x9E3779B9;
+	W25qxx_SpidevTaskSwitches = 0;
+	W25qxx_SpidevTaskRunning = 0;
+	W25qxx_SpidevTaskAlive = (1UL << Count) - 1;
+	W25qxx_SpidevTaskCount = Count;
+	for (uint32_t i = 0; i < Count; i++)
+		pthread_create(&Thread[i], NULL, W25qxx_SpidevTaskMain, (void *)(uintptr_t)i);
+	for (uint32_t i = 0; i < Count; i++)
+		pthread_join(Thread[i], NULL);
+	W25qxx_SpidevTaskCount = 0;
+	return W25qxx_SpidevTaskSwitches;
+}
+//###################################################################################################################
+static pthread_mutex_t W25qxx_SpidevCritical = PTHREAD_MUTEX_INITIALIZER;
+
+void taskENTER_CRITICAL(void)
+{
+	pthread_mutex_lock(&W25qxx_SpidevCritical);
+}
+//###################################################################################################################
+void taskEXIT_CRITICAL(void)
+{
+	pthread_mutex_unlock(&W25qxx_SpidevCritical);
+}
+//###################################################################################################################
@@ -0,0 +1,133 @@
+#ifndef _W25QXXSPIDEV_H
+#define _W25QXXSPIDEV_H
+
+/*
+  Linux userspace transport: the HAL calls of the driver on top of /dev/spidevX.Y.
+
+  Transmits are queued and go out with what follows in the same SPI_IOC_MESSAGE: command,
+  address and program data are one ioctl, command, address and read data as well. A
+  receive has to return its data, so it sends the queue and keeps CS low (cs_change on
+  the last transfer), raising CS later sends an empty transfer when nothing is queued.
+  Messages are split at the spidev bufsiz (/sys/module/spidev/parameters/bufsiz) with
+  CS held low in between.
+
+  W25qxx_SpidevOpen() on a regular file instead of a spidev node simulates a chip with
+  the file as its memory: size is a power of 2 from 128 KB to 256 MB, fill it with 0xFF
+  for a blank chip. Same message handling, so everything above can be tried without
+  hardware. 128 MB and 256 MB are a w25q01 and a w25q02, 64 MB dies selected with 0xC2;
+  SimDies = 2 after the open makes a 64 MB file a w25m512 (two w25q256). The file holds
+  the dies one after the other.
+
+  Every die of the simulated chip keeps datasheet timing: a page program is busy for 0.7 ms, a sector
+  erase for 45 ms, a 32 KB/64 KB block erase for 120/150 ms and a chip erase for 10 ms per
+  sector (of the selected die). Only status reads, Erase Suspend and die select are taken
+  while the selected die is busy, other commands are ignored and counted in Stats.Ignored. 0x75 suspends an erase (SUS in SR2, ready after
+  20 us), a page program may follow, 0x7A resumes it for the time it still had left.
+  SimSlowSector erases in SimSlowTime ms instead, an erase of SimFailSector is not carried
+  out and leaves WEL set, like one of a protected sector (0xFFFFFFFF: none, the default).
+
+  Power cuts: SimCut >= 0 carries out that many page programs and erases (the ones Stats
+  counts), the next one is cut. SimCutKeep says how much of it is done: 0 nothing, 1 the
+  first half of the page or the erased range, 2 all of it. After the cut the chip is dead:
+  no command is carried out and every byte reads 0x00, so the driver goes on without
+  waiting. W25qxx_SpidevPowerCycle() powers it up again, running programs and erases, WEL,
+  suspend and the die select are gone then.
+
+  Time is simulated too: once a simulated chip is open, HAL_GetTick(), HAL_Delay() and
+  osDelay() run on host time plus the SPI time of every simulated byte (8 bits at Speed)
+  plus every delay, and a delay does not sleep. CPU work between driver calls takes its
+  host time, waiting for the chip takes none. W25qxx_SpidevMicros() is the same clock in
+  us.
+
+  W25qxx_SpidevTasks() runs Count threads like FreeRTOS tasks on one CPU: one runs at a
+  time, osDelay() hands the CPU to another one picked with Seed. Code between two osDelay()
+  calls is not interrupted, like with a cooperative scheduler.
+
+  Build w25qxx.c with this directory in the include path (main.h, cmsis_os.h), the
+  default w25qxxConf.h then uses hspi1 defined here:
+
+    W25qxx_SpidevOpen(&hspi1, "/dev/spidev0.0", 20000000);
+    W25qxx_Init();
+*/
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdbool.h>
+#include <linux/spi/spidev.h>
+#include "main.h"
+
+#define W25QXX_SPIDEV_XFERS 64 // transfers queued while CS is low
+#define W25QXX_SPIDEV_TX_SIZE 8192 // bytes of transmit data queued
+#define W25QXX_SPIDEV_DIES 4 // of a simulated chip
+#define W25QXX_SPIDEV_TASKS 16 // W25qxx_SpidevTasks()
+
+	typedef struct
+	{
+		uint32_t Messages; // SPI_IOC_MESSAGE calls, one syscall each
+		uint32_t Transfers;
+		uint64_t Bytes;
+		uint32_t Errors; // failed ioctls
+		// simulated chip
+		uint32_t Programs;
+		uint32_t Erases;
+		uint32_t Suspends;
+		uint32_t Ignored; // commands a busy chip did not take, erases while suspended
+
+	} W25QXX_SpidevStats_t;
+
+	typedef struct w25qxx_spidev_s
+	{
+		int Fd; // spidev node, -1 when simulated
+		uint32_t Speed; // Hz
+		uint32_t MaxMessage; // bytes per message, spidev bufsiz
+		struct spi_ioc_transfer Xfer[W25QXX_SPIDEV_XFERS];
+		uint32_t XferCount;
+		uint32_t TxUsed;
+		uint8_t Tx[W25QXX_SPIDEV_TX_SIZE];
+		uint8_t Held; // CS left low by the last message
+		// simulated chip
+		uint8_t *Sim;
+		uint32_t SimSize;
+		uint8_t SimDies;
+		uint8_t SimDie; // selected
+		uint8_t SimCmd;
+		uint32_t SimPos; // bytes since CS went low
+		uint32_t SimAddr;
+		uint8_t SimIgnore; // command not taken, the die is busy
+		// per die
+		uint8_t SimWel[W25QXX_SPIDEV_DIES];
+		uint64_t SimReady[W25QXX_SPIDEV_DIES]; // ns of the simulated clock the running program or erase is done
+		uint8_t SimErasing[W25QXX_SPIDEV_DIES]; // what runs is an erase, it can be suspended
+		uint8_t SimSr2[W25QXX_SPIDEV_DIES]; // SUS (0x80)
+		uint64_t SimLeft[W25QXX_SPIDEV_DIES]; // ns the suspended erase still needs
+		uint32_t SimSlowSector;
+		uint32_t SimSlowTime; // ms
+		uint32_t SimFailSector;
+		int32_t SimCut; // programs and erases carried out before the power is cut, -1: never (the default)
+		uint8_t SimCutKeep; // of the cut one: 0 nothing, 1 the first half, 2 all of it
+		uint8_t SimDead; // the power is cut
+		uint32_t SimSavePage; // file offset of the page being programmed, its content before
+		uint8_t SimSave[256];
+		W25QXX_SpidevStats_t Stats;
+
+	} w25qxx_spidev_t;
+
+	// a spidev node (mode 0, 8 bit, Speed Hz) or a file used as simulated chip
+	bool W25qxx_SpidevOpen(w25qxx_spidev_t *Dev, const char *Path, uint32_t Speed);
+	void W25qxx_SpidevClose(w25qxx_spidev_t *Dev);
+	void W25qxx_SpidevStats(w25qxx_spidev_t *Dev, W25QXX_SpidevStats_t *Stats, bool Reset);
+	// simulated chip: power off and on, after a cut or at any time
+	void W25qxx_SpidevPowerCycle(w25qxx_spidev_t *Dev);
+	// runs Task(0 .. Count - 1, Context) as tasks on one CPU, returns the number of task switches
+	uint32_t W25qxx_SpidevTasks(uint32_t Count, void (*Task)(uint32_t Index, void *Context), void *Context, uint32_t Seed);
+	// host time, with a simulated chip open plus the time the chip and the delays took
+	uint64_t W25qxx_SpidevMicros(void);
+//############################################################################
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,401 @@
+/*
+  w25qxx-txtest: power cut test of the transactions (w25qxxTx.h) on a simulated chip.
+
+    w25qxx-txtest [-s seeds] DEVICE
+
+  14 transactions write whole sectors to 6 home sectors (one write across two of them),
+  every fourth commit waits, the others are queued. Then the power is cut before each of
+  the page programs and erases of that run (SimCut in w25qxxSpidev.h), with nothing, the
+  first half or all of the cut one done. After each cut W25qxx_TxMount() has to leave the
+  home sectors as a prefix of the transactions: all of some first ones, none of the rest,
+  at least every transaction whose waiting commit had returned. A second mount changes
+  nothing and writing goes on.
+
+  Then a bit is flipped in every shadow after each cut: the mount has to refuse the
+  unfinished journal page and leave the homes untouched, and finish it once the bit is
+  repaired. Last, Seeds times 4 tasks on one CPU (W25qxx_SpidevTasks()) commit with and
+  without waiting while another task writes the journal, every transaction has to reach
+  its home sectors. The journal takes sectors 200 and 201, the shadows 300 to 307.
+
+  DEVICE is a file used as simulated chip of 2 MB or more, it is overwritten.
+
+  Exit code 0 when every check passes, 1 when a mount leaves anything but a prefix of the
+  durable transactions or another check fails, 2 on errors.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "w25qxxTx.h"
+#include "w25qxxSpidev.h"
+#include "cmsis_os.h"
+
+#define TXTEST_HOME 10 // first home sector
+#define TXTEST_HOMES 6
+#define TXTEST_TRANSACTIONS 14
+#define TXTEST_JOURNAL 200
+#define TXTEST_SHADOW 300
+#define TXTEST_SHADOWS 8
+#define TXTEST_TASKS 4
+#define TXTEST_TASK_TRANSACTIONS 12
+
+typedef struct
+{
+	w25qxx_t Chip;
+	w25qxx_txlog_t Log;
+	w25qxx_tx_t Tx[TXTEST_TRANSACTIONS];
+	w25qxx_tx_t TaskTx[TXTEST_TASKS][TXTEST_TASK_TRANSACTIONS];
+	int8_t Sectors[TXTEST_TRANSACTIONS][3]; // homes a transaction writes, -1: none
+	uint32_t Durable; // transactions a waiting commit returned for
+	uint8_t Buffer[TXTEST_TASKS][4096];
+	uint8_t Homes[TXTEST_HOMES * 4096];
+	uint32_t Checks;
+	uint32_t Failed;
+
+} txtest_t;
+
+static txtest_t TxTest;
+
+//###################################################################################################################
+static void TxTest_Check(bool Ok, const char *What)
+{
+	TxTest.Checks++;
+	if (Ok == false)
+		TxTest.Failed++;
+	printf("%s: %s\n", (Ok == true) ? "ok  " : "FAIL", What);
+}
+//###################################################################################################################
+// content of home Home after transaction Version, 0 before any
+static uint8_t TxTest_Pattern(uint32_t Home, uint32_t Version, uint32_t Offset)
+{
+	return (uint8_t)(Home * 7 + Version * 13 + Offset * 3 + (Offset >> 8));
+}
+//###################################################################################################################
+// MCU reset: a new driver state and the log mounted
+static bool TxTest_Mount(void)
+{
+	W25qxx_SpidevPowerCycle(&hspi1);
+	if (W25qxx_InitDevice(&TxTest.Chip, &hspi1, &hspi1, 0) == false)
+		return false;
+	return W25qxx_TxMount(&TxTest.Log, TXTEST_JOURNAL, 2, TXTEST_SHADOW, TXTEST_SHADOWS);
+}
+//###################################################################################################################
+// blank journal and shadows, homes at version 0
+static void TxTest_Reset(void)
+{
+	memset(hspi1.Sim, 0xFF, (TXTEST_SHADOW + TXTEST_SHADOWS) * 4096);
+	for (uint32_t s = 0; s < TXTEST_HOMES; s++)
+		for (uint32_t i = 0; i < 4096; i++)
+			hspi1.Sim[(TXTEST_HOME + s) * 4096 + i] = TxTest_Pattern(s, 0, i);
+	TxTest_Mount();
+	TxTest.Durable = 0;
+}
+//###################################################################################################################
+// the 14 transactions, stops once the power is cut. false when the driver got something wrong before
+static bool TxTest_Work(void)
+{
+	uint8_t *Buffer = TxTest.Buffer[0];
+	uint8_t Back[64];
+	uint32_t Address;
+	bool Ok = true;
+	for (uint32_t g = 0; g < TXTEST_TRANSACTIONS; g++)
+	{
+		W25qxx_TxBegin(&TxTest.Log, &TxTest.Tx[g]);
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			if (TxTest.Sectors[g][k] < 0)
+				continue;
+			for (uint32_t i = 0; i < 4096; i++)
+				Buffer[i] = TxTest_Pattern(TxTest.Sectors[g][k], g + 1, i);
+			Address = (TXTEST_HOME + TxTest.Sectors[g][k]) * 4096;
+			// the first one in two pieces, the second one from the middle of the sector on
+			if (k == 0)
+				Ok = (W25qxx_TxWrite(&TxTest.Log, &TxTest.Tx[g], Buffer, Address, 3000) == true) &&
+					 (W25qxx_TxWrite(&TxTest.Log, &TxTest.Tx[g], &Buffer[3000], Address + 3000, 1096) == true) && (Ok == true);
+			else
+				Ok = (W25qxx_TxWrite(&TxTest.Log, &TxTest.Tx[g], Buffer, Address, 4096) == true) && (Ok == true);
+			W25qxx_TxRead(&TxTest.Log, &TxTest.Tx[g], Back, Address + 2990, sizeof(Back));
+			if (hspi1.SimDead == 1)
+				return Ok;
+			Ok = (memcmp(Back, &Buffer[2990], sizeof(Back)) == 0) && (Ok == true);
+		}
+		if ((g % 4) == 3)
+		{
+			Ok = (W25qxx_TxCommit(&TxTest.Log, &TxTest.Tx[g], true) == true) && (Ok == true);
+			if (hspi1.SimDead == 1)
+				return Ok;
+			TxTest.Durable = g + 1;
+		}
+		else
+			Ok = (W25qxx_TxCommit(&TxTest.Log, &TxTest.Tx[g], false) == true) && (Ok == true);
+		if (hspi1.SimDead == 1)
+			return Ok;
+	}
+	W25qxx_TxSync(&TxTest.Log);
+	if (hspi1.SimDead == 0)
+		TxTest.Durable = TXTEST_TRANSACTIONS;
+	return Ok;
+}
+//###################################################################################################################
+// the number of transactions the homes show all of, -1 when a home is in none of its versions, -2 when no prefix fits
+static int32_t TxTest_Prefix(void)
+{
+	int32_t Version[TXTEST_HOMES], Expect;
+	uint32_t i;
+	for (uint32_t s = 0; s < TXTEST_HOMES; s++)
+	{
+		Version[s] = -1;
+		for (uint32_t v = 0; (v <= TXTEST_TRANSACTIONS) && (Version[s] < 0); v++)
+		{
+			for (i = 0; i < 4096; i++)
+				if (hspi1.Sim[(TXTEST_HOME + s) * 4096 + i] != TxTest_Pattern(s, v, i))
+					break;
+			if (i == 4096)
+				Version[s] = v;
+		}
+		if (Version[s] < 0)
+			return -1;
+	}
+	for (int32_t n = TXTEST_TRANSACTIONS; n >= 0; n--)
+	{
+		for (i = 0; i < TXTEST_HOMES; i++)
+		{
+			Expect = 0;
+			for (int32_t g = 0; g < n; g++)
+				for (uint32_t k = 0; k < 3; k++)
+					if (TxTest.Sectors[g][k] == (int8_t)i)
+						Expect = g + 1;
+			if (Version[i] != Expect)
+				break;
+		}
+		if (i == TXTEST_HOMES)
+			return n;
+	}
+	return -2;
+}
+//###################################################################################################################
+// the power cut before every program and erase, Keep: nothing, half or all of the cut one done
+static bool TxTest_Cuts(uint32_t Steps, uint8_t Keep, uint32_t *Recovered)
+{
+	W25QXX_TxStats_t Stats;
+	int32_t Before, After;
+	for (uint32_t Cut = 0; Cut <= Steps; Cut++)
+	{
+		TxTest_Reset();
+		hspi1.SimCut = Cut;
+		hspi1.SimCutKeep = Keep;
+		if (TxTest_Work() == false)
+		{
+			printf("cut %u keep %u: the transactions failed before the cut\n", Cut, Keep);
+			return false;
+		}
+		Before = TxTest.Durable;
+		if (TxTest_Mount() == false)
+		{
+			printf("cut %u keep %u: mount failed\n", Cut, Keep);
+			return false;
+		}
+		After = TxTest_Prefix();
+		if (After < Before)
+		{
+			printf("cut %u keep %u: the homes show %d transactions, %d were durable\n", Cut, Keep, After, Before);
+			return false;
+		}
+		W25qxx_TxStats(&TxTest.Log, &Stats, false);
+		*Recovered += Stats.Recovered;
+		if ((Stats.CrcErrors > 0) || (TxTest_Mount() == false) || (TxTest_Prefix() != After))
+		{
+			printf("cut %u keep %u: the second mount changed the homes\n", Cut, Keep);
+			return false;
+		}
+	}
+	return true;
+}
+//###################################################################################################################
+// a damaged shadow of the unfinished journal page: the mount applies nothing, repaired it finishes the page
+static bool TxTest_Damaged(uint32_t Steps, uint32_t *Refused)
+{
+	W25QXX_TxStats_t Stats;
+	int32_t Before;
+	bool Mounted;
+	for (uint32_t Cut = 0; Cut <= Steps; Cut++)
+	{
+		TxTest_Reset();
+		hspi1.SimCut = Cut;
+		hspi1.SimCutKeep = 2;
+		TxTest_Work();
+		Before = TxTest.Durable;
+		memcpy(TxTest.Homes, &hspi1.Sim[TXTEST_HOME * 4096], sizeof(TxTest.Homes));
+		for (uint32_t s = TXTEST_SHADOW; s < TXTEST_SHADOW + TXTEST_SHADOWS; s++)
+			hspi1.Sim[s * 4096 + 100] ^= 0x01;
+		Mounted = TxTest_Mount();
+		if (Mounted == false)
+		{
+			(*Refused)++;
+			W25qxx_TxStats(&TxTest.Log, &Stats, false);
+			if ((memcmp(TxTest.Homes, &hspi1.Sim[TXTEST_HOME * 4096], sizeof(TxTest.Homes)) != 0) || (Stats.CrcErrors == 0) || (Stats.Recovered > 0))
+			{
+				printf("cut %u: the refused mount changed the homes\n", Cut);
+				return false;
+			}
+		}
+		for (uint32_t s = TXTEST_SHADOW; s < TXTEST_SHADOW + TXTEST_SHADOWS; s++)
+			hspi1.Sim[s * 4096 + 100] ^= 0x01;
+		if ((TxTest_Mount() == false) || (TxTest_Prefix() < Before))
+		{
+			printf("cut %u: the repaired log lost durable transactions\n", Cut);
+			return false;
+		}
+	}
+	return true;
+}
+//###################################################################################################################
+static uint8_t TxTest_TaskPattern(uint32_t Home, uint32_t Version, uint32_t Offset)
+{
+	return (uint8_t)(Home * 31 + Version * 7 + Offset * 5 + (Offset >> 8));
+}
+//###################################################################################################################
+// two homes of its own per task, commits that wait and ones that do not
+static void TxTest_Task(uint32_t Index, void *Context)
+{
+	uint32_t *Wrong = Context, Home;
+	w25qxx_tx_t *Tx;
+	bool Wait;
+	for (uint32_t n = 0; n < TXTEST_TASK_TRANSACTIONS; n++)
+	{
+		Tx = &TxTest.TaskTx[Index][n];
+		W25qxx_TxBegin(&TxTest.Log, Tx);
+		for (Home = 2 * Index; Home < 2 * Index + 2; Home++)
+		{
+			for (uint32_t i = 0; i < 4096; i++)
+				TxTest.Buffer[Index][i] = TxTest_TaskPattern(Home, n + 1, i);
+			while (W25qxx_TxWrite(&TxTest.Log, Tx, TxTest.Buffer[Index], (TXTEST_HOME + Home) * 4096, 4096) == false)
+			{
+				W25qxx_TxSync(&TxTest.Log);
+				osDelay(1);
+			}
+		}
+		Wait = ((n % 3) == 2) || (n == TXTEST_TASK_TRANSACTIONS - 1);
+		// the commit may land while another task writes the journal
+		if ((n % 2) == Index % 2)
+			osDelay(1);
+		if (W25qxx_TxCommit(&TxTest.Log, Tx, Wait) == false)
+			(*Wrong)++;
+		if (Wait == true)
+			for (uint32_t k = 0; k <= n; k++)
+				if (TxTest.TaskTx[Index][k].State != W25QXX_TX_DONE)
+					(*Wrong)++;
+		if (((n + Index) % 4) == 0)
+			W25qxx_TxSync(&TxTest.Log);
+	}
+}
+//###################################################################################################################
+static bool TxTest_Tasks(uint32_t Seeds, uint32_t *Records, uint32_t *Switches)
+{
+	W25QXX_TxStats_t Stats;
+	uint32_t Wrong = 0, i;
+	for (uint32_t Seed = 1; Seed <= Seeds; Seed++)
+	{
+		TxTest_Reset();
+		*Switches += W25qxx_SpidevTasks(TXTEST_TASKS, TxTest_Task, &Wrong, Seed);
+		W25qxx_TxStats(&TxTest.Log, &Stats, false);
+		*Records += Stats.Records;
+		if ((Wrong > 0) || (Stats.Transactions != TXTEST_TASKS * TXTEST_TASK_TRANSACTIONS) || (TxTest.Log.Queue != NULL) || (TxTest.Log.Busy != 0) ||
+			(TxTest.Log.ShadowUsed != 0))
+		{
+			printf("seed %u: %u wrong commits, %u transactions, the log not idle\n", Seed, Wrong, Stats.Transactions);
+			return false;
+		}
+		for (uint32_t s = 0; s < 2 * TXTEST_TASKS; s++)
+		{
+			for (i = 0; i < 4096; i++)
+				if (hspi1.Sim[(TXTEST_HOME + s) * 4096 + i] != TxTest_TaskPattern(s, TXTEST_TASK_TRANSACTIONS, i))
+					break;
+			if (i < 4096)
+			{
+				printf("seed %u: home %u does not hold the last transaction\n", Seed, s);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+//###################################################################################################################
+static int TxTest_Usage(void)
+{
+	fprintf(stderr, "usage: w25qxx-txtest [-s seeds] DEVICE\n"
+					"  DEVICE is a file used as simulated chip of 2 MB or more, it is overwritten\n");
+	return 2;
+}
+//###################################################################################################################
+int main(int argc, char **argv)
+{
+	W25QXX_SpidevStats_t Spi;
+	W25QXX_TxStats_t Stats;
+	uint32_t Seeds = 40, Steps, Recovered = 0, Refused = 0, Records = 0, Switches = 0;
+	char Text[128];
+	bool Ok;
+	int Opt;
+	while ((Opt = getopt(argc, argv, "s:")) != -1)
+	{
+		if (Opt == 's')
+			Seeds = strtoul(optarg, NULL, 0);
+		else
+			return TxTest_Usage();
+	}
+	if (argc - optind != 1)
+		return TxTest_Usage();
+	if ((W25qxx_SpidevOpen(&hspi1, argv[optind], 20000000) == false) || (hspi1.Sim == NULL) || (hspi1.SimSize < 0x200000))
+	{
+		fprintf(stderr, "%s: no file of 2 MB or more for a simulated chip\n", argv[optind]);
+		return 2;
+	}
+	if (W25qxx_InitDevice(&TxTest.Chip, &hspi1, &hspi1, 0) == false)
+	{
+		fprintf(stderr, "%s: no w25qxx found\n", argv[optind]);
+		return 2;
+	}
+	// homes of the transactions, the first one is written across into the next sector
+	for (uint32_t g = 0; g < TXTEST_TRANSACTIONS; g++)
+	{
+		TxTest.Sectors[g][0] = g % TXTEST_HOMES;
+		TxTest.Sectors[g][1] = ((g % 3) == 0) ? -1 : (int8_t)((g * 5 + 1) % TXTEST_HOMES);
+		TxTest.Sectors[g][2] = ((g % 5) == 2) ? (int8_t)((g + 3) % TXTEST_HOMES) : -1;
+		if (TxTest.Sectors[g][1] == TxTest.Sectors[g][0])
+			TxTest.Sectors[g][1] = -1;
+		if ((TxTest.Sectors[g][2] == TxTest.Sectors[g][0]) || (TxTest.Sectors[g][2] == TxTest.Sectors[g][1]))
+			TxTest.Sectors[g][2] = -1;
+	}
+	// without a cut
+	TxTest_Reset();
+	W25qxx_SpidevStats(&hspi1, NULL, true);
+	Ok = TxTest_Work();
+	W25qxx_SpidevStats(&hspi1, &Spi, false);
+	W25qxx_TxStats(&TxTest.Log, &Stats, true);
+	Steps = Spi.Programs + Spi.Erases;
+	snprintf(Text, sizeof(Text), "%u transactions in %u journal pages, %u programs and erases", Stats.Transactions, Stats.Records, Steps);
+	TxTest_Check(Ok && (TxTest_Prefix() == TXTEST_TRANSACTIONS) && (Stats.Transactions == TXTEST_TRANSACTIONS) && (Stats.Records == 4), Text);
+	Ok = TxTest_Mount() && (TxTest_Prefix() == TXTEST_TRANSACTIONS);
+	W25qxx_TxStats(&TxTest.Log, &Stats, false);
+	TxTest_Check(Ok && (Stats.Recovered == 0), "mount after a clean run changes nothing");
+	// power cuts
+	Ok = true;
+	for (uint8_t Keep = 0; (Keep < 3) && (Ok == true); Keep++)
+		Ok = TxTest_Cuts(Steps, Keep, &Recovered);
+	snprintf(Text, sizeof(Text), "%u power cuts with nothing, half or all of the step done: prefixes, %u journal pages finished by mount", 3 * (Steps + 1),
+			 Recovered);
+	TxTest_Check(Ok, Text);
+	Ok = TxTest_Damaged(Steps, &Refused);
+	snprintf(Text, sizeof(Text), "damaged shadows: %u mounts refused, homes untouched, finished once repaired", Refused);
+	TxTest_Check(Ok && (Refused > 0), Text);
+	Ok = TxTest_Tasks(Seeds, &Records, &Switches);
+	snprintf(Text, sizeof(Text), "%u x %u tasks, %u transactions each: %u journal pages, %u task switches", Seeds, TXTEST_TASKS, TXTEST_TASK_TRANSACTIONS, Records,
+			 Switches);
+	TxTest_Check(Ok && (Records < Seeds * TXTEST_TASKS * TXTEST_TASK_TRANSACTIONS), Text);
+	printf("%u checks, %u failed\n", TxTest.Checks, TxTest.Failed);
+	W25qxx_SpidevClose(&hspi1);
+	return (TxTest.Failed > 0) ? 1 : 0;
+}
+//###################################################################################################################
@@ -0,0 +1,174 @@
+/*
+  w25qxx-volumebench: erase, write and read throughput of a volume (w25qxxVolume.h) of one
+  to four chips, concatenated and striped, on a Linux host.
+
+    w25qxx-volumebench [-k KB] [-s stripe] DEVICE...
+
+  For 1 to the number of DEVICEs chips, KB bytes from volume address 0 on are erased,
+  written and read back, in concat and in stripe mode with stripes of stripe bytes. Then
+  the same range is erased again: the sector maps of the chips know it is erased, so with
+  _W25QXX_USE_SECTOR_MAP no erase command may go out, also after the volume switched between
+  the chips for every stripe.
+
+  Each DEVICE is /dev/spidevX.Y or a file used as simulated chip (see w25qxxSpidev.h), one
+  chip each. On simulated chips the times are simulated and the busy times of the chips
+  overlap like on real ones.
+
+  Exit code 0 when the data reads back right, 1 on differences, erases that were not needed
+  or commands a busy simulated chip ignored, 2 on errors.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "w25qxxVolume.h"
+#include "w25qxxSpidev.h"
+
+typedef struct
+{
+	w25qxx_spidev_t Spi[W25QXX_VOLUME_MAX_DEVICES];
+	w25qxx_t Chip[W25QXX_VOLUME_MAX_DEVICES];
+	w25qxx_t *Device[W25QXX_VOLUME_MAX_DEVICES];
+	uint8_t Count;
+	uint8_t *Data;
+	uint8_t *Back;
+	uint32_t Differ; // runs
+	uint32_t Repeated; // erases of erased sectors
+
+} volumebench_t;
+
+static volumebench_t VolumeBench;
+
+//###################################################################################################################
+// erase, program and ignored commands of all chips
+static void VolumeBench_Stats(W25QXX_SpidevStats_t *Sum)
+{
+	W25QXX_SpidevStats_t Stats;
+	memset(Sum, 0, sizeof(W25QXX_SpidevStats_t));
+	for (uint8_t i = 0; i < VolumeBench.Count; i++)
+	{
+		W25qxx_SpidevStats(&VolumeBench.Spi[i], &Stats, false);
+		Sum->Programs += Stats.Programs;
+		Sum->Erases += Stats.Erases;
+		Sum->Ignored += Stats.Ignored;
+		Sum->Bytes += Stats.Bytes;
+	}
+}
+//###################################################################################################################
+static double VolumeBench_Rate(uint32_t Bytes, uint64_t Time)
+{
+	return Bytes / 1024.0 / ((Time > 0) ? Time / 1e6 : 1e-6);
+}
+//###################################################################################################################
+static void VolumeBench_Run(uint8_t Chips, W25QXX_VolumeMode_t Mode, uint32_t Stripe, uint32_t Bytes)
+{
+	w25qxx_volume_t Volume;
+	W25QXX_SpidevStats_t Before, After;
+	uint64_t Start, Erase, Write, Read;
+	uint32_t Size = Bytes;
+	bool Differ;
+	if (W25qxx_VolumeInit(&Volume, VolumeBench.Device, Chips, Mode, Stripe) == false)
+	{
+		printf("%u chips %s: no volume\n", Chips, (Mode == W25QXX_VOLUME_STRIPE) ? "stripe" : "concat");
+		return;
+	}
+	if (Size > Volume.Capacity)
+		Size = Volume.Capacity;
+	// data there before, every sector needs its erase
+	W25qxx_VolumeErase(&Volume, 0, Size);
+	W25qxx_VolumeWrite(&Volume, VolumeBench.Back, 0, Size);
+	Start = W25qxx_SpidevMicros();
+	W25qxx_VolumeErase(&Volume, 0, Size);
+	Erase = W25qxx_SpidevMicros() - Start;
+	Start = W25qxx_SpidevMicros();
+	W25qxx_VolumeWrite(&Volume, VolumeBench.Data, 0, Size);
+	Write = W25qxx_SpidevMicros() - Start;
+	memset(VolumeBench.Back, 0, Size);
+	Start = W25qxx_SpidevMicros();
+	W25qxx_VolumeRead(&Volume, VolumeBench.Back, 0, Size);
+	Read = W25qxx_SpidevMicros() - Start;
+	Differ = (memcmp(VolumeBench.Data, VolumeBench.Back, Size) != 0);
+	if (Differ == true)
+		VolumeBench.Differ++;
+	// erased twice, the second time from the sector maps
+	W25qxx_VolumeErase(&Volume, 0, Size);
+	VolumeBench_Stats(&Before);
+	W25qxx_VolumeErase(&Volume, 0, Size);
+	VolumeBench_Stats(&After);
+	VolumeBench.Repeated += After.Erases - Before.Erases;
+	printf("%u chips %s: erase %7.1f KB/s, write %6.1f KB/s, read %7.1f KB/s, %u erases repeated%s\n", Chips,
+		   (Mode == W25QXX_VOLUME_STRIPE) ? "stripe" : "concat", VolumeBench_Rate(Size, Erase), VolumeBench_Rate(Size, Write), VolumeBench_Rate(Size, Read),
+		   After.Erases - Before.Erases, (Differ == true) ? ", DATA DIFFERS" : "");
+}
+//###################################################################################################################
+static int VolumeBench_Usage(void)
+{
+	fprintf(stderr, "usage: w25qxx-volumebench [-k KB] [-s stripe] DEVICE...\n"
+					"  up to 4 DEVICEs, /dev/spidevX.Y or files used as simulated chips, the first KB of the volume are overwritten\n");
+	return 2;
+}
+//###################################################################################################################
+int main(int argc, char **argv)
+{
+	uint32_t Bytes = 1024 * 1024, Stripe = 4096, Seed = 1;
+	W25QXX_SpidevStats_t Stats;
+	int Opt;
+	while ((Opt = getopt(argc, argv, "k:s:")) != -1)
+	{
+		if (Opt == 'k')
+			Bytes = strtoul(optarg, NULL, 0) * 1024;
+		else if (Opt == 's')
+			Stripe = strtoul(optarg, NULL, 0);
+		else
+			return VolumeBench_Usage();
+	}
+	if ((argc - optind < 1) || (argc - optind > W25QXX_VOLUME_MAX_DEVICES) || (Bytes == 0))
+		return VolumeBench_Usage();
+	VolumeBench.Count = argc - optind;
+	for (uint8_t i = 0; i < VolumeBench.Count; i++)
+	{
+		if (W25qxx_SpidevOpen(&VolumeBench.Spi[i], argv[optind + i], 20000000) == false)
+		{
+			perror(argv[optind + i]);
+			return 2;
+		}
+		if (W25qxx_InitDevice(&VolumeBench.Chip[i], &VolumeBench.Spi[i], &VolumeBench.Spi[i], 0) == false)
+		{
+			fprintf(stderr, "%s: no w25qxx found\n", argv[optind + i]);
+			return 2;
+		}
+		VolumeBench.Device[i] = &VolumeBench.Chip[i];
+		W25qxx_SpidevStats(&VolumeBench.Spi[i], NULL, true);
+	}
+	VolumeBench.Data = malloc(Bytes);
+	VolumeBench.Back = malloc(Bytes);
+	if ((VolumeBench.Data == NULL) || (VolumeBench.Back == NULL))
+		return 2;
+	for (uint32_t i = 0; i < Bytes; i++)
+	{
+		Seed ^= Seed << 13;
+		Seed ^= Seed >> 17;
+		Seed ^= Seed << 5;
+		VolumeBench.Data[i] = (uint8_t)Seed;
+	}
+	printf("%u KB, stripes of %u bytes\n", Bytes / 1024, Stripe);
+	for (uint8_t Chips = 1; Chips <= VolumeBench.Count; Chips++)
+	{
+		VolumeBench_Run(Chips, W25QXX_VOLUME_CONCAT, Stripe, Bytes);
+		VolumeBench_Run(Chips, W25QXX_VOLUME_STRIPE, Stripe, Bytes);
+	}
+	VolumeBench_Stats(&Stats);
+	printf("%u programs, %u erases, %u commands ignored while busy\n", Stats.Programs, Stats.Erases, Stats.Ignored);
+	for (uint8_t i = 0; i < VolumeBench.Count; i++)
+		W25qxx_SpidevClose(&VolumeBench.Spi[i]);
+	free(VolumeBench.Data);
+	free(VolumeBench.Back);
+#if (_W25QXX_USE_SECTOR_MAP == 1)
+	if (VolumeBench.Repeated > 0)
+		return 1;
+#endif
+	return ((VolumeBench.Differ > 0) || (Stats.Ignored > 0)) ? 1 : 0;
+}
+//###################################################################################################################
@@ -0,0 +1,215 @@
+/*
+  w25qxx-writebufbench: page programs and time of byte and short writes with the write buffer
+  (_W25QXX_USE_WRITE_BUFFER), on a Linux host.
+
+    w25qxx-writebufbench [-b bytes] [-n operations] DEVICE
+
+  Bytes bytes go out one W25qxx_WriteByte() at a time, then the same amount as records of
+  1 to 40 bytes with W25qxx_WriteBytes(), both appended from address 0 on. Then a random
+  mix of byte writes, short writes, reads, blank checks and sector erases runs on the
+  first 64 KB and every read is checked against a copy in RAM, at the end the whole range.
+
+  DEVICE is /dev/spidevX.Y or a file used as simulated chip (see w25qxxSpidev.h), times
+  and programs are counted on a simulated chip only. Build with
+  -D_W25QXX_USE_WRITE_BUFFER=0 to compare without the buffer.
+
+  Exit code 0 when every read returns the right data, 1 on differences or commands the busy
+  simulated chip ignored, 2 on errors.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "w25qxx.h"
+#include "w25qxxSpidev.h"
+
+#define WRITEBUFBENCH_RANGE 0x10000 // of the random mix
+
+typedef struct
+{
+	uint32_t Bytes;
+	uint32_t Operations;
+	uint32_t Seed;
+	uint32_t Differ; // reads
+	uint32_t Ignored; // commands the busy simulated chip ignored
+	uint8_t Model[WRITEBUFBENCH_RANGE];
+
+} writebufbench_t;
+
+static writebufbench_t WriteBufBench;
+
+//###################################################################################################################
+static uint32_t WriteBufBench_Random(void)
+{
+	WriteBufBench.Seed ^= WriteBufBench.Seed << 13;
+	WriteBufBench.Seed ^= WriteBufBench.Seed >> 17;
+	WriteBufBench.Seed ^= WriteBufBench.Seed << 5;
+	return WriteBufBench.Seed;
+}
+//###################################################################################################################
+static void WriteBufBench_Erase(uint32_t Bytes)
+{
+	for (uint32_t s = 0; s < (Bytes + w25qxx.SectorSize - 1) / w25qxx.SectorSize; s++)
+		W25qxx_EraseSector(s);
+}
+//###################################################################################################################
+static void WriteBufBench_Report(const char *Name, uint64_t Start)
+{
+	W25QXX_SpidevStats_t Stats;
+	uint64_t Time = W25qxx_SpidevMicros() - Start;
+	W25qxx_SpidevStats(&hspi1, &Stats, true);
+	printf("%-13s %u bytes: %u programs, %.1f ms, %.1f KB/s\n", Name, WriteBufBench.Bytes, Stats.Programs, Time / 1000.0,
+		   WriteBufBench.Bytes / 1024.0 / ((Time > 0) ? Time / 1e6 : 1e-6));
+	WriteBufBench.Ignored += Stats.Ignored;
+}
+//###################################################################################################################
+// byte writes and short writes appended, then read back
+static void WriteBufBench_Append(bool Records)
+{
+	uint8_t Record[40], Back[256];
+	uint32_t Address = 0, Length;
+	uint64_t Start;
+	WriteBufBench_Erase(WriteBufBench.Bytes);
+	WriteBufBench.Seed = 3;
+	W25qxx_SpidevStats(&hspi1, NULL, true);
+	Start = W25qxx_SpidevMicros();
+	while (Address < WriteBufBench.Bytes)
+	{
+		Length = (Records == true) ? 1 + WriteBufBench_Random() % sizeof(Record) : 1;
+		if (Length > WriteBufBench.Bytes - Address)
+			Length = WriteBufBench.Bytes - Address;
+		for (uint32_t i = 0; i < Length; i++)
+			Record[i] = (uint8_t)(Address + i);
+		if (Records == true)
+			W25qxx_WriteBytes(Record, Address, Length);
+		else
+			W25qxx_WriteByte(Record[0], Address);
+		Address += Length;
+	}
+	W25qxx_WriteFlush();
+	W25qxx_WaitReady();
+	WriteBufBench_Report((Records == true) ? "WriteBytes" : "WriteByte", Start);
+	for (Address = 0; Address < WriteBufBench.Bytes; Address += Length)
+	{
+		Length = (WriteBufBench.Bytes - Address > sizeof(Back)) ? sizeof(Back) : WriteBufBench.Bytes - Address;
+		W25qxx_ReadBytes(Back, Address, Length);
+		for (uint32_t i = 0; i < Length; i++)
+			if (Back[i] != (uint8_t)(Address + i))
+			{
+				WriteBufBench.Differ++;
+				break;
+			}
+	}
+}
+//###################################################################################################################
+// every path that has to see the buffered page, against a copy in RAM
+static void WriteBufBench_Mix(void)
+{
+	uint8_t Data[64];
+	uint32_t Address, Length, Operation;
+	bool Empty, ModelEmpty;
+	WriteBufBench_Erase(WRITEBUFBENCH_RANGE);
+	memset(WriteBufBench.Model, 0xFF, WRITEBUFBENCH_RANGE);
+	WriteBufBench.Seed = 9;
+	for (uint32_t n = 0; n < WriteBufBench.Operations; n++)
+	{
+		Operation = WriteBufBench_Random() % 10;
+		Address = WriteBufBench_Random() % WRITEBUFBENCH_RANGE;
+		Length = 1 + WriteBufBench_Random() % ((Operation < 7) ? 40 : 64);
+		if (Address + Length > WRITEBUFBENCH_RANGE)
+			Length = WRITEBUFBENCH_RANGE - Address;
+		if (Operation < 5)
+		{
+			Data[0] = (uint8_t)WriteBufBench_Random();
+			W25qxx_WriteByte(Data[0], Address);
+			WriteBufBench.Model[Address] &= Data[0];
+		}
+		else if (Operation < 7)
+		{
+			for (uint32_t i = 0; i < Length; i++)
+			{
+				Data[i] = (uint8_t)WriteBufBench_Random();
+				WriteBufBench.Model[Address + i] &= Data[i];
+			}
+			W25qxx_WriteBytes(Data, Address, Length);
+		}
+		else if (Operation < 9)
+		{
+			W25qxx_ReadBytes(Data, Address, Length);
+			if (memcmp(Data, &WriteBufBench.Model[Address], Length) != 0)
+				WriteBufBench.Differ++;
+		}
+		else if ((WriteBufBench_Random() % 20) == 0)
+		{
+			W25qxx_EraseSector(Address / w25qxx.SectorSize);
+			memset(&WriteBufBench.Model[Address / w25qxx.SectorSize * w25qxx.SectorSize], 0xFF, w25qxx.SectorSize);
+		}
+		else
+		{
+			Empty = W25qxx_IsEmptyPage(Address / w25qxx.PageSize, 0, w25qxx.PageSize);
+			ModelEmpty = true;
+			for (uint32_t i = 0; i < w25qxx.PageSize; i++)
+				if (WriteBufBench.Model[Address / w25qxx.PageSize * w25qxx.PageSize + i] != 0xFF)
+					ModelEmpty = false;
+			if (Empty != ModelEmpty)
+				WriteBufBench.Differ++;
+		}
+	}
+	W25qxx_WriteFlush();
+	for (Address = 0; Address < WRITEBUFBENCH_RANGE; Address += sizeof(Data))
+	{
+		W25qxx_ReadBytes(Data, Address, sizeof(Data));
+		if (memcmp(Data, &WriteBufBench.Model[Address], sizeof(Data)) != 0)
+			WriteBufBench.Differ++;
+	}
+	printf("random mix: %u operations\n", WriteBufBench.Operations);
+}
+//###################################################################################################################
+static int WriteBufBench_Usage(void)
+{
+	fprintf(stderr, "usage: w25qxx-writebufbench [-b bytes] [-n operations] DEVICE\n"
+					"  DEVICE is /dev/spidevX.Y or a file used as simulated chip, the first 64 KB are overwritten\n");
+	return 2;
+}
+//###################################################################################################################
+int main(int argc, char **argv)
+{
+	W25QXX_SpidevStats_t Stats;
+	int Opt;
+	WriteBufBench.Bytes = 4096;
+	WriteBufBench.Operations = 20000;
+	while ((Opt = getopt(argc, argv, "b:n:")) != -1)
+	{
+		if (Opt == 'b')
+			WriteBufBench.Bytes = strtoul(optarg, NULL, 0);
+		else if (Opt == 'n')
+			WriteBufBench.Operations = strtoul(optarg, NULL, 0);
+		else
+			return WriteBufBench_Usage();
+	}
+	if ((argc - optind != 1) || (WriteBufBench.Bytes == 0) || (WriteBufBench.Bytes > WRITEBUFBENCH_RANGE))
+		return WriteBufBench_Usage();
+	if (W25qxx_SpidevOpen(&hspi1, argv[optind], 20000000) == false)
+	{
+		perror(argv[optind]);
+		return 2;
+	}
+	if ((W25qxx_Init() == false) || (w25qxx.SectorCount * w25qxx.SectorSize < WRITEBUFBENCH_RANGE))
+	{
+		fprintf(stderr, "%s: no w25qxx of 64 KB or more found\n", argv[optind]);
+		return 2;
+	}
+	printf("write buffer %s\n", (_W25QXX_USE_WRITE_BUFFER == 1) ? "on" : "off");
+	WriteBufBench_Append(false);
+	WriteBufBench_Append(true);
+	W25qxx_SpidevStats(&hspi1, NULL, true);
+	WriteBufBench_Mix();
+	W25qxx_SpidevStats(&hspi1, &Stats, false);
+	WriteBufBench.Ignored += Stats.Ignored;
+	printf("%u reads differ, %u commands ignored while busy\n", WriteBufBench.Differ, WriteBufBench.Ignored);
+	W25qxx_SpidevClose(&hspi1);
+	return ((WriteBufBench.Differ > 0) || (WriteBufBench.Ignored > 0)) ? 1 : 0;
+}
+//###################################################################################################################
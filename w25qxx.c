@@ -2,77 +2,101 @@
 #include "w25qxxConf.h"
 #include "w25qxx.h"
 
+#include <string.h>
 #if (_W25QXX_DEBUG == 1)
 #include <stdio.h>
 #endif
 
 #define W25QXX_DUMMY_BYTE 0xA5
+#define W25QXX_FRONTIER_PROBE 16 // bytes read per binary search step
 
 w25qxx_t w25qxx;
 extern SPI_HandleTypeDef _W25QXX_SPI;
+// all functions work on the selected device, w25qxx is the default one
+static w25qxx_t *const W25qxx_Default = &w25qxx;
+static w25qxx_t *W25qxx_Dev = &w25qxx;
+static w25qxx_t *W25qxx_Selected = &w25qxx; // by W25qxx_SelectDevice(), selected again when the users are done
+static volatile uint32_t W25qxx_DevUsers; // W25qxx_DeviceAcquire() not released yet, all on W25qxx_Dev
+static volatile uint8_t W25qxx_DevSwitching;
+#define w25qxx (*W25qxx_Dev)
 #if (_W25QXX_USE_FREERTOS == 1)
 #define W25qxx_Delay(delay) osDelay(delay)
+#define W25qxx_EnterCritical() taskENTER_CRITICAL()
+#define W25qxx_ExitCritical() taskEXIT_CRITICAL()
 #include "cmsis_os.h"
 #else
 #define W25qxx_Delay(delay) HAL_Delay(delay)
+#define W25qxx_EnterCritical()
+#define W25qxx_ExitCritical()
 #endif
+static void W25qxx_BufferSync(uint32_t Address, uint32_t Size);
+static void W25qxx_BufferDrop(uint32_t Address, uint32_t Size);
+static void W25qxx_BufferFlush(void);
+static void W25qxx_OpBusy(void);
+#if (_W25QXX_USE_ERASE_SUSPEND == 1)
+static void W25qxx_OpPause(void);
+#endif
+static void W25qxx_OpResume(void);
+static void W25qxx_OpDone(void);
 //###################################################################################################################
 uint8_t W25qxx_Spi(uint8_t Data)
 {
 	uint8_t ret;
-	HAL_SPI_TransmitReceive(&_W25QXX_SPI, &Data, &ret, 1, 100);
+	HAL_SPI_TransmitReceive(w25qxx.Spi, &Data, &ret, 1, 100);
 	return ret;
 }
 //###################################################################################################################
 uint32_t W25qxx_ReadID(void)
 {
 	uint32_t Temp = 0, Temp0 = 0, Temp1 = 0, Temp2 = 0;
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_RESET);
 	W25qxx_Spi(0x9F);
 	Temp0 = W25qxx_Spi(W25QXX_DUMMY_BYTE);
 	Temp1 = W25qxx_Spi(W25QXX_DUMMY_BYTE);
 	Temp2 = W25qxx_Spi(W25QXX_DUMMY_BYTE);
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
 	Temp = (Temp0 << 16) | (Temp1 << 8) | Temp2;
 	return Temp;
 }
 //###################################################################################################################
 void W25qxx_ReadUniqID(void)
 {
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_RESET);
 	W25qxx_Spi(0x4B);
 	for (uint8_t i = 0; i < 4; i++)
 		W25qxx_Spi(W25QXX_DUMMY_BYTE);
 	for (uint8_t i = 0; i < 8; i++)
 		w25qxx.UniqID[i] = W25qxx_Spi(W25QXX_DUMMY_BYTE);
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
 }
 //###################################################################################################################
 void W25qxx_WriteEnable(void)
 {
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_RESET);
 	W25qxx_Spi(0x06);
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
 	W25qxx_Delay(1);
 }
 //###################################################################################################################
 void W25qxx_WriteDisable(void)
 {
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_RESET);
 	W25qxx_Spi(0x04);
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
 	W25qxx_Delay(1);
 }
 //###################################################################################################################
 uint8_t W25qxx_ReadStatusRegister(uint8_t SelectStatusRegister_1_2_3)
 {
 	uint8_t status = 0;
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_RESET);
 	if (SelectStatusRegister_1_2_3 == 1)
 	{
 		W25qxx_Spi(0x05);
 		status = W25qxx_Spi(W25QXX_DUMMY_BYTE);
 		w25qxx.StatusRegister1 = status;
+		if ((status & 0x01) == 0x01)
+			W25qxx_OpBusy();
 	}
 	else if (SelectStatusRegister_1_2_3 == 2)
 	{
@@ -86,13 +110,13 @@ uint8_t W25qxx_ReadStatusRegister(uint8_t SelectStatusRegister_1_2_3)
 		status = W25qxx_Spi(W25QXX_DUMMY_BYTE);
 		w25qxx.StatusRegister3 = status;
 	}
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
 	return status;
 }
 //###################################################################################################################
 void W25qxx_WriteStatusRegister(uint8_t SelectStatusRegister_1_2_3, uint8_t Data)
 {
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_RESET);
 	if (SelectStatusRegister_1_2_3 == 1)
 	{
 		W25qxx_Spi(0x01);
@@ -109,28 +133,609 @@ void W25qxx_WriteStatusRegister(uint8_t SelectStatusRegister_1_2_3, uint8_t Data
 		w25qxx.StatusRegister3 = Data;
 	}
 	W25qxx_Spi(Data);
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
+	w25qxx.Busy = 1;
 }
 //###################################################################################################################
 void W25qxx_WaitForWriteEnd(void)
 {
 	W25qxx_Delay(1);
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_RESET);
 	W25qxx_Spi(0x05);
 	do
 	{
 		w25qxx.StatusRegister1 = W25qxx_Spi(W25QXX_DUMMY_BYTE);
+		if ((w25qxx.StatusRegister1 & 0x01) == 0x01)
+			W25qxx_OpBusy();
 		W25qxx_Delay(1);
 	} while ((w25qxx.StatusRegister1 & 0x01) == 0x01);
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
+	W25qxx_OpDone();
+	w25qxx.Busy = 0;
+}
+//###################################################################################################################
+// a background erase (Busy == 2) is suspended instead of waited for, reads and programs to other sectors go on
+static void W25qxx_SuspendRaw(void)
+{
+#if (_W25QXX_USE_ERASE_SUSPEND == 1)
+	if (w25qxx.Busy != 2)
+		return;
+	// repeated until idle, a suspend too soon after a resume is ignored. tSUS is about 20us
+	do
+	{
+		HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_RESET);
+		W25qxx_Spi(0x75);
+		HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
+	} while ((W25qxx_ReadStatusRegister(1) & 0x01) == 0x01);
+	// the erase may have ended just before the suspend command
+	if ((W25qxx_ReadStatusRegister(2) & 0x80) == 0x80)
+	{
+		w25qxx.Suspended = 1;
+		W25qxx_OpPause();
+	}
+	else
+		W25qxx_OpDone();
+	w25qxx.Busy = 0;
+#endif
+}
+//###################################################################################################################
+static void W25qxx_ResumeRaw(void)
+{
+	if (w25qxx.Suspended == 0)
+		return;
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_RESET);
+	W25qxx_Spi(0x7A);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
+	W25qxx_OpResume();
+	w25qxx.Suspended = 0;
+	w25qxx.Busy = 2;
+}
+//###################################################################################################################
+// only waits if the driver left the chip busy, no fixed delays
+static void W25qxx_WaitBusy(void)
+{
+	W25qxx_SuspendRaw();
+	if (w25qxx.Busy == 0)
+		return;
+	while ((W25qxx_ReadStatusRegister(1) & 0x01) == 0x01)
+		W25qxx_Delay(1);
+	W25qxx_OpDone();
+	w25qxx.Busy = 0;
+}
+//###################################################################################################################
+// no erase is accepted while another one is suspended, let it finish first
+static void W25qxx_EraseFinish(void)
+{
+	if (w25qxx.Busy == 2)
+		w25qxx.Busy = 1;
+	W25qxx_WaitBusy();
+	if (w25qxx.Suspended == 1)
+	{
+		W25qxx_ResumeRaw();
+		w25qxx.Busy = 1;
+		W25qxx_WaitBusy();
+	}
+}
+//###################################################################################################################
+// stacked parts: every die has its own busy state, the one not selected keeps programming or erasing
+static void W25qxx_DieSelectRaw(uint8_t Die)
+{
+	if (Die == w25qxx.Die)
+		return;
+	w25qxx.DieBusy[w25qxx.Die] = w25qxx.Busy;
+	w25qxx.DieSuspended[w25qxx.Die] = w25qxx.Suspended;
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_RESET);
+	W25qxx_Spi(0xC2);
+	W25qxx_Spi(Die);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
+	w25qxx.Die = Die;
+	w25qxx.Busy = w25qxx.DieBusy[Die];
+	w25qxx.Suspended = w25qxx.DieSuspended[Die];
+}
+//###################################################################################################################
+static uint32_t W25qxx_DieSize(void)
+{
+	return (w25qxx.SectorCount / w25qxx.DieCount) * w25qxx.SectorSize;
+}
+//###################################################################################################################
+// selects the die holding Address, before waiting for it
+static void W25qxx_DieSelect(uint32_t Address)
+{
+	if (w25qxx.DieCount > 1)
+		W25qxx_DieSelectRaw(Address / W25qxx_DieSize());
+}
+//###################################################################################################################
+// bytes of Size up to the end of the die, a read does not go on into the next one
+static uint32_t W25qxx_DiePart(uint32_t Address, uint32_t Size)
+{
+	uint32_t Left;
+	if (w25qxx.DieCount <= 1)
+		return Size;
+	Left = W25qxx_DieSize() - (Address % W25qxx_DieSize());
+	return (Size > Left) ? Left : Size;
+}
+//###################################################################################################################
+static bool W25qxx_DieIdle(uint8_t Die)
+{
+	if (Die == w25qxx.Die)
+		return (w25qxx.Busy == 0) && (w25qxx.Suspended == 0);
+	return (w25qxx.DieBusy[Die] == 0) && (w25qxx.DieSuspended[Die] == 0);
+}
+//###################################################################################################################
+// command, address and Dummy bytes in one transfer
+static void W25qxx_SendCmdAddr(uint8_t Cmd, uint8_t Cmd4Byte, uint32_t Address, uint8_t Dummy)
+{
+	uint8_t Buffer[6];
+	uint8_t Size = 0;
+	if (w25qxx.DieCount > 1)
+		Address %= W25qxx_DieSize();
+	if (w25qxx.ID >= W25Q256)
+	{
+		Buffer[Size++] = Cmd4Byte;
+		Buffer[Size++] = (Address & 0xFF000000) >> 24;
+	}
+	else
+	{
+		Buffer[Size++] = Cmd;
+	}
+	Buffer[Size++] = (Address & 0xFF0000) >> 16;
+	Buffer[Size++] = (Address & 0xFF00) >> 8;
+	Buffer[Size++] = Address & 0xFF;
+	if (Dummy == 1)
+		Buffer[Size++] = 0;
+	HAL_SPI_Transmit(w25qxx.Spi, Buffer, Size, 100);
+}
+//###################################################################################################################
+static void W25qxx_Receive(uint8_t *pBuffer, uint32_t NumByteToRead)
+{
+	uint16_t Chunk;
+	while (NumByteToRead > 0)
+	{
+		Chunk = (NumByteToRead > 0x8000) ? 0x8000 : NumByteToRead;
+		HAL_SPI_Receive(w25qxx.Spi, pBuffer, Chunk, 2000);
+		pBuffer += Chunk;
+		NumByteToRead -= Chunk;
+	}
+}
+//###################################################################################################################
+static void W25qxx_ReadRaw(uint8_t *pBuffer, uint32_t ReadAddr, uint32_t NumByteToRead)
+{
+	uint32_t Part = W25qxx_DiePart(ReadAddr, NumByteToRead);
+	if (Part < NumByteToRead)
+	{
+		W25qxx_ReadRaw(pBuffer, ReadAddr, Part);
+		W25qxx_ReadRaw(pBuffer + Part, ReadAddr + Part, NumByteToRead - Part);
+		return;
+	}
+	W25qxx_BufferSync(ReadAddr, NumByteToRead);
+	W25qxx_DieSelect(ReadAddr);
+	W25qxx_WaitBusy();
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_RESET);
+	W25qxx_SendCmdAddr(0x0B, 0x0C, ReadAddr, 1);
+	W25qxx_Receive(pBuffer, NumByteToRead);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
+}
+//###################################################################################################################
+static bool W25qxx_IsBlankRaw(uint32_t CheckAddr, uint32_t NumByteToCheck)
+{
+	uint8_t pBuffer[32];
+	uint32_t Chunk, i;
+	bool Blank = true;
+	uint32_t Part = W25qxx_DiePart(CheckAddr, NumByteToCheck);
+	if (Part < NumByteToCheck)
+		return W25qxx_IsBlankRaw(CheckAddr, Part) && W25qxx_IsBlankRaw(CheckAddr + Part, NumByteToCheck - Part);
+	W25qxx_BufferSync(CheckAddr, NumByteToCheck);
+	W25qxx_DieSelect(CheckAddr);
+	W25qxx_WaitBusy();
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_RESET);
+	W25qxx_SendCmdAddr(0x0B, 0x0C, CheckAddr, 1);
+	while ((NumByteToCheck > 0) && (Blank == true))
+	{
+		Chunk = (NumByteToCheck > sizeof(pBuffer)) ? sizeof(pBuffer) : NumByteToCheck;
+		HAL_SPI_Receive(w25qxx.Spi, pBuffer, Chunk, 100);
+		for (i = 0; i < Chunk; i++)
+		{
+			if (pBuffer[i] != 0xFF)
+			{
+				Blank = false;
+				break;
+			}
+		}
+		NumByteToCheck -= Chunk;
+	}
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
+	return Blank;
+}
+//###################################################################################################################
+#if (_W25QXX_USE_SECTOR_MAP == 1)
+static W25QXX_Sector_t W25qxx_MapGet(uint32_t Sector)
+{
+	if (Sector >= _W25QXX_SECTOR_MAP_SECTORS)
+		return W25QXX_SECTOR_UNKNOWN;
+	return (W25QXX_Sector_t)((w25qxx.SectorMap[Sector / 4] >> ((Sector % 4) * 2)) & 0x03);
+}
+//###################################################################################################################
+static void W25qxx_MapSet(uint32_t Sector, W25QXX_Sector_t State)
+{
+	if (Sector >= _W25QXX_SECTOR_MAP_SECTORS)
+		return;
+	w25qxx.SectorMap[Sector / 4] &= ~(0x03 << ((Sector % 4) * 2));
+	w25qxx.SectorMap[Sector / 4] |= (State << ((Sector % 4) * 2));
+}
+//###################################################################################################################
+static bool W25qxx_MapIsErased(uint32_t Address, uint32_t Size)
+{
+	uint32_t Sector;
+	for (Sector = Address / w25qxx.SectorSize; Sector <= (Address + Size - 1) / w25qxx.SectorSize; Sector++)
+	{
+		if (W25qxx_MapGet(Sector) != W25QXX_SECTOR_ERASED)
+			return false;
+	}
+	return true;
+}
+#endif
+//###################################################################################################################
+#if (_W25QXX_USE_HEALTH == 1)
+#define W25QXX_HEALTH_MAGIC 0x48353257 // "W25H"
+//###################################################################################################################
+static uint32_t W25qxx_HealthEntry(uint32_t Address)
+{
+	return (Address / w25qxx.SectorSize) / w25qxx.Health->Sectors;
+}
+//###################################################################################################################
+static uint32_t W25qxx_HealthCrc(uint32_t Crc, const uint8_t *pData, uint32_t Size)
+{
+	Crc = ~Crc;
+	while (Size-- > 0)
+	{
+		Crc ^= *pData++;
+		for (uint8_t i = 0; i < 8; i++)
+			Crc = (Crc >> 1) ^ (0xEDB88320 & (0 - (Crc & 1)));
+	}
+	return ~Crc;
+}
+#endif
+//###################################################################################################################
+// program/erase telemetry, Op 1 = program, 2 = erase. the time runs until a status poll sees the chip ready
+static void W25qxx_OpStart(uint8_t Op, uint32_t Address, uint32_t Size)
+{
+#if (_W25QXX_USE_HEALTH == 1)
+	W25QXX_HealthRun_t *Run;
+	// not measured while an erase is suspended, its own run goes on after the resume
+	if ((w25qxx.Health == NULL) || (w25qxx.Suspended == 1))
+		return;
+	Run = &w25qxx.Health->Run[w25qxx.Die];
+	Run->Op = Op;
+	Run->Seen = 0;
+	Run->Entry = W25qxx_HealthEntry(Address);
+	Run->Entries = W25qxx_HealthEntry(Address + Size - 1) - Run->Entry + 1;
+	Run->Tick = HAL_GetTick();
+	Run->Time = 0;
+#else
+	(void)Op;
+	(void)Address;
+	(void)Size;
+#endif
+}
+//###################################################################################################################
+static void W25qxx_OpBusy(void)
+{
+#if (_W25QXX_USE_HEALTH == 1)
+	if ((w25qxx.Health != NULL) && (w25qxx.Suspended == 0))
+		w25qxx.Health->Run[w25qxx.Die].Seen = 1;
+#endif
+}
+//###################################################################################################################
+#if (_W25QXX_USE_ERASE_SUSPEND == 1)
+// the erase is suspended, its time stops
+static void W25qxx_OpPause(void)
+{
+#if (_W25QXX_USE_HEALTH == 1)
+	W25QXX_HealthRun_t *Run;
+	if (w25qxx.Health == NULL)
+		return;
+	Run = &w25qxx.Health->Run[w25qxx.Die];
+	Run->Time += HAL_GetTick() - Run->Tick;
+#endif
+}
+#endif
+//###################################################################################################################
+static void W25qxx_OpResume(void)
+{
+#if (_W25QXX_USE_HEALTH == 1)
+	if (w25qxx.Health != NULL)
+		w25qxx.Health->Run[w25qxx.Die].Tick = HAL_GetTick();
+#endif
+}
+//###################################################################################################################
+// the chip got ready, StatusRegister1 holds the status read last. Winbond parts have no fail bits,
+// WEL is only left set when the command was not carried out
+static void W25qxx_OpDone(void)
+{
+	if ((w25qxx.Suspended == 0) && (w25qxx.EraseSize[w25qxx.Die] != 0))
+	{
+#if (_W25QXX_USE_SECTOR_MAP == 1)
+		// a rejected erase leaves the sectors unknown
+		if ((w25qxx.StatusRegister1 & 0x02) == 0)
+		{
+			uint32_t Sector = w25qxx.EraseAddr[w25qxx.Die] / w25qxx.SectorSize;
+			for (uint32_t i = 0; i < w25qxx.EraseSize[w25qxx.Die] / w25qxx.SectorSize; i++)
+				W25qxx_MapSet(Sector + i, W25QXX_SECTOR_ERASED);
+		}
+#endif
+		w25qxx.EraseSize[w25qxx.Die] = 0;
+	}
+#if (_W25QXX_USE_HEALTH == 1)
+	W25QXX_HealthRun_t *Run;
+	W25QXX_HealthEntry_t *Entry;
+	uint32_t Time;
+	if ((w25qxx.Health == NULL) || (w25qxx.Suspended == 1))
+		return;
+	Run = &w25qxx.Health->Run[w25qxx.Die];
+	if (Run->Op == 0)
+		return;
+	Time = Run->Time + HAL_GetTick() - Run->Tick;
+	if (Time > 0xFFFF)
+		Time = 0xFFFF;
+	for (uint32_t i = Run->Entry; i < Run->Entry + Run->Entries; i++)
+	{
+		Entry = &w25qxx.Health->Entry[i];
+		if (Run->Op == 2)
+		{
+			// a chip found ready on the first poll finished at some unknown time before
+			if (Run->Seen == 1)
+			{
+				Entry->EraseLast = Time;
+				if (Time > Entry->EraseMax)
+					Entry->EraseMax = Time;
+			}
+			if (((w25qxx.StatusRegister1 & 0x02) == 0x02) && (Entry->EraseFails < 0xFFFF))
+				Entry->EraseFails++;
+		}
+		else if (((w25qxx.StatusRegister1 & 0x02) == 0x02) && (Entry->ProgramFails < 0xFFFF))
+			Entry->ProgramFails++;
+	}
+	Run->Op = 0;
+#endif
+}
+//###################################################################################################################
+#if (_W25QXX_READ_CACHE_SLOTS > 0)
+static void W25qxx_CacheInvalidate(uint32_t Address, uint32_t Size)
+{
+	uint32_t FirstPage = Address / w25qxx.PageSize;
+	uint32_t LastPage = (Address + Size - 1) / w25qxx.PageSize;
+	for (uint32_t i = 0; i < _W25QXX_READ_CACHE_SLOTS; i++)
+	{
+		if ((w25qxx.Cache[i].Page >= FirstPage) && (w25qxx.Cache[i].Page <= LastPage))
+			w25qxx.Cache[i].Valid = 0;
+	}
+}
+//###################################################################################################################
+// returns true if everything came from the cache
+static bool W25qxx_CacheRead(uint8_t *pBuffer, uint32_t ReadAddr, uint32_t NumByteToRead)
+{
+	bool AllHit = true;
+	uint32_t Page, Offset, Chunk, i;
+	W25QXX_CacheSlot_t *Slot;
+	while (NumByteToRead > 0)
+	{
+		Page = ReadAddr / w25qxx.PageSize;
+		Offset = ReadAddr % w25qxx.PageSize;
+		Chunk = w25qxx.PageSize - Offset;
+		if (Chunk > NumByteToRead)
+			Chunk = NumByteToRead;
+		Slot = NULL;
+		for (i = 0; i < _W25QXX_READ_CACHE_SLOTS; i++)
+		{
+			if ((w25qxx.Cache[i].Valid == 1) && (w25qxx.Cache[i].Page == Page))
+			{
+				Slot = &w25qxx.Cache[i];
+				break;
+			}
+		}
+		if (Slot != NULL)
+		{
+			Slot->Ref = 1;
+			w25qxx.CacheStats.Hits++;
+		}
+		else
+		{
+			// CLOCK: skip referenced slots once, new pages start unreferenced so one pass scans do not flush hot pages
+			while ((w25qxx.Cache[w25qxx.CacheHand].Valid == 1) && (w25qxx.Cache[w25qxx.CacheHand].Ref == 1))
+			{
+				w25qxx.Cache[w25qxx.CacheHand].Ref = 0;
+				w25qxx.CacheHand = (w25qxx.CacheHand + 1) % _W25QXX_READ_CACHE_SLOTS;
+			}
+			Slot = &w25qxx.Cache[w25qxx.CacheHand];
+			w25qxx.CacheHand = (w25qxx.CacheHand + 1) % _W25QXX_READ_CACHE_SLOTS;
+			W25qxx_ReadRaw(Slot->Data, Page * w25qxx.PageSize, w25qxx.PageSize);
+			Slot->Page = Page;
+			Slot->Valid = 1;
+			Slot->Ref = 0;
+			w25qxx.CacheStats.Misses++;
+			AllHit = false;
+		}
+		memcpy(pBuffer, &Slot->Data[Offset], Chunk);
+		pBuffer += Chunk;
+		ReadAddr += Chunk;
+		NumByteToRead -= Chunk;
+	}
+	return AllHit;
+}
+#endif
+//###################################################################################################################
+// keeps driver side state (sector map, ...) in sync, called after every program and erase
+static void W25qxx_Programmed(uint8_t *pBuffer, uint32_t WriteAddr, uint32_t NumByteToWrite)
+{
+#if (_W25QXX_USE_SECTOR_MAP == 1)
+	for (uint32_t i = 0; i < NumByteToWrite; i++)
+	{
+		if (pBuffer[i] != 0xFF)
+		{
+			W25qxx_MapSet(WriteAddr / w25qxx.SectorSize, W25QXX_SECTOR_PROGRAMMED);
+			break;
+		}
+	}
+#else
+	(void)pBuffer;
+#endif
+#if (_W25QXX_READ_CACHE_SLOTS > 0)
+	W25qxx_CacheInvalidate(WriteAddr, NumByteToWrite);
+#endif
+	(void)WriteAddr;
+	(void)NumByteToWrite;
+}
+//###################################################################################################################
+// the erase command was sent, the sectors count as erased once W25qxx_OpDone() sees it done
+static void W25qxx_Erased(uint32_t EraseAddr, uint32_t Size)
+{
+#if (_W25QXX_USE_SECTOR_MAP == 1)
+	for (uint32_t Sector = EraseAddr / w25qxx.SectorSize; Sector < (EraseAddr + Size) / w25qxx.SectorSize; Sector++)
+		W25qxx_MapSet(Sector, W25QXX_SECTOR_UNKNOWN);
+#endif
+	w25qxx.EraseAddr[w25qxx.Die] = EraseAddr;
+	w25qxx.EraseSize[w25qxx.Die] = Size;
+#if (_W25QXX_USE_HEALTH == 1)
+	if (w25qxx.Health != NULL)
+	{
+		for (uint32_t Entry = W25qxx_HealthEntry(EraseAddr); Entry <= W25qxx_HealthEntry(EraseAddr + Size - 1); Entry++)
+			w25qxx.Health->Entry[Entry].EraseCount++;
+	}
+#endif
+#if (_W25QXX_READ_CACHE_SLOTS > 0)
+	W25qxx_CacheInvalidate(EraseAddr, Size);
+#endif
+	(void)EraseAddr;
+	(void)Size;
+}
+//###################################################################################################################
+static void W25qxx_WriteEnableNoDelay(void)
+{
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_RESET);
+	W25qxx_Spi(0x06);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
+}
+//###################################################################################################################
+// NumByteToWrite must not cross a page boundary, returns while the chip is still busy
+static void W25qxx_ProgramStartRaw(uint8_t *pBuffer, uint32_t WriteAddr, uint32_t NumByteToWrite)
+{
+	W25qxx_BufferSync(WriteAddr, NumByteToWrite);
+	W25qxx_DieSelect(WriteAddr);
+	W25qxx_WaitBusy();
+	W25qxx_WriteEnableNoDelay();
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_RESET);
+	W25qxx_SendCmdAddr(0x02, 0x12, WriteAddr, 0);
+	HAL_SPI_Transmit(w25qxx.Spi, pBuffer, NumByteToWrite, 100);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
+	w25qxx.Busy = 1;
+	W25qxx_OpStart(1, WriteAddr, NumByteToWrite);
+	W25qxx_Programmed(pBuffer, WriteAddr, NumByteToWrite);
+}
+//###################################################################################################################
+static void W25qxx_ProgramRaw(uint8_t *pBuffer, uint32_t WriteAddr, uint32_t NumByteToWrite)
+{
+	W25qxx_ProgramStartRaw(pBuffer, WriteAddr, NumByteToWrite);
+	W25qxx_WaitBusy();
+}
+//###################################################################################################################
+static void W25qxx_EraseStartRaw(uint8_t Cmd, uint8_t Cmd4Byte, uint32_t EraseAddr)
+{
+	W25qxx_BufferDrop(EraseAddr, (Cmd == 0x20) ? w25qxx.SectorSize : w25qxx.BlockSize);
+	W25qxx_DieSelect(EraseAddr);
+	W25qxx_EraseFinish();
+	W25qxx_WriteEnableNoDelay();
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_RESET);
+	W25qxx_SendCmdAddr(Cmd, Cmd4Byte, EraseAddr, 0);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
+	w25qxx.Busy = 1;
+	W25qxx_OpStart(2, EraseAddr, (Cmd == 0x20) ? w25qxx.SectorSize : w25qxx.BlockSize);
+	W25qxx_Erased(EraseAddr, (Cmd == 0x20) ? w25qxx.SectorSize : w25qxx.BlockSize);
+}
+//###################################################################################################################
+static void W25qxx_EraseRaw(uint8_t Cmd, uint8_t Cmd4Byte, uint32_t EraseAddr)
+{
+	W25qxx_EraseStartRaw(Cmd, Cmd4Byte, EraseAddr);
+	W25qxx_WaitBusy();
+}
+//###################################################################################################################
+static void W25qxx_BufferFlush(void)
+{
+#if (_W25QXX_USE_WRITE_BUFFER == 1)
+	if (w25qxx.WriteBuffer.Valid == 0)
+		return;
+	w25qxx.WriteBuffer.Valid = 0;
+	W25qxx_ProgramRaw(&w25qxx.WriteBuffer.Data[w25qxx.WriteBuffer.Start], w25qxx.WriteBuffer.Page * w25qxx.PageSize + w25qxx.WriteBuffer.Start, w25qxx.WriteBuffer.End - w25qxx.WriteBuffer.Start);
+#endif
+}
+//###################################################################################################################
+// any access to the buffered page has to see the flash up to date
+static void W25qxx_BufferSync(uint32_t Address, uint32_t Size)
+{
+#if (_W25QXX_USE_WRITE_BUFFER == 1)
+	if ((w25qxx.WriteBuffer.Valid == 1) && (Size > 0) && (w25qxx.WriteBuffer.Page >= Address / w25qxx.PageSize) && (w25qxx.WriteBuffer.Page <= (Address + Size - 1) / w25qxx.PageSize))
+		W25qxx_BufferFlush();
+#else
+	(void)Address;
+	(void)Size;
+#endif
+}
+//###################################################################################################################
+// the buffered bytes would be erased anyway
+static void W25qxx_BufferDrop(uint32_t Address, uint32_t Size)
+{
+#if (_W25QXX_USE_WRITE_BUFFER == 1)
+	if ((w25qxx.WriteBuffer.Valid == 1) && (w25qxx.WriteBuffer.Page >= Address / w25qxx.PageSize) && (w25qxx.WriteBuffer.Page < (Address + Size) / w25qxx.PageSize))
+		w25qxx.WriteBuffer.Valid = 0;
+#else
+	(void)Address;
+	(void)Size;
+#endif
+}
+//###################################################################################################################
+#if (_W25QXX_USE_WRITE_BUFFER == 1)
+// NumByteToWrite must not cross a page boundary
+static void W25qxx_BufferWrite(uint8_t *pBuffer, uint32_t WriteAddr, uint32_t NumByteToWrite)
+{
+	uint32_t Page = WriteAddr / w25qxx.PageSize;
+	uint32_t Offset = WriteAddr % w25qxx.PageSize;
+	if ((w25qxx.WriteBuffer.Valid == 1) && ((w25qxx.WriteBuffer.Page != Page) || (HAL_GetTick() - w25qxx.WriteBuffer.Tick >= _W25QXX_WRITE_BUFFER_TIMEOUT)))
+		W25qxx_BufferFlush();
+	if (w25qxx.WriteBuffer.Valid == 0)
+	{
+		memset(w25qxx.WriteBuffer.Data, 0xFF, sizeof(w25qxx.WriteBuffer.Data));
+		w25qxx.WriteBuffer.Page = Page;
+		w25qxx.WriteBuffer.Tick = HAL_GetTick();
+		w25qxx.WriteBuffer.Start = Offset;
+		w25qxx.WriteBuffer.End = Offset + NumByteToWrite;
+		w25qxx.WriteBuffer.Valid = 1;
+	}
+	// programming only clears bits, writing the same byte twice ands them like the flash would
+	for (uint32_t i = 0; i < NumByteToWrite; i++)
+		w25qxx.WriteBuffer.Data[Offset + i] &= pBuffer[i];
+	if (Offset < w25qxx.WriteBuffer.Start)
+		w25qxx.WriteBuffer.Start = Offset;
+	if (Offset + NumByteToWrite > w25qxx.WriteBuffer.End)
+		w25qxx.WriteBuffer.End = Offset + NumByteToWrite;
+	// sector map and read cache see the data as written already
+	W25qxx_Programmed(pBuffer, WriteAddr, NumByteToWrite);
+	if ((w25qxx.WriteBuffer.Start == 0) && (w25qxx.WriteBuffer.End == w25qxx.PageSize))
+		W25qxx_BufferFlush();
 }
+#endif
 //###################################################################################################################
 bool W25qxx_Init(void)
 {
 	w25qxx.Lock = 1;
+	if (w25qxx.Spi == NULL)
+	{
+		w25qxx.Spi = &_W25QXX_SPI;
+		w25qxx.CsGpio = _W25QXX_CS_GPIO;
+		w25qxx.CsPin = _W25QXX_CS_PIN;
+	}
+	w25qxx.Busy = 1; // an erase may still run after a MCU reset
 	while (HAL_GetTick() < 100)
 		W25qxx_Delay(1);
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
 	W25qxx_Delay(100);
 	uint32_t id;
 #if (_W25QXX_DEBUG == 1)
@@ -141,8 +746,25 @@ bool W25qxx_Init(void)
 #if (_W25QXX_DEBUG == 1)
 	printf("w25qxx ID:0x%X\r\n", id);
 #endif
+	w25qxx.DieCount = 1;
 	switch (id & 0x000000FF)
 	{
+	case 0x22: // 	w25q02, 4 x 512 Mbit
+		w25qxx.ID = W25Q02;
+		w25qxx.BlockCount = 4096;
+		w25qxx.DieCount = 4;
+#if (_W25QXX_DEBUG == 1)
+		printf("w25qxx Chip: w25q02\r\n");
+#endif
+		break;
+	case 0x21: // 	w25q01, 2 x 512 Mbit
+		w25qxx.ID = W25Q01;
+		w25qxx.BlockCount = 2048;
+		w25qxx.DieCount = 2;
+#if (_W25QXX_DEBUG == 1)
+		printf("w25qxx Chip: w25q01\r\n");
+#endif
+		break;
 	case 0x20: // 	w25q512
 		w25qxx.ID = W25Q512;
 		w25qxx.BlockCount = 1024;
@@ -151,6 +773,16 @@ bool W25qxx_Init(void)
 #endif
 		break;
 	case 0x19: // 	w25q256
+		if ((id & 0x0000FF00) == 0x7100) // w25m512, 2 x w25q256
+		{
+			w25qxx.ID = W25M512;
+			w25qxx.BlockCount = 1024;
+			w25qxx.DieCount = 2;
+#if (_W25QXX_DEBUG == 1)
+			printf("w25qxx Chip: w25m512\r\n");
+#endif
+			break;
+		}
 		w25qxx.ID = W25Q256;
 		w25qxx.BlockCount = 512;
 #if (_W25QXX_DEBUG == 1)
@@ -226,10 +858,40 @@ bool W25qxx_Init(void)
 	w25qxx.PageCount = (w25qxx.SectorCount * w25qxx.SectorSize) / w25qxx.PageSize;
 	w25qxx.BlockSize = w25qxx.SectorSize * 16;
 	w25qxx.CapacityInKiloByte = (w25qxx.SectorCount * w25qxx.SectorSize) / 1024;
+#if (_W25QXX_USE_SECTOR_MAP == 1)
+	memset(w25qxx.SectorMap, 0, sizeof(w25qxx.SectorMap));
+#endif
+#if (_W25QXX_READ_CACHE_SLOTS > 0)
+	memset(w25qxx.Cache, 0, sizeof(w25qxx.Cache));
+#endif
+#if (_W25QXX_USE_WRITE_BUFFER == 1)
+	w25qxx.WriteBuffer.Valid = 0;
+#endif
+	w25qxx.Die = 0;
+	if (w25qxx.DieCount > 1)
+	{
+		// the die select outlives a MCU reset
+		HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_RESET);
+		W25qxx_Spi(0xC2);
+		W25qxx_Spi(0);
+		HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
+		for (uint8_t Die = 1; Die < w25qxx.DieCount; Die++)
+		{
+			w25qxx.DieBusy[Die] = 1;
+			w25qxx.DieSuspended[Die] = 0;
+		}
+	}
 	W25qxx_ReadUniqID();
 	W25qxx_ReadStatusRegister(1);
 	W25qxx_ReadStatusRegister(2);
 	W25qxx_ReadStatusRegister(3);
+	w25qxx.Suspended = ((w25qxx.StatusRegister2 & 0x80) == 0x80) ? 1 : 0; // suspended before a MCU reset
+	for (uint8_t Die = 1; Die < w25qxx.DieCount; Die++)
+	{
+		W25qxx_DieSelectRaw(Die);
+		w25qxx.Suspended = ((W25qxx_ReadStatusRegister(2) & 0x80) == 0x80) ? 1 : 0;
+	}
+	W25qxx_DieSelectRaw(0);
 #if (_W25QXX_DEBUG == 1)
 	printf("w25qxx Page Size: %d Bytes\r\n", w25qxx.PageSize);
 	printf("w25qxx Page Count: %d\r\n", w25qxx.PageCount);
@@ -244,55 +906,246 @@ bool W25qxx_Init(void)
 	return true;
 }
 //###################################################################################################################
-void W25qxx_EraseChip(void)
+bool W25qxx_InitDevice(w25qxx_t *Device, SPI_HandleTypeDef *Spi, GPIO_TypeDef *CsGpio, uint16_t CsPin)
 {
-	while (w25qxx.Lock == 1)
-		W25qxx_Delay(1);
-	w25qxx.Lock = 1;
-#if (_W25QXX_DEBUG == 1)
-	uint32_t StartTime = HAL_GetTick();
-	printf("w25qxx EraseChip Begin...\r\n");
-#endif
-	W25qxx_WriteEnable();
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-	W25qxx_Spi(0xC7);
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-	W25qxx_WaitForWriteEnd();
-#if (_W25QXX_DEBUG == 1)
-	printf("w25qxx EraseBlock done after %d ms!\r\n", HAL_GetTick() - StartTime);
-#endif
-	W25qxx_Delay(10);
-	w25qxx.Lock = 0;
+	bool Ok;
+	memset(Device, 0, sizeof(w25qxx_t));
+	Device->Spi = Spi;
+	Device->CsGpio = CsGpio;
+	Device->CsPin = CsPin;
+	W25qxx_SelectDevice(Device);
+	W25qxx_DeviceAcquire(Device);
+	Ok = W25qxx_Init();
+	W25qxx_DeviceRelease();
+	return Ok;
 }
 //###################################################################################################################
-void W25qxx_EraseSector(uint32_t SectorAddr)
+void W25qxx_DeviceAcquire(w25qxx_t *Device)
 {
-	while (w25qxx.Lock == 1)
-		W25qxx_Delay(1);
-	w25qxx.Lock = 1;
-#if (_W25QXX_DEBUG == 1)
-	uint32_t StartTime = HAL_GetTick();
-	printf("w25qxx EraseSector %d Begin...\r\n", SectorAddr);
-#endif
-	W25qxx_WaitForWriteEnd();
-	SectorAddr = SectorAddr * w25qxx.SectorSize;
-	W25qxx_WriteEnable();
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-	if (w25qxx.ID >= W25Q256)
+	w25qxx_t *Previous;
+	if (Device == NULL)
+		Device = W25qxx_Default;
+	W25qxx_EnterCritical();
+	// another chip stays selected while it has users or a call in progress
+	while ((W25qxx_DevSwitching == 1) || ((Device != W25qxx_Dev) && ((W25qxx_DevUsers > 0) || (w25qxx.Lock == 1))))
 	{
-		W25qxx_Spi(0x21);
-		W25qxx_Spi((SectorAddr & 0xFF000000) >> 24);
+		W25qxx_ExitCritical();
+		W25qxx_Delay(1);
+		W25qxx_EnterCritical();
 	}
-	else
+	Previous = W25qxx_Dev;
+	W25qxx_DevUsers++;
+	if (Device != Previous)
 	{
-		W25qxx_Spi(0x20);
+		W25qxx_DevSwitching = 1;
+		w25qxx.Lock = 1;
 	}
-	W25qxx_Spi((SectorAddr & 0xFF0000) >> 16);
-	W25qxx_Spi((SectorAddr & 0xFF00) >> 8);
-	W25qxx_Spi(SectorAddr & 0xFF);
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-	W25qxx_WaitForWriteEnd();
-#if (_W25QXX_DEBUG == 1)
+	W25qxx_ExitCritical();
+	if (Device == Previous)
+		return;
+	// sector map, read cache and write buffer are in the device, they stay with their chip
+	W25qxx_Dev = Device;
+	Previous->Lock = 0;
+	W25qxx_DevSwitching = 0;
+}
+//###################################################################################################################
+void W25qxx_DeviceRelease(void)
+{
+	bool Last;
+	W25qxx_EnterCritical();
+	W25qxx_DevUsers--;
+	Last = (W25qxx_DevUsers == 0);
+	W25qxx_ExitCritical();
+	// the last user puts the chip of the plain API back
+	if ((Last == true) && (W25qxx_Dev != W25qxx_Selected))
+	{
+		W25qxx_DeviceAcquire(W25qxx_Selected);
+		W25qxx_EnterCritical();
+		W25qxx_DevUsers--;
+		W25qxx_ExitCritical();
+	}
+}
+//###################################################################################################################
+void W25qxx_SelectDevice(w25qxx_t *Device)
+{
+	if (Device == NULL)
+		Device = W25qxx_Default;
+	W25qxx_DeviceAcquire(Device);
+	W25qxx_Selected = Device;
+	W25qxx_DeviceRelease();
+}
+//###################################################################################################################
+w25qxx_t *W25qxx_GetDevice(void)
+{
+	return W25qxx_Dev;
+}
+//###################################################################################################################
+void W25qxx_ProgramStart(uint8_t *pBuffer, uint32_t WriteAddr, uint32_t NumByteToWrite_up_to_PageEnd)
+{
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+	if ((NumByteToWrite_up_to_PageEnd == 0) || (NumByteToWrite_up_to_PageEnd > w25qxx.PageSize - (WriteAddr % w25qxx.PageSize)))
+		NumByteToWrite_up_to_PageEnd = w25qxx.PageSize - (WriteAddr % w25qxx.PageSize);
+	W25qxx_ProgramStartRaw(pBuffer, WriteAddr, NumByteToWrite_up_to_PageEnd);
+	w25qxx.Lock = 0;
+}
+//###################################################################################################################
+void W25qxx_EraseSectorStart(uint32_t SectorAddr)
+{
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+#if (_W25QXX_USE_SECTOR_MAP == 1)
+	if (W25qxx_MapGet(SectorAddr) != W25QXX_SECTOR_ERASED)
+#endif
+		W25qxx_EraseStartRaw(0x20, 0x21, SectorAddr * w25qxx.SectorSize);
+	w25qxx.Lock = 0;
+}
+//###################################################################################################################
+void W25qxx_EraseSectorBackground(uint32_t SectorAddr)
+{
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+#if (_W25QXX_USE_SECTOR_MAP == 1)
+	if (W25qxx_MapGet(SectorAddr) != W25QXX_SECTOR_ERASED)
+#endif
+	{
+		W25qxx_EraseStartRaw(0x20, 0x21, SectorAddr * w25qxx.SectorSize);
+		w25qxx.Busy = 2;
+	}
+	w25qxx.Lock = 0;
+}
+//###################################################################################################################
+void W25qxx_EraseResume(void)
+{
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+	for (uint8_t Die = 0; Die < w25qxx.DieCount; Die++)
+	{
+		if (W25qxx_DieIdle(Die))
+			continue;
+		W25qxx_DieSelectRaw(Die);
+		if (w25qxx.Suspended == 1)
+		{
+			W25qxx_WaitBusy(); // a program started during the suspend
+			W25qxx_ResumeRaw();
+		}
+	}
+	w25qxx.Lock = 0;
+}
+//###################################################################################################################
+bool W25qxx_IsBusy(void)
+{
+	bool Busy = false;
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+	for (uint8_t Die = 0; Die < w25qxx.DieCount; Die++)
+	{
+		if (W25qxx_DieIdle(Die))
+			continue;
+		W25qxx_DieSelectRaw(Die);
+		if ((w25qxx.Busy != 0) && ((W25qxx_ReadStatusRegister(1) & 0x01) == 0))
+		{
+			W25qxx_OpDone();
+			w25qxx.Busy = 0;
+		}
+		if ((w25qxx.Busy != 0) || (w25qxx.Suspended == 1))
+			Busy = true;
+	}
+	w25qxx.Lock = 0;
+	return Busy;
+}
+//###################################################################################################################
+bool W25qxx_IsErasing(uint32_t SectorAddr)
+{
+	uint32_t Address = SectorAddr * w25qxx.SectorSize;
+	uint8_t Die = (w25qxx.DieCount > 1) ? Address / W25qxx_DieSize() : 0;
+	bool Erasing;
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+	// only the die of the sector is polled, W25qxx_OpDone() ends its erase
+	if (W25qxx_DieIdle(Die) == false)
+	{
+		W25qxx_DieSelectRaw(Die);
+		if ((w25qxx.Busy != 0) && ((W25qxx_ReadStatusRegister(1) & 0x01) == 0))
+		{
+			W25qxx_OpDone();
+			w25qxx.Busy = 0;
+		}
+	}
+	Erasing = (w25qxx.EraseSize[Die] != 0) && (Address >= w25qxx.EraseAddr[Die]) && (Address < w25qxx.EraseAddr[Die] + w25qxx.EraseSize[Die]);
+	w25qxx.Lock = 0;
+	return Erasing;
+}
+//###################################################################################################################
+void W25qxx_WaitReady(void)
+{
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+	for (uint8_t Die = 0; Die < w25qxx.DieCount; Die++)
+	{
+		if (W25qxx_DieIdle(Die))
+			continue;
+		W25qxx_DieSelectRaw(Die);
+		W25qxx_EraseFinish();
+	}
+	w25qxx.Lock = 0;
+}
+//###################################################################################################################
+void W25qxx_EraseChip(void)
+{
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+#if (_W25QXX_DEBUG == 1)
+	uint32_t StartTime = HAL_GetTick();
+	printf("w25qxx EraseChip Begin...\r\n");
+#endif
+	W25qxx_BufferDrop(0, w25qxx.SectorCount * w25qxx.SectorSize);
+	// Chip Erase only erases the selected die, all of them erase at the same time
+	for (uint8_t Die = 0; Die < w25qxx.DieCount; Die++)
+	{
+		W25qxx_DieSelectRaw(Die);
+		W25qxx_EraseFinish();
+		W25qxx_WriteEnable();
+		HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_RESET);
+		W25qxx_Spi(0xC7);
+		HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
+		w25qxx.Busy = 1;
+		W25qxx_Erased(Die * W25qxx_DieSize(), W25qxx_DieSize());
+	}
+	for (uint8_t Die = 0; Die < w25qxx.DieCount; Die++)
+	{
+		W25qxx_DieSelectRaw(Die);
+		W25qxx_WaitForWriteEnd();
+	}
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx EraseBlock done after %d ms!\r\n", HAL_GetTick() - StartTime);
+#endif
+	W25qxx_Delay(10);
+	w25qxx.Lock = 0;
+}
+//###################################################################################################################
+void W25qxx_EraseSector(uint32_t SectorAddr)
+{
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+#if (_W25QXX_DEBUG == 1)
+	uint32_t StartTime = HAL_GetTick();
+	printf("w25qxx EraseSector %d Begin...\r\n", SectorAddr);
+#endif
+#if (_W25QXX_USE_SECTOR_MAP == 1)
+	if (W25qxx_MapGet(SectorAddr) != W25QXX_SECTOR_ERASED)
+#endif
+		W25qxx_EraseRaw(0x20, 0x21, SectorAddr * w25qxx.SectorSize);
+#if (_W25QXX_DEBUG == 1)
 	printf("w25qxx EraseSector done after %d ms\r\n", HAL_GetTick() - StartTime);
 #endif
 	W25qxx_Delay(1);
@@ -309,24 +1162,11 @@ void W25qxx_EraseBlock(uint32_t BlockAddr)
 	W25qxx_Delay(100);
 	uint32_t StartTime = HAL_GetTick();
 #endif
-	W25qxx_WaitForWriteEnd();
 	BlockAddr = BlockAddr * w25qxx.SectorSize * 16;
-	W25qxx_WriteEnable();
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-	if (w25qxx.ID >= W25Q256)
-	{
-		W25qxx_Spi(0xDC);
-		W25qxx_Spi((BlockAddr & 0xFF000000) >> 24);
-	}
-	else
-	{
-		W25qxx_Spi(0xD8);
-	}
-	W25qxx_Spi((BlockAddr & 0xFF0000) >> 16);
-	W25qxx_Spi((BlockAddr & 0xFF00) >> 8);
-	W25qxx_Spi(BlockAddr & 0xFF);
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-	W25qxx_WaitForWriteEnd();
+#if (_W25QXX_USE_SECTOR_MAP == 1)
+	if (W25qxx_MapIsErased(BlockAddr, w25qxx.BlockSize) == false)
+#endif
+		W25qxx_EraseRaw(0xD8, 0xDC, BlockAddr);
 #if (_W25QXX_DEBUG == 1)
 	printf("w25qxx EraseBlock done after %d ms\r\n", HAL_GetTick() - StartTime);
 	W25qxx_Delay(100);
@@ -362,6 +1202,7 @@ uint32_t W25qxx_BlockToPage(uint32_t BlockAddress)
 //###################################################################################################################
 bool W25qxx_IsEmptyPage(uint32_t Page_Address, uint32_t OffsetInByte, uint32_t NumByteToCheck_up_to_PageSize)
 {
+	bool Empty;
 	while (w25qxx.Lock == 1)
 		W25qxx_Delay(1);
 	w25qxx.Lock = 1;
@@ -372,274 +1213,437 @@ bool W25qxx_IsEmptyPage(uint32_t Page_Address, uint32_t OffsetInByte, uint32_t N
 	W25qxx_Delay(100);
 	uint32_t StartTime = HAL_GetTick();
 #endif
-	uint8_t pBuffer[32];
-	uint32_t WorkAddress;
-	uint32_t i;
-	for (i = OffsetInByte; i < w25qxx.PageSize; i += sizeof(pBuffer))
-	{
-		HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-		WorkAddress = (i + Page_Address * w25qxx.PageSize);
-		if (w25qxx.ID >= W25Q256)
-		{
-			W25qxx_Spi(0x0C);
-			W25qxx_Spi((WorkAddress & 0xFF000000) >> 24);
-		}
-		else
-		{
-			W25qxx_Spi(0x0B);
-		}
-		W25qxx_Spi((WorkAddress & 0xFF0000) >> 16);
-		W25qxx_Spi((WorkAddress & 0xFF00) >> 8);
-		W25qxx_Spi(WorkAddress & 0xFF);
-		W25qxx_Spi(0);
-		HAL_SPI_Receive(&_W25QXX_SPI, pBuffer, sizeof(pBuffer), 100);
-		HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-		for (uint8_t x = 0; x < sizeof(pBuffer); x++)
-		{
-			if (pBuffer[x] != 0xFF)
-				goto NOT_EMPTY;
-		}
-	}
-	if ((w25qxx.PageSize + OffsetInByte) % sizeof(pBuffer) != 0)
-	{
-		i -= sizeof(pBuffer);
-		for (; i < w25qxx.PageSize; i++)
-		{
-			HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-			WorkAddress = (i + Page_Address * w25qxx.PageSize);
-			W25qxx_Spi(0x0B);
-			if (w25qxx.ID >= W25Q256)
-			{
-				W25qxx_Spi(0x0C);
-				W25qxx_Spi((WorkAddress & 0xFF000000) >> 24);
-			}
-			else
-			{
-				W25qxx_Spi(0x0B);
-			}
-			W25qxx_Spi((WorkAddress & 0xFF0000) >> 16);
-			W25qxx_Spi((WorkAddress & 0xFF00) >> 8);
-			W25qxx_Spi(WorkAddress & 0xFF);
-			W25qxx_Spi(0);
-			HAL_SPI_Receive(&_W25QXX_SPI, pBuffer, 1, 100);
-			HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-			if (pBuffer[0] != 0xFF)
-				goto NOT_EMPTY;
-		}
-	}
+#if (_W25QXX_USE_SECTOR_MAP == 1)
+	if (W25qxx_MapGet(W25qxx_PageToSector(Page_Address)) == W25QXX_SECTOR_ERASED)
+		Empty = true;
+	else
+#endif
+		Empty = W25qxx_IsBlankRaw(Page_Address * w25qxx.PageSize + OffsetInByte, NumByteToCheck_up_to_PageSize);
 #if (_W25QXX_DEBUG == 1)
-	printf("w25qxx CheckPage is Empty in %d ms\r\n", HAL_GetTick() - StartTime);
+	printf("w25qxx CheckPage is %s in %d ms\r\n", Empty ? "Empty" : "Not Empty", HAL_GetTick() - StartTime);
 	W25qxx_Delay(100);
 #endif
 	w25qxx.Lock = 0;
-	return true;
-NOT_EMPTY:
+	return Empty;
+}
+//###################################################################################################################
+bool W25qxx_IsEmptySector(uint32_t Sector_Address, uint32_t OffsetInByte, uint32_t NumByteToCheck_up_to_SectorSize)
+{
+	bool Empty;
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+	if (((NumByteToCheck_up_to_SectorSize + OffsetInByte) > w25qxx.SectorSize) || (NumByteToCheck_up_to_SectorSize == 0))
+		NumByteToCheck_up_to_SectorSize = w25qxx.SectorSize - OffsetInByte;
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx CheckSector:%d, Offset:%d, Bytes:%d begin...\r\n", Sector_Address, OffsetInByte, NumByteToCheck_up_to_SectorSize);
+	W25qxx_Delay(100);
+	uint32_t StartTime = HAL_GetTick();
+#endif
+#if (_W25QXX_USE_SECTOR_MAP == 1)
+	if (W25qxx_MapGet(Sector_Address) == W25QXX_SECTOR_ERASED)
+		Empty = true;
+	else
+	{
+		Empty = W25qxx_IsBlankRaw(Sector_Address * w25qxx.SectorSize + OffsetInByte, NumByteToCheck_up_to_SectorSize);
+		if (Empty == false)
+			W25qxx_MapSet(Sector_Address, W25QXX_SECTOR_PROGRAMMED);
+		else if (NumByteToCheck_up_to_SectorSize == w25qxx.SectorSize)
+			W25qxx_MapSet(Sector_Address, W25QXX_SECTOR_ERASED);
+	}
+#else
+	Empty = W25qxx_IsBlankRaw(Sector_Address * w25qxx.SectorSize + OffsetInByte, NumByteToCheck_up_to_SectorSize);
+#endif
 #if (_W25QXX_DEBUG == 1)
-	printf("w25qxx CheckPage is Not Empty in %d ms\r\n", HAL_GetTick() - StartTime);
+	printf("w25qxx CheckSector is %s in %d ms\r\n", Empty ? "Empty" : "Not Empty", HAL_GetTick() - StartTime);
 	W25qxx_Delay(100);
 #endif
 	w25qxx.Lock = 0;
-	return false;
+	return Empty;
 }
 //###################################################################################################################
-bool W25qxx_IsEmptySector(uint32_t Sector_Address, uint32_t OffsetInByte, uint32_t NumByteToCheck_up_to_SectorSize)
+bool W25qxx_IsEmptyBlock(uint32_t Block_Address, uint32_t OffsetInByte, uint32_t NumByteToCheck_up_to_BlockSize)
 {
+	bool Empty;
 	while (w25qxx.Lock == 1)
 		W25qxx_Delay(1);
 	w25qxx.Lock = 1;
-	if ((NumByteToCheck_up_to_SectorSize > w25qxx.SectorSize) || (NumByteToCheck_up_to_SectorSize == 0))
-		NumByteToCheck_up_to_SectorSize = w25qxx.SectorSize;
+	if (((NumByteToCheck_up_to_BlockSize + OffsetInByte) > w25qxx.BlockSize) || (NumByteToCheck_up_to_BlockSize == 0))
+		NumByteToCheck_up_to_BlockSize = w25qxx.BlockSize - OffsetInByte;
 #if (_W25QXX_DEBUG == 1)
-	printf("w25qxx CheckSector:%d, Offset:%d, Bytes:%d begin...\r\n", Sector_Address, OffsetInByte, NumByteToCheck_up_to_SectorSize);
+	printf("w25qxx CheckBlock:%d, Offset:%d, Bytes:%d begin...\r\n", Block_Address, OffsetInByte, NumByteToCheck_up_to_BlockSize);
 	W25qxx_Delay(100);
 	uint32_t StartTime = HAL_GetTick();
 #endif
-	uint8_t pBuffer[32];
-	uint32_t WorkAddress;
-	uint32_t i;
-	for (i = OffsetInByte; i < w25qxx.SectorSize; i += sizeof(pBuffer))
-	{
-		HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-		WorkAddress = (i + Sector_Address * w25qxx.SectorSize);
-		W25qxx_Spi(0x0B);
-		if (w25qxx.ID >= W25Q256)
-		{
-			W25qxx_Spi(0x0C);
-			W25qxx_Spi((WorkAddress & 0xFF000000) >> 24);
-		}
+#if (_W25QXX_USE_SECTOR_MAP == 1)
+	if (W25qxx_MapIsErased(Block_Address * w25qxx.BlockSize, w25qxx.BlockSize))
+		Empty = true;
+	else
+#endif
+		Empty = W25qxx_IsBlankRaw(Block_Address * w25qxx.BlockSize + OffsetInByte, NumByteToCheck_up_to_BlockSize);
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx CheckBlock is %s in %d ms\r\n", Empty ? "Empty" : "Not Empty", HAL_GetTick() - StartTime);
+	W25qxx_Delay(100);
+#endif
+	w25qxx.Lock = 0;
+	return Empty;
+}
+//###################################################################################################################
+static bool W25qxx_FrontierUsed(uint32_t CheckAddr, uint32_t NumByteToCheck)
+{
+#if (_W25QXX_USE_SECTOR_MAP == 1)
+	if (W25qxx_MapIsErased(CheckAddr, NumByteToCheck))
+		return false;
+#endif
+	return !W25qxx_IsBlankRaw(CheckAddr, NumByteToCheck);
+}
+//###################################################################################################################
+// first of Count units whose first Probe bytes are blank, Count if none
+static uint32_t W25qxx_FrontierSearch(uint32_t StartAddr, uint32_t UnitSize, uint32_t Count, uint32_t Probe)
+{
+	uint32_t Lo = 0, Hi = Count, Mid;
+	while (Lo < Hi)
+	{
+		Mid = Lo + (Hi - Lo) / 2;
+		if (W25qxx_FrontierUsed(StartAddr + Mid * UnitSize, Probe))
+			Lo = Mid + 1;
 		else
-		{
-			W25qxx_Spi(0x0B);
-		}
-		W25qxx_Spi((WorkAddress & 0xFF0000) >> 16);
-		W25qxx_Spi((WorkAddress & 0xFF00) >> 8);
-		W25qxx_Spi(WorkAddress & 0xFF);
-		W25qxx_Spi(0);
-		HAL_SPI_Receive(&_W25QXX_SPI, pBuffer, sizeof(pBuffer), 100);
-		HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-		for (uint8_t x = 0; x < sizeof(pBuffer); x++)
-		{
-			if (pBuffer[x] != 0xFF)
-				goto NOT_EMPTY;
-		}
+			Hi = Mid;
 	}
-	if ((w25qxx.SectorSize + OffsetInByte) % sizeof(pBuffer) != 0)
+	return Lo;
+}
+//###################################################################################################################
+// backwards from EndAddr, whole sectors first, then the granules of the first used one
+static uint32_t W25qxx_FrontierScanRaw(uint32_t StartAddr, uint32_t EndAddr, uint32_t Granularity)
+{
+	uint32_t Count = (EndAddr - StartAddr) / Granularity;
+	uint32_t Step = (Granularity < w25qxx.SectorSize) ? w25qxx.SectorSize / Granularity : 1;
+	uint32_t n;
+	while (Count > 0)
 	{
-		i -= sizeof(pBuffer);
-		for (; i < w25qxx.SectorSize; i++)
-		{
-			HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-			WorkAddress = (i + Sector_Address * w25qxx.SectorSize);
-			if (w25qxx.ID >= W25Q256)
-			{
-				W25qxx_Spi(0x0C);
-				W25qxx_Spi((WorkAddress & 0xFF000000) >> 24);
-			}
-			else
-			{
-				W25qxx_Spi(0x0B);
-			}
-			W25qxx_Spi((WorkAddress & 0xFF0000) >> 16);
-			W25qxx_Spi((WorkAddress & 0xFF00) >> 8);
-			W25qxx_Spi(WorkAddress & 0xFF);
-			W25qxx_Spi(0);
-			HAL_SPI_Receive(&_W25QXX_SPI, pBuffer, 1, 100);
-			HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-			if (pBuffer[0] != 0xFF)
-				goto NOT_EMPTY;
-		}
+		n = (Count % Step == 0) ? Step : Count % Step;
+		if (W25qxx_FrontierUsed(StartAddr + (Count - n) * Granularity, n * Granularity))
+			break;
+		Count -= n;
 	}
+	while ((Count > 0) && !W25qxx_FrontierUsed(StartAddr + (Count - 1) * Granularity, Granularity))
+		Count--;
+	return StartAddr + Count * Granularity;
+}
+//###################################################################################################################
+uint32_t W25qxx_FindFrontier(uint32_t StartAddr, uint32_t EndAddr, uint32_t Granularity)
+{
+	uint32_t Count, Step, Unit, Frontier, Probe, Verify;
+	// no probes past the end of the chip, they would wrap around to its start
+	if (EndAddr > w25qxx.SectorCount * w25qxx.SectorSize)
+		EndAddr = w25qxx.SectorCount * w25qxx.SectorSize;
+	if (EndAddr <= StartAddr)
+		return StartAddr;
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+	if (Granularity == 0)
+		Granularity = w25qxx.PageSize;
 #if (_W25QXX_DEBUG == 1)
-	printf("w25qxx CheckSector is Empty in %d ms\r\n", HAL_GetTick() - StartTime);
-	W25qxx_Delay(100);
+	printf("w25qxx FindFrontier %d..%d, Granularity:%d begin...\r\n", StartAddr, EndAddr, Granularity);
+	uint32_t StartTime = HAL_GetTick();
+#endif
+	Count = (EndAddr - StartAddr) / Granularity;
+	Step = (Granularity < w25qxx.SectorSize) ? w25qxx.SectorSize / Granularity : 1;
+	Probe = (Granularity < W25QXX_FRONTIER_PROBE) ? Granularity : W25QXX_FRONTIER_PROBE;
+	// sector steps, then the granules of the last used sector
+	Unit = W25qxx_FrontierSearch(StartAddr, Step * Granularity, (Count + Step - 1) / Step, Probe);
+	Frontier = 0;
+	if (Unit > 0)
+	{
+		Unit--;
+		Frontier = Unit * Step + W25qxx_FrontierSearch(StartAddr + Unit * Step * Granularity, Granularity, ((Count - Unit * Step) < Step) ? (Count - Unit * Step) : Step, Probe);
+	}
+	Frontier = StartAddr + Frontier * Granularity;
+	// a probe only sees the first bytes of a granule, the area after the frontier must be blank as a whole
+	Verify = StartAddr + Count * Granularity - Frontier;
+	if (Verify > Step * Granularity)
+		Verify = Step * Granularity;
+	if ((Verify > 0) && W25qxx_FrontierUsed(Frontier, Verify))
+		Frontier = W25qxx_FrontierScanRaw(StartAddr, StartAddr + Count * Granularity, Granularity);
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx FindFrontier at %d after %d ms\r\n", Frontier, HAL_GetTick() - StartTime);
 #endif
 	w25qxx.Lock = 0;
-	return true;
-NOT_EMPTY:
+	return Frontier;
+}
+//###################################################################################################################
+uint32_t W25qxx_FindFrontierScan(uint32_t StartAddr, uint32_t EndAddr, uint32_t Granularity)
+{
+	uint32_t Frontier;
+	if (EndAddr > w25qxx.SectorCount * w25qxx.SectorSize)
+		EndAddr = w25qxx.SectorCount * w25qxx.SectorSize;
+	if (EndAddr <= StartAddr)
+		return StartAddr;
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+	if (Granularity == 0)
+		Granularity = w25qxx.PageSize;
 #if (_W25QXX_DEBUG == 1)
-	printf("w25qxx CheckSector is Not Empty in %d ms\r\n", HAL_GetTick() - StartTime);
-	W25qxx_Delay(100);
+	printf("w25qxx FindFrontierScan %d..%d, Granularity:%d begin...\r\n", StartAddr, EndAddr, Granularity);
+	uint32_t StartTime = HAL_GetTick();
+#endif
+	Frontier = W25qxx_FrontierScanRaw(StartAddr, StartAddr + ((EndAddr - StartAddr) / Granularity) * Granularity, Granularity);
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx FindFrontierScan at %d after %d ms\r\n", Frontier, HAL_GetTick() - StartTime);
 #endif
 	w25qxx.Lock = 0;
-	return false;
+	return Frontier;
 }
 //###################################################################################################################
-bool W25qxx_IsEmptyBlock(uint32_t Block_Address, uint32_t OffsetInByte, uint32_t NumByteToCheck_up_to_BlockSize)
+#if (_W25QXX_USE_SECTOR_MAP == 1)
+W25QXX_Sector_t W25qxx_SectorMapGet(uint32_t Sector_Address)
+{
+	return W25qxx_MapGet(Sector_Address);
+}
+//###################################################################################################################
+void W25qxx_SectorMapInvalidate(void)
 {
 	while (w25qxx.Lock == 1)
 		W25qxx_Delay(1);
 	w25qxx.Lock = 1;
-	if ((NumByteToCheck_up_to_BlockSize > w25qxx.BlockSize) || (NumByteToCheck_up_to_BlockSize == 0))
-		NumByteToCheck_up_to_BlockSize = w25qxx.BlockSize;
+	memset(w25qxx.SectorMap, 0, sizeof(w25qxx.SectorMap));
+	w25qxx.Lock = 0;
+}
+//###################################################################################################################
+void W25qxx_SectorMapRebuild(bool OnlyUnknown)
+{
+	uint32_t Sector;
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
 #if (_W25QXX_DEBUG == 1)
-	printf("w25qxx CheckBlock:%d, Offset:%d, Bytes:%d begin...\r\n", Block_Address, OffsetInByte, NumByteToCheck_up_to_BlockSize);
-	W25qxx_Delay(100);
 	uint32_t StartTime = HAL_GetTick();
+	printf("w25qxx SectorMapRebuild begin...\r\n");
 #endif
-	uint8_t pBuffer[32];
-	uint32_t WorkAddress;
-	uint32_t i;
-	for (i = OffsetInByte; i < w25qxx.BlockSize; i += sizeof(pBuffer))
+	for (Sector = 0; (Sector < w25qxx.SectorCount) && (Sector < _W25QXX_SECTOR_MAP_SECTORS); Sector++)
 	{
-		HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-		WorkAddress = (i + Block_Address * w25qxx.BlockSize);
-
-		if (w25qxx.ID >= W25Q256)
-		{
-			W25qxx_Spi(0x0C);
-			W25qxx_Spi((WorkAddress & 0xFF000000) >> 24);
-		}
+		if ((OnlyUnknown == true) && (W25qxx_MapGet(Sector) != W25QXX_SECTOR_UNKNOWN))
+			continue;
+		if (W25qxx_IsBlankRaw(Sector * w25qxx.SectorSize, w25qxx.SectorSize))
+			W25qxx_MapSet(Sector, W25QXX_SECTOR_ERASED);
 		else
-		{
-			W25qxx_Spi(0x0B);
-		}
-		W25qxx_Spi((WorkAddress & 0xFF0000) >> 16);
-		W25qxx_Spi((WorkAddress & 0xFF00) >> 8);
-		W25qxx_Spi(WorkAddress & 0xFF);
-		W25qxx_Spi(0);
-		HAL_SPI_Receive(&_W25QXX_SPI, pBuffer, sizeof(pBuffer), 100);
-		HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-		for (uint8_t x = 0; x < sizeof(pBuffer); x++)
-		{
-			if (pBuffer[x] != 0xFF)
-				goto NOT_EMPTY;
-		}
+			W25qxx_MapSet(Sector, W25QXX_SECTOR_PROGRAMMED);
+	}
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx SectorMapRebuild done after %d ms\r\n", HAL_GetTick() - StartTime);
+#endif
+	w25qxx.Lock = 0;
+}
+#endif
+//###################################################################################################################
+#if (_W25QXX_USE_HEALTH == 1)
+bool W25qxx_HealthInit(W25QXX_Health_t *Health, W25QXX_HealthEntry_t *Entry, uint32_t Count)
+{
+	if ((Count == 0) || (Count > w25qxx.SectorCount) || ((w25qxx.SectorCount % Count) != 0))
+		return false;
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+	memset(Health, 0, sizeof(W25QXX_Health_t));
+	memset(Entry, 0, Count * sizeof(W25QXX_HealthEntry_t));
+	Health->Entry = Entry;
+	Health->Count = Count;
+	Health->Sectors = w25qxx.SectorCount / Count;
+	w25qxx.Health = Health;
+	w25qxx.Lock = 0;
+	return true;
+}
+//###################################################################################################################
+bool W25qxx_HealthGet(uint32_t Sector_Address, W25QXX_HealthEntry_t *Entry)
+{
+	if ((w25qxx.Health == NULL) || (Sector_Address >= w25qxx.SectorCount))
+		return false;
+	*Entry = w25qxx.Health->Entry[Sector_Address / w25qxx.Health->Sectors];
+	return true;
+}
+//###################################################################################################################
+uint32_t W25qxx_HealthDegrading(uint32_t *Sectors, uint32_t MaxSectors, uint16_t EraseLimitMs)
+{
+	W25QXX_HealthEntry_t *Entry;
+	uint32_t Found = 0;
+	if (w25qxx.Health == NULL)
+		return 0;
+	for (uint32_t i = 0; (i < w25qxx.Health->Count) && (Found < MaxSectors); i++)
+	{
+		Entry = &w25qxx.Health->Entry[i];
+		if ((Entry->EraseLast >= EraseLimitMs) || (Entry->EraseFails > 0) || (Entry->ProgramFails > 0))
+			Sectors[Found++] = i * w25qxx.Health->Sectors;
+	}
+	return Found;
+}
+//###################################################################################################################
+bool W25qxx_HealthSave(uint32_t Sector_Address, uint32_t SectorCount)
+{
+	W25QXX_Health_t *Health = w25qxx.Health;
+	W25QXX_HealthHeader_t Header;
+	uint32_t Size, CopySectors, Address, Offset, Chunk, Crc = 0;
+	uint8_t *pData;
+	if (Health == NULL)
+		return false;
+	Size = Health->Count * sizeof(W25QXX_HealthEntry_t);
+	CopySectors = (sizeof(Header) + Size + w25qxx.SectorSize - 1) / w25qxx.SectorSize;
+	if ((SectorCount < 2 * CopySectors) || (Sector_Address + 2 * CopySectors > w25qxx.SectorCount))
+		return false;
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+#if (_W25QXX_DEBUG == 1)
+	uint32_t StartTime = HAL_GetTick();
+	printf("w25qxx HealthSave at Sector:%d begin...\r\n", Sector_Address);
+#endif
+	// over the older copy, a power loss during the save leaves the newer one
+	Address = (Sector_Address + ((Health->Sequence + 1) & 1) * CopySectors) * w25qxx.SectorSize;
+	for (uint32_t i = 0; i < CopySectors; i++)
+		W25qxx_EraseRaw(0x20, 0x21, Address + i * w25qxx.SectorSize);
+	pData = (uint8_t *)Health->Entry;
+	Offset = sizeof(Header);
+	while (Size > 0)
+	{
+		Chunk = w25qxx.PageSize - (Offset % w25qxx.PageSize);
+		if (Chunk > Size)
+			Chunk = Size;
+		// the table changes while it is saved (the erases above), the crc covers what was programmed
+		Crc = W25qxx_HealthCrc(Crc, pData, Chunk);
+		W25qxx_ProgramRaw(pData, Address + Offset, Chunk);
+		pData += Chunk;
+		Offset += Chunk;
+		Size -= Chunk;
+	}
+	// the header goes last, it makes the copy valid
+	Header.Magic = W25QXX_HEALTH_MAGIC;
+	Header.Sequence = Health->Sequence + 1;
+	Header.Count = Health->Count;
+	Header.Crc = Crc;
+	W25qxx_ProgramRaw((uint8_t *)&Header, Address, sizeof(Header));
+	Health->Sequence++;
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx HealthSave done after %d ms\r\n", HAL_GetTick() - StartTime);
+#endif
+	w25qxx.Lock = 0;
+	return true;
+}
+//###################################################################################################################
+bool W25qxx_HealthLoad(uint32_t Sector_Address, uint32_t SectorCount)
+{
+	W25QXX_Health_t *Health = w25qxx.Health;
+	W25QXX_HealthHeader_t Header[2];
+	uint32_t Size, CopySectors, Copy;
+	bool Loaded = false;
+	if (Health == NULL)
+		return false;
+	Size = Health->Count * sizeof(W25QXX_HealthEntry_t);
+	CopySectors = (sizeof(Header[0]) + Size + w25qxx.SectorSize - 1) / w25qxx.SectorSize;
+	if ((SectorCount < 2 * CopySectors) || (Sector_Address + 2 * CopySectors > w25qxx.SectorCount))
+		return false;
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+	for (Copy = 0; Copy < 2; Copy++)
+	{
+		W25qxx_ReadRaw((uint8_t *)&Header[Copy], (Sector_Address + Copy * CopySectors) * w25qxx.SectorSize, sizeof(Header[0]));
+		if ((Header[Copy].Magic != W25QXX_HEALTH_MAGIC) || (Header[Copy].Count != Health->Count))
+			Header[Copy].Magic = 0;
 	}
-	if ((w25qxx.BlockSize + OffsetInByte) % sizeof(pBuffer) != 0)
+	// newest first, the other one if its crc does not match
+	Copy = ((Header[1].Magic != 0) && ((Header[0].Magic == 0) || ((int32_t)(Header[1].Sequence - Header[0].Sequence) > 0))) ? 1 : 0;
+	for (uint8_t Try = 0; (Try < 2) && (Loaded == false); Try++, Copy ^= 1)
 	{
-		i -= sizeof(pBuffer);
-		for (; i < w25qxx.BlockSize; i++)
+		if (Header[Copy].Magic == 0)
+			continue;
+		W25qxx_ReadRaw((uint8_t *)Health->Entry, (Sector_Address + Copy * CopySectors) * w25qxx.SectorSize + sizeof(Header[0]), Size);
+		if (W25qxx_HealthCrc(0, (uint8_t *)Health->Entry, Size) == Header[Copy].Crc)
 		{
-			HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-			WorkAddress = (i + Block_Address * w25qxx.BlockSize);
-
-			if (w25qxx.ID >= W25Q256)
-			{
-				W25qxx_Spi(0x0C);
-				W25qxx_Spi((WorkAddress & 0xFF000000) >> 24);
-			}
-			else
-			{
-				W25qxx_Spi(0x0B);
-			}
-			W25qxx_Spi((WorkAddress & 0xFF0000) >> 16);
-			W25qxx_Spi((WorkAddress & 0xFF00) >> 8);
-			W25qxx_Spi(WorkAddress & 0xFF);
-			W25qxx_Spi(0);
-			HAL_SPI_Receive(&_W25QXX_SPI, pBuffer, 1, 100);
-			HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-			if (pBuffer[0] != 0xFF)
-				goto NOT_EMPTY;
+			Health->Sequence = Header[Copy].Sequence;
+			Loaded = true;
 		}
 	}
+	if (Loaded == false)
+		memset(Health->Entry, 0, Size);
+	w25qxx.Lock = 0;
+	return Loaded;
+}
+#endif
+//###################################################################################################################
+void W25qxx_WriteByte(uint8_t pBuffer, uint32_t WriteAddr_inBytes)
+{
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
 #if (_W25QXX_DEBUG == 1)
-	printf("w25qxx CheckBlock is Empty in %d ms\r\n", HAL_GetTick() - StartTime);
-	W25qxx_Delay(100);
+	uint32_t StartTime = HAL_GetTick();
+	printf("w25qxx WriteByte 0x%02X at address %d begin...", pBuffer, WriteAddr_inBytes);
+#endif
+#if (_W25QXX_USE_WRITE_BUFFER == 1)
+	W25qxx_BufferWrite(&pBuffer, WriteAddr_inBytes, 1);
+#else
+	W25qxx_ProgramRaw(&pBuffer, WriteAddr_inBytes, 1);
+#endif
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx WriteByte done after %d ms\r\n", HAL_GetTick() - StartTime);
 #endif
 	w25qxx.Lock = 0;
-	return true;
-NOT_EMPTY:
+}
+//###################################################################################################################
+void W25qxx_WriteBytes(uint8_t *pBuffer, uint32_t WriteAddr, uint32_t NumByteToWrite)
+{
+	uint32_t Chunk;
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
 #if (_W25QXX_DEBUG == 1)
-	printf("w25qxx CheckBlock is Not Empty in %d ms\r\n", HAL_GetTick() - StartTime);
-	W25qxx_Delay(100);
+	uint32_t StartTime = HAL_GetTick();
+	printf("w25qxx WriteBytes at Address:%d, %d Bytes begin...\r\n", WriteAddr, NumByteToWrite);
+#endif
+	while (NumByteToWrite > 0)
+	{
+		Chunk = w25qxx.PageSize - (WriteAddr % w25qxx.PageSize);
+		if (Chunk > NumByteToWrite)
+			Chunk = NumByteToWrite;
+#if (_W25QXX_USE_WRITE_BUFFER == 1)
+		if (Chunk < w25qxx.PageSize)
+			W25qxx_BufferWrite(pBuffer, WriteAddr, Chunk);
+		else
+#endif
+			W25qxx_ProgramRaw(pBuffer, WriteAddr, Chunk);
+		pBuffer += Chunk;
+		WriteAddr += Chunk;
+		NumByteToWrite -= Chunk;
+	}
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx WriteBytes done after %d ms\r\n", HAL_GetTick() - StartTime);
 #endif
 	w25qxx.Lock = 0;
-	return false;
 }
 //###################################################################################################################
-void W25qxx_WriteByte(uint8_t pBuffer, uint32_t WriteAddr_inBytes)
+void W25qxx_WriteFlush(void)
 {
 	while (w25qxx.Lock == 1)
 		W25qxx_Delay(1);
 	w25qxx.Lock = 1;
-#if (_W25QXX_DEBUG == 1)
-	uint32_t StartTime = HAL_GetTick();
-	printf("w25qxx WriteByte 0x%02X at address %d begin...", pBuffer, WriteAddr_inBytes);
-#endif
-	W25qxx_WaitForWriteEnd();
-	W25qxx_WriteEnable();
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-
-	if (w25qxx.ID >= W25Q256)
-	{
-		W25qxx_Spi(0x12);
-		W25qxx_Spi((WriteAddr_inBytes & 0xFF000000) >> 24);
-	}
-	else
-	{
-		W25qxx_Spi(0x02);
-	}
-	W25qxx_Spi((WriteAddr_inBytes & 0xFF0000) >> 16);
-	W25qxx_Spi((WriteAddr_inBytes & 0xFF00) >> 8);
-	W25qxx_Spi(WriteAddr_inBytes & 0xFF);
-	W25qxx_Spi(pBuffer);
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-	W25qxx_WaitForWriteEnd();
-#if (_W25QXX_DEBUG == 1)
-	printf("w25qxx WriteByte done after %d ms\r\n", HAL_GetTick() - StartTime);
-#endif
+	W25qxx_BufferFlush();
+	w25qxx.Lock = 0;
+}
+//###################################################################################################################
+#if (_W25QXX_USE_WRITE_BUFFER == 1)
+void W25qxx_WriteBufferPoll(void)
+{
+	if (w25qxx.WriteBuffer.Valid == 0)
+		return;
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+	if ((w25qxx.WriteBuffer.Valid == 1) && (HAL_GetTick() - w25qxx.WriteBuffer.Tick >= _W25QXX_WRITE_BUFFER_TIMEOUT))
+		W25qxx_BufferFlush();
 	w25qxx.Lock = 0;
 }
+#endif
 //###################################################################################################################
 void W25qxx_WritePage(uint8_t *pBuffer, uint32_t Page_Address, uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_PageSize)
 {
@@ -655,25 +1659,8 @@ void W25qxx_WritePage(uint8_t *pBuffer, uint32_t Page_Address, uint32_t OffsetIn
 	W25qxx_Delay(100);
 	uint32_t StartTime = HAL_GetTick();
 #endif
-	W25qxx_WaitForWriteEnd();
-	W25qxx_WriteEnable();
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
 	Page_Address = (Page_Address * w25qxx.PageSize) + OffsetInByte;
-	if (w25qxx.ID >= W25Q256)
-	{
-		W25qxx_Spi(0x12);
-		W25qxx_Spi((Page_Address & 0xFF000000) >> 24);
-	}
-	else
-	{
-		W25qxx_Spi(0x02);
-	}
-	W25qxx_Spi((Page_Address & 0xFF0000) >> 16);
-	W25qxx_Spi((Page_Address & 0xFF00) >> 8);
-	W25qxx_Spi(Page_Address & 0xFF);
-	HAL_SPI_Transmit(&_W25QXX_SPI, pBuffer, NumByteToWrite_up_to_PageSize, 100);
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-	W25qxx_WaitForWriteEnd();
+	W25qxx_ProgramRaw(pBuffer, Page_Address, NumByteToWrite_up_to_PageSize);
 #if (_W25QXX_DEBUG == 1)
 	StartTime = HAL_GetTick() - StartTime;
 	for (uint32_t i = 0; i < NumByteToWrite_up_to_PageSize; i++)
@@ -771,32 +1758,221 @@ void W25qxx_WriteBlock(uint8_t *pBuffer, uint32_t Block_Address, uint32_t Offset
 #endif
 }
 //###################################################################################################################
-void W25qxx_ReadByte(uint8_t *pBuffer, uint32_t Bytes_Address)
+#if (_W25QXX_USE_SMART_WRITE == 1)
+static uint8_t W25qxx_SectorBuffer[0x1000];
+//###################################################################################################################
+// Sector_Address in bytes, [OffsetInByte, OffsetInByte + NumByteToWrite) must stay inside the sector
+static W25QXX_SmartWrite_t W25qxx_SmartWriteSector(uint8_t *pBuffer, uint32_t Sector_Address, uint32_t OffsetInByte, uint32_t NumByteToWrite)
 {
+	uint8_t *pOld = &W25qxx_SectorBuffer[OffsetInByte];
+	uint32_t DirtyPages = 0;
+	uint32_t i, Page, Start, End;
+	bool NeedErase = false;
+#if (_W25QXX_USE_SECTOR_MAP == 1)
+	if (W25qxx_MapGet(Sector_Address / w25qxx.SectorSize) == W25QXX_SECTOR_ERASED)
+		memset(pOld, 0xFF, NumByteToWrite);
+	else
+#endif
+		W25qxx_ReadRaw(pOld, Sector_Address + OffsetInByte, NumByteToWrite);
+	for (i = 0; i < NumByteToWrite; i++)
+	{
+		if (pOld[i] == pBuffer[i])
+			continue;
+		if ((pBuffer[i] & ~pOld[i]) != 0)
+		{
+			NeedErase = true;
+			break;
+		}
+		DirtyPages |= 1UL << ((OffsetInByte + i) / w25qxx.PageSize);
+	}
+	if (NeedErase == false)
+	{
+		if (DirtyPages == 0)
+			return W25QXX_SMART_UNCHANGED;
+		for (Page = 0; Page < w25qxx.SectorSize / w25qxx.PageSize; Page++)
+		{
+			if ((DirtyPages & (1UL << Page)) == 0)
+				continue;
+			Start = Page * w25qxx.PageSize;
+			End = Start + w25qxx.PageSize;
+			if (Start < OffsetInByte)
+				Start = OffsetInByte;
+			if (End > OffsetInByte + NumByteToWrite)
+				End = OffsetInByte + NumByteToWrite;
+			W25qxx_ProgramRaw(&pBuffer[Start - OffsetInByte], Sector_Address + Start, End - Start);
+		}
+		return W25QXX_SMART_PROGRAMMED;
+	}
+	// some bit has to go 0->1, keep the rest of the sector and rewrite it after erase
+	if (OffsetInByte > 0)
+		W25qxx_ReadRaw(W25qxx_SectorBuffer, Sector_Address, OffsetInByte);
+	if (OffsetInByte + NumByteToWrite < w25qxx.SectorSize)
+		W25qxx_ReadRaw(&W25qxx_SectorBuffer[OffsetInByte + NumByteToWrite], Sector_Address + OffsetInByte + NumByteToWrite, w25qxx.SectorSize - OffsetInByte - NumByteToWrite);
+	memcpy(pOld, pBuffer, NumByteToWrite);
+	W25qxx_EraseRaw(0x20, 0x21, Sector_Address);
+	for (Start = 0; Start < w25qxx.SectorSize; Start += w25qxx.PageSize)
+	{
+		for (i = 0; i < w25qxx.PageSize; i++)
+		{
+			if (W25qxx_SectorBuffer[Start + i] != 0xFF)
+			{
+				W25qxx_ProgramRaw(&W25qxx_SectorBuffer[Start], Sector_Address + Start, w25qxx.PageSize);
+				break;
+			}
+		}
+	}
+	return W25QXX_SMART_ERASED;
+}
+//###################################################################################################################
+static W25QXX_SmartWrite_t W25qxx_SmartWriteRange(uint8_t *pBuffer, uint32_t WriteAddr, uint32_t NumByteToWrite, W25QXX_DiffStats_t *Stats)
+{
+	W25QXX_SmartWrite_t Result = W25QXX_SMART_UNCHANGED;
+	W25QXX_SmartWrite_t SectorResult;
+	uint32_t Sector_Address, OffsetInByte, BytesToWrite;
+	while (NumByteToWrite > 0)
+	{
+		OffsetInByte = WriteAddr % w25qxx.SectorSize;
+		Sector_Address = WriteAddr - OffsetInByte;
+		BytesToWrite = w25qxx.SectorSize - OffsetInByte;
+		if (BytesToWrite > NumByteToWrite)
+			BytesToWrite = NumByteToWrite;
+		SectorResult = W25qxx_SmartWriteSector(pBuffer, Sector_Address, OffsetInByte, BytesToWrite);
+		if (SectorResult > Result)
+			Result = SectorResult;
+		if (Stats != NULL)
+		{
+			if (SectorResult == W25QXX_SMART_UNCHANGED)
+				Stats->SectorsSkipped++;
+			else if (SectorResult == W25QXX_SMART_PROGRAMMED)
+				Stats->SectorsProgrammed++;
+			else
+				Stats->SectorsErased++;
+		}
+		pBuffer += BytesToWrite;
+		WriteAddr += BytesToWrite;
+		NumByteToWrite -= BytesToWrite;
+	}
+	return Result;
+}
+//###################################################################################################################
+W25QXX_SmartWrite_t W25qxx_SmartWrite(uint8_t *pBuffer, uint32_t WriteAddr, uint32_t NumByteToWrite)
+{
+	W25QXX_SmartWrite_t Result;
 	while (w25qxx.Lock == 1)
 		W25qxx_Delay(1);
 	w25qxx.Lock = 1;
 #if (_W25QXX_DEBUG == 1)
 	uint32_t StartTime = HAL_GetTick();
-	printf("w25qxx ReadByte at address %d begin...\r\n", Bytes_Address);
+	printf("w25qxx SmartWrite at Address:%d, %d Bytes begin...\r\n", WriteAddr, NumByteToWrite);
 #endif
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-
-	if (w25qxx.ID >= W25Q256)
+	Result = W25qxx_SmartWriteRange(pBuffer, WriteAddr, NumByteToWrite, NULL);
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx SmartWrite done (%d) after %d ms\r\n", Result, HAL_GetTick() - StartTime);
+#endif
+	W25qxx_Delay(1);
+	w25qxx.Lock = 0;
+	return Result;
+}
+//###################################################################################################################
+void W25qxx_WriteDiff(uint8_t *pBuffer, uint32_t WriteAddr, uint32_t NumByteToWrite, W25QXX_DiffStats_t *Stats)
+{
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+#if (_W25QXX_DEBUG == 1)
+	uint32_t StartTime = HAL_GetTick();
+	printf("w25qxx WriteDiff at Address:%d, %d Bytes begin...\r\n", WriteAddr, NumByteToWrite);
+#endif
+	W25qxx_SmartWriteRange(pBuffer, WriteAddr, NumByteToWrite, Stats);
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx WriteDiff done after %d ms\r\n", HAL_GetTick() - StartTime);
+#endif
+	W25qxx_Delay(1);
+	w25qxx.Lock = 0;
+}
+//###################################################################################################################
+void W25qxx_WriteBlockDiff(uint8_t *pBuffer, uint32_t Block_Address, uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_BlockSize, W25QXX_DiffStats_t *Stats)
+{
+	if ((NumByteToWrite_up_to_BlockSize > w25qxx.BlockSize) || (NumByteToWrite_up_to_BlockSize == 0))
+		NumByteToWrite_up_to_BlockSize = w25qxx.BlockSize;
+	if (OffsetInByte >= w25qxx.BlockSize)
 	{
-		W25qxx_Spi(0x0C);
-		W25qxx_Spi((Bytes_Address & 0xFF000000) >> 24);
+#if (_W25QXX_DEBUG == 1)
+		printf("---w25qxx WriteBlockDiff Faild!\r\n");
+		W25qxx_Delay(100);
+#endif
+		return;
 	}
-	else
+	if ((OffsetInByte + NumByteToWrite_up_to_BlockSize) > w25qxx.BlockSize)
+		NumByteToWrite_up_to_BlockSize = w25qxx.BlockSize - OffsetInByte;
+	W25qxx_WriteDiff(pBuffer, Block_Address * w25qxx.BlockSize + OffsetInByte, NumByteToWrite_up_to_BlockSize, Stats);
+}
+#endif
+//###################################################################################################################
+// polls with CS held low, no delays, used where the next page is already waiting
+static void W25qxx_WaitBusySpin(void)
+{
+	W25qxx_SuspendRaw();
+	if (w25qxx.Busy == 0)
+		return;
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_RESET);
+	W25qxx_Spi(0x05);
+	do
+	{
+		w25qxx.StatusRegister1 = W25qxx_Spi(W25QXX_DUMMY_BYTE);
+		if ((w25qxx.StatusRegister1 & 0x01) == 0x01)
+			W25qxx_OpBusy();
+	} while ((w25qxx.StatusRegister1 & 0x01) == 0x01);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
+	W25qxx_OpDone();
+	w25qxx.Busy = 0;
+}
+//###################################################################################################################
+uint32_t W25qxx_WritePipeline(uint32_t Page_Address, uint32_t PageCount, W25qxx_PageProducer_t Producer, void *Context, uint8_t *pWork)
+{
+	uint8_t *pPage[2] = {pWork, pWork + w25qxx.PageSize};
+	uint32_t Done = 0;
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+#if (_W25QXX_DEBUG == 1)
+	uint32_t StartTime = HAL_GetTick();
+	printf("w25qxx WritePipeline at Page:%d, %d Pages begin...\r\n", Page_Address, PageCount);
+#endif
+	if ((PageCount > 0) && (Producer(pPage[0], 0, Context) == true))
 	{
-		W25qxx_Spi(0x0B);
+		while (Done < PageCount)
+		{
+			W25qxx_WaitBusySpin();
+			W25qxx_ProgramStartRaw(pPage[Done & 1], (Page_Address + Done) * w25qxx.PageSize, w25qxx.PageSize);
+			Done++;
+			// prepare the next page while the chip programs this one
+			if ((Done == PageCount) || (Producer(pPage[Done & 1], Done, Context) == false))
+				break;
+		}
+		W25qxx_WaitBusySpin();
 	}
-	W25qxx_Spi((Bytes_Address & 0xFF0000) >> 16);
-	W25qxx_Spi((Bytes_Address & 0xFF00) >> 8);
-	W25qxx_Spi(Bytes_Address & 0xFF);
-	W25qxx_Spi(0);
-	*pBuffer = W25qxx_Spi(W25QXX_DUMMY_BYTE);
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx WritePipeline %d Pages done after %d ms\r\n", Done, HAL_GetTick() - StartTime);
+#endif
+	w25qxx.Lock = 0;
+	return Done;
+}
+//###################################################################################################################
+void W25qxx_ReadByte(uint8_t *pBuffer, uint32_t Bytes_Address)
+{
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+#if (_W25QXX_DEBUG == 1)
+	uint32_t StartTime = HAL_GetTick();
+	printf("w25qxx ReadByte at address %d begin...\r\n", Bytes_Address);
+#endif
+#if (_W25QXX_READ_CACHE_SLOTS > 0)
+	W25qxx_CacheRead(pBuffer, Bytes_Address, 1);
+#else
+	W25qxx_ReadRaw(pBuffer, Bytes_Address, 1);
+#endif
 #if (_W25QXX_DEBUG == 1)
 	printf("w25qxx ReadByte 0x%02X done after %d ms\r\n", *pBuffer, HAL_GetTick() - StartTime);
 #endif
@@ -812,23 +1988,15 @@ void W25qxx_ReadBytes(uint8_t *pBuffer, uint32_t ReadAddr, uint32_t NumByteToRea
 	uint32_t StartTime = HAL_GetTick();
 	printf("w25qxx ReadBytes at Address:%d, %d Bytes  begin...\r\n", ReadAddr, NumByteToRead);
 #endif
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-
-	if (w25qxx.ID >= W25Q256)
-	{
-		W25qxx_Spi(0x0C);
-		W25qxx_Spi((ReadAddr & 0xFF000000) >> 24);
-	}
-	else
+#if (_W25QXX_READ_CACHE_SLOTS > 0)
+	if ((NumByteToRead <= w25qxx.PageSize) && (W25qxx_CacheRead(pBuffer, ReadAddr, NumByteToRead) == true))
 	{
-		W25qxx_Spi(0x0B);
+		w25qxx.Lock = 0;
+		return;
 	}
-	W25qxx_Spi((ReadAddr & 0xFF0000) >> 16);
-	W25qxx_Spi((ReadAddr & 0xFF00) >> 8);
-	W25qxx_Spi(ReadAddr & 0xFF);
-	W25qxx_Spi(0);
-	HAL_SPI_Receive(&_W25QXX_SPI, pBuffer, NumByteToRead, 2000);
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+	if (NumByteToRead > w25qxx.PageSize)
+#endif
+		W25qxx_ReadRaw(pBuffer, ReadAddr, NumByteToRead);
 #if (_W25QXX_DEBUG == 1)
 	StartTime = HAL_GetTick() - StartTime;
 	for (uint32_t i = 0; i < NumByteToRead; i++)
@@ -863,22 +2031,15 @@ void W25qxx_ReadPage(uint8_t *pBuffer, uint32_t Page_Address, uint32_t OffsetInB
 	uint32_t StartTime = HAL_GetTick();
 #endif
 	Page_Address = Page_Address * w25qxx.PageSize + OffsetInByte;
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-	if (w25qxx.ID >= W25Q256)
-	{
-		W25qxx_Spi(0x0C);
-		W25qxx_Spi((Page_Address & 0xFF000000) >> 24);
-	}
-	else
+#if (_W25QXX_READ_CACHE_SLOTS > 0)
+	if (W25qxx_CacheRead(pBuffer, Page_Address, NumByteToRead_up_to_PageSize) == true)
 	{
-		W25qxx_Spi(0x0B);
+		w25qxx.Lock = 0;
+		return;
 	}
-	W25qxx_Spi((Page_Address & 0xFF0000) >> 16);
-	W25qxx_Spi((Page_Address & 0xFF00) >> 8);
-	W25qxx_Spi(Page_Address & 0xFF);
-	W25qxx_Spi(0);
-	HAL_SPI_Receive(&_W25QXX_SPI, pBuffer, NumByteToRead_up_to_PageSize, 100);
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+#else
+	W25qxx_ReadRaw(pBuffer, Page_Address, NumByteToRead_up_to_PageSize);
+#endif
 #if (_W25QXX_DEBUG == 1)
 	StartTime = HAL_GetTick() - StartTime;
 	for (uint32_t i = 0; i < NumByteToRead_up_to_PageSize; i++)
@@ -976,3 +2137,311 @@ void W25qxx_ReadBlock(uint8_t *pBuffer, uint32_t Block_Address, uint32_t OffsetI
 #endif
 }
 //###################################################################################################################
+void W25qxx_ReadV(uint32_t ReadAddr, const W25QXX_IoVec_t *Iov, uint32_t IovCount)
+{
+	uint32_t Total = 0;
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+#if (_W25QXX_DEBUG == 1)
+	uint32_t StartTime = HAL_GetTick();
+	printf("w25qxx ReadV at Address:%d, %d Segments begin...\r\n", ReadAddr, IovCount);
+#endif
+	W25qxx_BufferFlush();
+	for (uint32_t i = 0; i < IovCount; i++)
+		Total += Iov[i].Length;
+	if (W25qxx_DiePart(ReadAddr, Total) < Total)
+	{
+		// crosses into the next die, one read per segment
+		for (uint32_t i = 0; i < IovCount; i++)
+		{
+			W25qxx_ReadRaw(Iov[i].Buffer, ReadAddr, Iov[i].Length);
+			ReadAddr += Iov[i].Length;
+		}
+	}
+	else
+	{
+		W25qxx_DieSelect(ReadAddr);
+		W25qxx_WaitBusy();
+		HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_RESET);
+		W25qxx_SendCmdAddr(0x0B, 0x0C, ReadAddr, 1);
+		for (uint32_t i = 0; i < IovCount; i++)
+			W25qxx_Receive(Iov[i].Buffer, Iov[i].Length);
+		HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
+	}
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx ReadV done after %d ms\r\n", HAL_GetTick() - StartTime);
+#endif
+	w25qxx.Lock = 0;
+}
+//###################################################################################################################
+void W25qxx_WriteV(uint32_t WriteAddr, const W25QXX_IoVec_t *Iov, uint32_t IovCount)
+{
+	uint32_t Segment = 0;
+	uint32_t SegmentOffset = 0;
+	uint32_t PageLeft, Chunk, ChunkAddr, FirstSegment, FirstOffset;
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+#if (_W25QXX_DEBUG == 1)
+	uint32_t StartTime = HAL_GetTick();
+	printf("w25qxx WriteV at Address:%d, %d Segments begin...\r\n", WriteAddr, IovCount);
+#endif
+	W25qxx_BufferFlush();
+	while ((Segment < IovCount) && (Iov[Segment].Length == 0))
+		Segment++;
+	while (Segment < IovCount)
+	{
+		// one Page Program per page, the segments are clocked out back to back
+		W25qxx_DieSelect(WriteAddr);
+		W25qxx_WaitBusy();
+		W25qxx_WriteEnableNoDelay();
+		HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_RESET);
+		W25qxx_SendCmdAddr(0x02, 0x12, WriteAddr, 0);
+		PageLeft = w25qxx.PageSize - (WriteAddr % w25qxx.PageSize);
+		ChunkAddr = WriteAddr;
+		FirstSegment = Segment;
+		FirstOffset = SegmentOffset;
+		while ((PageLeft > 0) && (Segment < IovCount))
+		{
+			Chunk = Iov[Segment].Length - SegmentOffset;
+			if (Chunk > PageLeft)
+				Chunk = PageLeft;
+			HAL_SPI_Transmit(w25qxx.Spi, &Iov[Segment].Buffer[SegmentOffset], Chunk, 100);
+			PageLeft -= Chunk;
+			WriteAddr += Chunk;
+			SegmentOffset += Chunk;
+			if (SegmentOffset == Iov[Segment].Length)
+			{
+				Segment++;
+				SegmentOffset = 0;
+				while ((Segment < IovCount) && (Iov[Segment].Length == 0))
+					Segment++;
+			}
+		}
+		HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
+		w25qxx.Busy = 1;
+		W25qxx_OpStart(1, ChunkAddr, WriteAddr - ChunkAddr);
+		W25qxx_WaitBusy();
+		// walk the same pieces again to update the driver state
+		while (ChunkAddr < WriteAddr)
+		{
+			Chunk = Iov[FirstSegment].Length - FirstOffset;
+			if (Chunk > WriteAddr - ChunkAddr)
+				Chunk = WriteAddr - ChunkAddr;
+			W25qxx_Programmed(&Iov[FirstSegment].Buffer[FirstOffset], ChunkAddr, Chunk);
+			ChunkAddr += Chunk;
+			FirstSegment++;
+			FirstOffset = 0;
+		}
+	}
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx WriteV done after %d ms\r\n", HAL_GetTick() - StartTime);
+#endif
+	W25qxx_Delay(1);
+	w25qxx.Lock = 0;
+}
+//###################################################################################################################
+static void W25qxx_StreamStart(W25qxx_Stream_t *Stream)
+{
+	W25qxx_BufferFlush();
+	W25qxx_DieSelect(Stream->ChipAddress);
+	W25qxx_WaitBusy();
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_RESET);
+	W25qxx_SendCmdAddr(0x0B, 0x0C, Stream->ChipAddress, 1);
+	Stream->Headers++;
+}
+//###################################################################################################################
+static void W25qxx_StreamWait(W25qxx_Stream_t *Stream)
+{
+#if (_W25QXX_USE_DMA == 1)
+	if (Stream->Filling != 0)
+	{
+		while (HAL_SPI_GetState(w25qxx.Spi) != HAL_SPI_STATE_READY)
+			;
+		Stream->Filling = 0;
+	}
+#else
+	(void)Stream;
+#endif
+}
+//###################################################################################################################
+// bytes the open read can still clock out, at the end of a die it is started again on the next one
+static uint32_t W25qxx_StreamLeft(W25qxx_Stream_t *Stream)
+{
+	uint32_t ChipSize = w25qxx.SectorCount * w25qxx.SectorSize;
+	if (Stream->ChipAddress >= ChipSize)
+		return 0;
+	if ((w25qxx.DieCount > 1) && (Stream->ChipAddress / W25qxx_DieSize() != w25qxx.Die))
+	{
+		HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
+		W25qxx_StreamStart(Stream);
+	}
+	return W25qxx_DiePart(Stream->ChipAddress, ChipSize - Stream->ChipAddress);
+}
+//###################################################################################################################
+// clocks the next Prefetch bytes of the open read into buffer Index
+static void W25qxx_StreamFill(W25qxx_Stream_t *Stream, uint8_t Index)
+{
+	uint32_t Size = Stream->Prefetch;
+	if (Size > W25qxx_StreamLeft(Stream))
+		Size = W25qxx_StreamLeft(Stream);
+	Stream->Length[Index] = Size;
+	Stream->ChipAddress += Size;
+	if (Size == 0)
+		return;
+#if (_W25QXX_USE_DMA == 1)
+	Stream->Filling = Index + 1;
+	HAL_SPI_Receive_DMA(w25qxx.Spi, Stream->Buffer[Index], Size);
+#else
+	HAL_SPI_Receive(w25qxx.Spi, Stream->Buffer[Index], Size, 100);
+#endif
+}
+//###################################################################################################################
+void W25qxx_StreamOpen(W25qxx_Stream_t *Stream, uint32_t ReadAddr)
+{
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx StreamOpen at Address:%d\r\n", ReadAddr);
+#endif
+	Stream->Address = ReadAddr;
+	Stream->ChipAddress = ReadAddr;
+	Stream->Length[0] = 0;
+	Stream->Length[1] = 0;
+	Stream->Position = 0;
+	Stream->Front = 0;
+	Stream->Filling = 0;
+	Stream->Prefetch = _W25QXX_STREAM_BUFFER_SIZE;
+	Stream->Headers = 0;
+	W25qxx_StreamStart(Stream);
+	W25qxx_StreamFill(Stream, 0);
+}
+//###################################################################################################################
+uint32_t W25qxx_StreamRead(W25qxx_Stream_t *Stream, uint8_t *pBuffer, uint32_t NumByteToRead)
+{
+	uint32_t Done = 0;
+	uint32_t Chunk;
+	uint8_t Back;
+	while (Done < NumByteToRead)
+	{
+		// open and seek leave the DMA filling the front buffer
+		if (Stream->Filling == Stream->Front + 1)
+			W25qxx_StreamWait(Stream);
+		if (Stream->Position < Stream->Length[Stream->Front])
+		{
+			Chunk = Stream->Length[Stream->Front] - Stream->Position;
+			if (Chunk > NumByteToRead - Done)
+				Chunk = NumByteToRead - Done;
+			memcpy(&pBuffer[Done], &Stream->Buffer[Stream->Front][Stream->Position], Chunk);
+			Stream->Position += Chunk;
+			Stream->Address += Chunk;
+			Done += Chunk;
+			continue;
+		}
+		// front buffer drained
+		Back = Stream->Front ^ 1;
+		W25qxx_StreamWait(Stream);
+		if (Stream->Length[Back] == 0)
+		{
+			// nothing prefetched yet, big requests bypass the buffers
+			Chunk = NumByteToRead - Done;
+			if (Chunk > W25qxx_StreamLeft(Stream))
+				Chunk = W25qxx_StreamLeft(Stream);
+			if (Chunk == 0)
+				break;
+			if (Chunk >= _W25QXX_STREAM_BUFFER_SIZE)
+			{
+				Chunk -= Chunk % _W25QXX_STREAM_BUFFER_SIZE;
+				W25qxx_Receive(&pBuffer[Done], Chunk);
+				Stream->ChipAddress += Chunk;
+				Stream->Address += Chunk;
+				Stream->Length[Stream->Front] = 0;
+				Stream->Position = 0;
+				Done += Chunk;
+				continue;
+			}
+			W25qxx_StreamFill(Stream, Back);
+			W25qxx_StreamWait(Stream);
+		}
+		// consumer keeps up with whole buffers, read further ahead
+		if (Stream->Prefetch < _W25QXX_STREAM_BUFFER_SIZE)
+			Stream->Prefetch *= 2;
+		Stream->Length[Stream->Front] = 0;
+		Stream->Front = Back;
+		Stream->Position = 0;
+#if (_W25QXX_USE_DMA == 1)
+		// let the DMA fill the other half while the caller works on this one
+		W25qxx_StreamFill(Stream, Back ^ 1);
+#endif
+	}
+	return Done;
+}
+//###################################################################################################################
+void W25qxx_StreamSeek(W25qxx_Stream_t *Stream, uint32_t ReadAddr)
+{
+	uint32_t FrontStart = Stream->Address - Stream->Position;
+	uint8_t Back = Stream->Front ^ 1;
+	if ((ReadAddr >= FrontStart) && (ReadAddr < FrontStart + Stream->Length[Stream->Front]))
+	{
+		Stream->Position = ReadAddr - FrontStart;
+		Stream->Address = ReadAddr;
+		return;
+	}
+	W25qxx_StreamWait(Stream);
+	if ((ReadAddr >= FrontStart + Stream->Length[Stream->Front]) && (ReadAddr < Stream->ChipAddress) && (Stream->Length[Back] > 0))
+	{
+		Stream->Length[Stream->Front] = 0;
+		Stream->Front = Back;
+		Stream->Position = ReadAddr - (Stream->ChipAddress - Stream->Length[Back]);
+		Stream->Address = ReadAddr;
+		return;
+	}
+	// prefetched data is thrown away, read less ahead next time
+	if ((Stream->Prefetch > 32) && (Stream->Length[Back] > 0 || Stream->Position < Stream->Length[Stream->Front]))
+		Stream->Prefetch /= 2;
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
+	Stream->Address = ReadAddr;
+	Stream->ChipAddress = ReadAddr;
+	Stream->Length[0] = 0;
+	Stream->Length[1] = 0;
+	Stream->Position = 0;
+	Stream->Front = 0;
+	W25qxx_StreamStart(Stream);
+	W25qxx_StreamFill(Stream, 0);
+}
+//###################################################################################################################
+void W25qxx_StreamClose(W25qxx_Stream_t *Stream)
+{
+	W25qxx_StreamWait(Stream);
+	HAL_GPIO_WritePin(w25qxx.CsGpio, w25qxx.CsPin, GPIO_PIN_SET);
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx StreamClose at Address:%d, %d headers\r\n", Stream->Address, Stream->Headers);
+#endif
+	w25qxx.Lock = 0;
+}
+//###################################################################################################################
+#if (_W25QXX_READ_CACHE_SLOTS > 0)
+void W25qxx_ReadCacheStats(W25QXX_CacheStats_t *Stats, bool Reset)
+{
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+	if (Stats != NULL)
+		*Stats = w25qxx.CacheStats;
+	if (Reset == true)
+		memset(&w25qxx.CacheStats, 0, sizeof(w25qxx.CacheStats));
+	w25qxx.Lock = 0;
+}
+//###################################################################################################################
+void W25qxx_ReadCacheInvalidate(void)
+{
+	while (w25qxx.Lock == 1)
+		W25qxx_Delay(1);
+	w25qxx.Lock = 1;
+	memset(w25qxx.Cache, 0, sizeof(w25qxx.Cache));
+	w25qxx.Lock = 0;
+}
+#endif
+//###################################################################################################################
@@ -35,6 +35,9 @@ extern "C"
 
 #include <stdbool.h>
 #include "main.h"
+#include "w25qxxConf.h"
+
+#define W25QXX_MAX_DIES 4
 
 	typedef enum
 	{
@@ -48,9 +51,107 @@ extern "C"
 		W25Q128,
 		W25Q256,
 		W25Q512,
+		W25Q01, // stacked dies from here on
+		W25Q02,
+		W25M512,
 
 	} W25QXX_ID_t;
 
+	typedef enum
+	{
+		W25QXX_SMART_UNCHANGED = 0, // flash already holds the data, nothing written
+		W25QXX_SMART_PROGRAMMED, // only 1->0 changes, differing pages programmed in place
+		W25QXX_SMART_ERASED, // at least one sector needed 0->1, erased and rewritten
+
+	} W25QXX_SmartWrite_t;
+
+	typedef enum
+	{
+		W25QXX_SECTOR_UNKNOWN = 0,
+		W25QXX_SECTOR_ERASED,
+		W25QXX_SECTOR_PROGRAMMED, // fully or partially programmed
+
+	} W25QXX_Sector_t;
+
+	typedef struct
+	{
+		uint32_t Hits;
+		uint32_t Misses;
+
+	} W25QXX_CacheStats_t;
+
+	typedef struct
+	{
+		uint32_t SectorsSkipped; // content already matched
+		uint32_t SectorsProgrammed; // programmed without erase
+		uint32_t SectorsErased; // erased and reprogrammed
+
+	} W25QXX_DiffStats_t;
+
+	typedef struct
+	{
+		uint32_t EraseCount; // erase commands covering it, chip erase included
+		uint16_t EraseLast; // ms, suspended time not counted. only erases a status poll saw running
+		uint16_t EraseMax; // ms
+		uint16_t EraseFails; // WEL still set when the chip got ready: rejected (protected) or failed
+		uint16_t ProgramFails;
+
+	} W25QXX_HealthEntry_t;
+
+	typedef struct
+	{
+		uint32_t Page;
+		uint8_t Valid;
+		uint8_t Ref;
+		uint8_t Data[256];
+
+	} W25QXX_CacheSlot_t;
+
+	typedef struct
+	{
+		uint32_t Page;
+		uint32_t Tick;
+		uint16_t Start;
+		uint16_t End;
+		uint8_t Valid;
+		uint8_t Data[256];
+
+	} W25QXX_WriteBuffer_t;
+
+	typedef struct
+	{
+		uint32_t Entry; // first entry of the program/erase running
+		uint32_t Entries;
+		uint32_t Tick;
+		uint32_t Time; // ms, before a suspend
+		uint8_t Op; // 0 = none, 1 = program, 2 = erase
+		uint8_t Seen; // a status poll saw it busy, the time is a measurement
+
+	} W25QXX_HealthRun_t;
+
+	typedef struct
+	{
+		W25QXX_HealthEntry_t *Entry;
+		uint32_t Count;
+		uint32_t Sectors; // per entry
+		uint32_t Sequence; // of the last saved copy
+		W25QXX_HealthRun_t Run[W25QXX_MAX_DIES];
+
+	} W25QXX_Health_t;
+
+	// in front of each saved copy of the table
+	typedef struct
+	{
+		uint32_t Magic;
+		uint32_t Sequence;
+		uint32_t Count;
+		uint32_t Crc; // of the entries
+
+	} W25QXX_HealthHeader_t;
+
+// sectors W25qxx_HealthSave() needs for Count entries on the selected chip, two copies
+#define W25QXX_HEALTH_SAVE_SECTORS(Count) (2 * ((sizeof(W25QXX_HealthHeader_t) + (Count) * sizeof(W25QXX_HealthEntry_t) + w25qxx.SectorSize - 1) / w25qxx.SectorSize))
+
 	typedef struct
 	{
 		W25QXX_ID_t ID;
@@ -66,19 +167,88 @@ extern "C"
 		uint8_t StatusRegister2;
 		uint8_t StatusRegister3;
 		uint8_t Lock;
+		uint8_t Busy; // program/erase started and not waited for, 2 = background erase
+		uint8_t Suspended; // background erase suspended, resumed by W25qxx_EraseResume() or the next erase
+		uint8_t DieCount; // 1, or dies stacked in the package, selected with 0xC2
+		uint8_t Die; // selected die, Busy and Suspended are its state
+		uint8_t DieBusy[W25QXX_MAX_DIES]; // Busy of the other dies, they keep working while one is selected
+		uint8_t DieSuspended[W25QXX_MAX_DIES];
+		uint32_t EraseAddr[W25QXX_MAX_DIES]; // erase running on each die, the sector map marks it erased when done
+		uint32_t EraseSize[W25QXX_MAX_DIES]; // 0 = none
+		W25QXX_Health_t *Health; // _W25QXX_USE_HEALTH, set by W25qxx_HealthInit()
+		// per chip, kept while another one is selected
+#if (_W25QXX_USE_SECTOR_MAP == 1)
+		uint8_t SectorMap[(_W25QXX_SECTOR_MAP_SECTORS + 3) / 4]; // W25QXX_Sector_t, 2 bits each
+#endif
+#if (_W25QXX_READ_CACHE_SLOTS > 0)
+		W25QXX_CacheSlot_t Cache[_W25QXX_READ_CACHE_SLOTS];
+		uint32_t CacheHand;
+		W25QXX_CacheStats_t CacheStats;
+#endif
+#if (_W25QXX_USE_WRITE_BUFFER == 1)
+		W25QXX_WriteBuffer_t WriteBuffer;
+#endif
+		SPI_HandleTypeDef *Spi;
+		GPIO_TypeDef *CsGpio;
+		uint16_t CsPin;
 
 	} w25qxx_t;
 
+	typedef struct
+	{
+		uint8_t *Buffer;
+		uint32_t Length;
+
+	} W25QXX_IoVec_t;
+
+	// fills Page (PageSize bytes) with page number PageIndex of the stream, false stops the write
+	typedef bool (*W25qxx_PageProducer_t)(uint8_t *Page, uint32_t PageIndex, void *Context);
+
+	typedef struct
+	{
+		uint32_t Address;	  // flash address of the next byte returned to the caller
+		uint32_t ChipAddress; // flash address the open Fast Read is at
+		uint32_t Headers;	  // command headers sent since open
+		uint16_t Length[2];
+		uint16_t Position;
+		uint16_t Prefetch;
+		uint8_t Front;
+		uint8_t Filling;	  // buffer + 1 the DMA is filling, 0 = none
+		uint8_t Buffer[2][_W25QXX_STREAM_BUFFER_SIZE];
+
+	} W25qxx_Stream_t;
+
 	extern w25qxx_t w25qxx;
 	//############################################################################
 	// in Page,Sector and block read/write functions, can put 0 to read maximum bytes
 	//############################################################################
 	bool W25qxx_Init(void);
+	// more chips: init each once, then select the one the other functions work on (NULL = w25qxx).
+	// selecting waits until no call is in progress on the chip selected before
+	bool W25qxx_InitDevice(w25qxx_t *Device, SPI_HandleTypeDef *Spi, GPIO_TypeDef *CsGpio, uint16_t CsPin);
+	void W25qxx_SelectDevice(w25qxx_t *Device);
+	w25qxx_t *W25qxx_GetDevice(void);
+	// tasks working on different chips: selects Device and keeps it selected until the release, other
+	// chips wait. the last release selects the device of W25qxx_SelectDevice() again
+	void W25qxx_DeviceAcquire(w25qxx_t *Device);
+	void W25qxx_DeviceRelease(void);
 
 	void W25qxx_EraseChip(void);
 	void W25qxx_EraseSector(uint32_t SectorAddr);
 	void W25qxx_EraseBlock(uint32_t BlockAddr);
 
+	// start a page program / sector erase and return at once, the next call to the same chip waits for it
+	void W25qxx_ProgramStart(uint8_t *pBuffer, uint32_t WriteAddr, uint32_t NumByteToWrite_up_to_PageEnd);
+	void W25qxx_EraseSectorStart(uint32_t SectorAddr);
+	// with _W25QXX_USE_ERASE_SUSPEND, reads and programs suspend a background erase instead of waiting for it.
+	// keep out of the sector being erased, resume it from idle time with W25qxx_EraseResume()
+	// on stacked parts only accesses to the same die suspend it, the other dies work while it runs
+	void W25qxx_EraseSectorBackground(uint32_t SectorAddr);
+	void W25qxx_EraseResume(void);
+	bool W25qxx_IsBusy(void); // also true while an erase is suspended, any die
+	bool W25qxx_IsErasing(uint32_t SectorAddr); // an erase of this sector is running or suspended, other work does not count
+	void W25qxx_WaitReady(void);
+
 	uint32_t W25qxx_PageToSector(uint32_t PageAddress);
 	uint32_t W25qxx_PageToBlock(uint32_t PageAddress);
 	uint32_t W25qxx_SectorToBlock(uint32_t SectorAddress);
@@ -88,17 +258,74 @@ extern "C"
 	bool W25qxx_IsEmptyPage(uint32_t Page_Address, uint32_t OffsetInByte, uint32_t NumByteToCheck_up_to_PageSize);
 	bool W25qxx_IsEmptySector(uint32_t Sector_Address, uint32_t OffsetInByte, uint32_t NumByteToCheck_up_to_SectorSize);
 	bool W25qxx_IsEmptyBlock(uint32_t Block_Address, uint32_t OffsetInByte, uint32_t NumByteToCheck_up_to_BlockSize);
+	// end of the data in a region filled from StartAddr on, in Granularity steps (0 = page size).
+	// binary search with short probes, then one blank check after the result, W25qxx_FindFrontierScan() if that fails
+	uint32_t W25qxx_FindFrontier(uint32_t StartAddr, uint32_t EndAddr, uint32_t Granularity);
+	// end of the last granule holding data, scanned back from EndAddr, for regions with holes.
+	// EndAddr past the end of the chip is taken as the end, both return StartAddr for an empty or inverted region
+	uint32_t W25qxx_FindFrontierScan(uint32_t StartAddr, uint32_t EndAddr, uint32_t Granularity);
+#if (_W25QXX_USE_SECTOR_MAP == 1)
+	// with _W25QXX_USE_SECTOR_MAP, known erased sectors are not checked or erased again
+	W25QXX_Sector_t W25qxx_SectorMapGet(uint32_t Sector_Address);
+	void W25qxx_SectorMapInvalidate(void);
+	void W25qxx_SectorMapRebuild(bool OnlyUnknown);
+#endif
+#if (_W25QXX_USE_HEALTH == 1)
+	// with _W25QXX_USE_HEALTH, erase times and program/erase failures of the selected chip in Count equal parts
+	// (Count = SectorCount: per sector, BlockCount: per block). Entry is an array of Count entries
+	bool W25qxx_HealthInit(W25QXX_Health_t *Health, W25QXX_HealthEntry_t *Entry, uint32_t Count);
+	bool W25qxx_HealthGet(uint32_t Sector_Address, W25QXX_HealthEntry_t *Entry);
+	// first sectors of the parts with a failure or a last erase of EraseLimitMs or more, returns how many were found
+	uint32_t W25qxx_HealthDegrading(uint32_t *Sectors, uint32_t MaxSectors, uint16_t EraseLimitMs);
+	// the table is kept in SectorCount sectors (W25QXX_HEALTH_SAVE_SECTORS) from Sector_Address, in two copies.
+	// save writes over the older copy, load takes the newest valid one
+	bool W25qxx_HealthSave(uint32_t Sector_Address, uint32_t SectorCount);
+	bool W25qxx_HealthLoad(uint32_t Sector_Address, uint32_t SectorCount);
+#endif
 
 	void W25qxx_WriteByte(uint8_t pBuffer, uint32_t Bytes_Address);
+	// any size, split at page boundaries. with _W25QXX_USE_WRITE_BUFFER, WriteByte and short WriteBytes are
+	// collected per page and programmed at once on page change, WriteFlush, timeout or an overlapping read/write
+	void W25qxx_WriteBytes(uint8_t *pBuffer, uint32_t WriteAddr, uint32_t NumByteToWrite);
+	// programs PageCount erased pages from Page_Address on, Producer prepares page N+1 while page N programs.
+	// pWork holds 2 * PageSize bytes, returns the number of pages written
+	uint32_t W25qxx_WritePipeline(uint32_t Page_Address, uint32_t PageCount, W25qxx_PageProducer_t Producer, void *Context, uint8_t *pWork);
+	void W25qxx_WriteFlush(void);
+#if (_W25QXX_USE_WRITE_BUFFER == 1)
+	void W25qxx_WriteBufferPoll(void); // call every few ms, flushes after _W25QXX_WRITE_BUFFER_TIMEOUT. per chip, like WriteFlush
+#endif
 	void W25qxx_WritePage(uint8_t *pBuffer, uint32_t Page_Address, uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_PageSize);
 	void W25qxx_WriteSector(uint8_t *pBuffer, uint32_t Sector_Address, uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_SectorSize);
 	void W25qxx_WriteBlock(uint8_t *pBuffer, uint32_t Block_Address, uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_BlockSize);
+#if (_W25QXX_USE_SMART_WRITE == 1)
+	// no erase needed before, erases only the 4KB sectors where some bit has to go 0->1
+	W25QXX_SmartWrite_t W25qxx_SmartWrite(uint8_t *pBuffer, uint32_t WriteAddr, uint32_t NumByteToWrite);
+	// same as SmartWrite, per sector counters are added to Stats (can be NULL)
+	void W25qxx_WriteDiff(uint8_t *pBuffer, uint32_t WriteAddr, uint32_t NumByteToWrite, W25QXX_DiffStats_t *Stats);
+	void W25qxx_WriteBlockDiff(uint8_t *pBuffer, uint32_t Block_Address, uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_BlockSize, W25QXX_DiffStats_t *Stats);
+#endif
 
 	void W25qxx_ReadByte(uint8_t *pBuffer, uint32_t Bytes_Address);
 	void W25qxx_ReadBytes(uint8_t *pBuffer, uint32_t ReadAddr, uint32_t NumByteToRead);
 	void W25qxx_ReadPage(uint8_t *pBuffer, uint32_t Page_Address, uint32_t OffsetInByte, uint32_t NumByteToRead_up_to_PageSize);
 	void W25qxx_ReadSector(uint8_t *pBuffer, uint32_t Sector_Address, uint32_t OffsetInByte, uint32_t NumByteToRead_up_to_SectorSize);
 	void W25qxx_ReadBlock(uint8_t *pBuffer, uint32_t Block_Address, uint32_t OffsetInByte, uint32_t NumByteToRead_up_to_BlockSize);
+	// scatter/gather, the segments are read/programmed back to back as one flash range, programs split at page boundaries
+	void W25qxx_ReadV(uint32_t ReadAddr, const W25QXX_IoVec_t *Iov, uint32_t IovCount);
+	void W25qxx_WriteV(uint32_t WriteAddr, const W25QXX_IoVec_t *Iov, uint32_t IovCount);
+
+	// sequential reader, keeps one Fast Read open, a new command is only sent on seek.
+	// the chip stays locked until W25qxx_StreamClose(), do not call other W25qxx functions before.
+	void W25qxx_StreamOpen(W25qxx_Stream_t *Stream, uint32_t ReadAddr);
+	uint32_t W25qxx_StreamRead(W25qxx_Stream_t *Stream, uint8_t *pBuffer, uint32_t NumByteToRead);
+	void W25qxx_StreamSeek(W25qxx_Stream_t *Stream, uint32_t ReadAddr);
+	void W25qxx_StreamClose(W25qxx_Stream_t *Stream);
+
+#if (_W25QXX_READ_CACHE_SLOTS > 0)
+	// with _W25QXX_READ_CACHE_SLOTS > 0, reads up to one page are served from a page cache
+	void W25qxx_ReadCacheStats(W25QXX_CacheStats_t *Stats, bool Reset);
+	void W25qxx_ReadCacheInvalidate(void);
+#endif
 //############################################################################
 #ifdef __cplusplus
 }
@@ -6,5 +6,15 @@
 #define _W25QXX_CS_PIN                FLASH_CS_Pin
 #define _W25QXX_USE_FREERTOS          1
 #define _W25QXX_DEBUG                 0
+#define _W25QXX_USE_DMA               0   // W25qxx_StreamRead() prefetch with HAL_SPI_Receive_DMA
+#define _W25QXX_USE_SECTOR_MAP        0   // remember erased sectors, 2 bits of RAM per sector
+#define _W25QXX_SECTOR_MAP_SECTORS    16384 // sectors of the biggest chip used (w25q512)
+#define _W25QXX_USE_SMART_WRITE       0   // W25qxx_SmartWrite(), W25qxx_WriteDiff(), needs 4KB of RAM
+#define _W25QXX_READ_CACHE_SLOTS      0   // cached pages for small reads, 0 = off, about 264 bytes of RAM each
+#define _W25QXX_USE_WRITE_BUFFER      0   // collect WriteByte/short writes into one page program, about 268 bytes of RAM
+#define _W25QXX_WRITE_BUFFER_TIMEOUT  100 // ms, for W25qxx_WriteBufferPoll()
+#define _W25QXX_USE_ERASE_SUSPEND     0   // W25qxx_EraseSectorBackground() is suspended (0x75/0x7A) for reads/programs
+#define _W25QXX_USE_HEALTH            0   // erase counts/times and failures per sector or block, W25qxx_HealthInit()
+#define _W25QXX_STREAM_BUFFER_SIZE    256 // bytes, W25qxx_Stream_t holds two of them
 
 #endif
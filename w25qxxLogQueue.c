@@ -0,0 +1,193 @@
+
+#include "w25qxxLogQueue.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+_Static_assert(sizeof(_Atomic uint32_t) == sizeof(uint32_t), "counters and sequence words are uint32_t in the header");
+
+//###################################################################################################################
+// the sequence word of a slot and the counters of the queue
+static _Atomic uint32_t *W25qxx_LogAtomic(uint32_t *Word)
+{
+	return (_Atomic uint32_t *)Word;
+}
+//###################################################################################################################
+// the sector after the one holding Page, kept erased
+static uint32_t W25qxx_LogNextSector(w25qxx_logqueue_t *Queue)
+{
+	uint32_t Sector = W25qxx_PageToSector(Queue->Page);
+	return Queue->FirstSector + (Sector - Queue->FirstSector + 1) % Queue->SectorCount;
+}
+//###################################################################################################################
+static bool W25qxx_LogPop(w25qxx_logqueue_t *Queue, uint8_t *Record)
+{
+	uint32_t Tail = atomic_load_explicit(W25qxx_LogAtomic(&Queue->Tail), memory_order_relaxed);
+	uint32_t *Slot = &Queue->Storage[(Tail & Queue->Mask) * Queue->Stride];
+	if (atomic_load_explicit(W25qxx_LogAtomic(Slot), memory_order_acquire) != Tail + 1)
+		return false;
+	memcpy(Record, &Slot[1], Queue->RecordSize);
+	// free for the producer one lap later
+	atomic_store_explicit(W25qxx_LogAtomic(Slot), Tail + Queue->Mask + 1, memory_order_release);
+	atomic_store_explicit(W25qxx_LogAtomic(&Queue->Tail), Tail + 1, memory_order_relaxed);
+	return true;
+}
+//###################################################################################################################
+// programs what is new in the page buffer, a full page moves on to the next page
+static void W25qxx_LogProgram(w25qxx_logqueue_t *Queue, bool Full)
+{
+	W25qxx_WritePage(&Queue->Buffer[Queue->Programmed], Queue->Page, Queue->Programmed, Queue->Used - Queue->Programmed);
+	Queue->Pages++;
+	Queue->Programmed = Queue->Used;
+	if (Full == false)
+		return;
+	Queue->Used = 0;
+	Queue->Programmed = 0;
+	Queue->Page++;
+	if (Queue->Page == W25qxx_SectorToPage(Queue->FirstSector + Queue->SectorCount))
+		Queue->Page = W25qxx_SectorToPage(Queue->FirstSector);
+	if ((Queue->Page % (Queue->Device->SectorSize / Queue->Device->PageSize)) == 0)
+	{
+		W25qxx_EraseSector(W25qxx_LogNextSector(Queue));
+		Queue->Erases++;
+	}
+}
+//###################################################################################################################
+bool W25qxx_LogQueueInit(w25qxx_logqueue_t *Queue, uint32_t *Storage, uint32_t SlotCount, uint16_t RecordSize, uint32_t FirstSector, uint32_t SectorCount)
+{
+	w25qxx_t *Device = W25qxx_GetDevice();
+	uint32_t Sector, Next, Frontier;
+	bool Found = false;
+	if ((SlotCount < 2) || ((SlotCount & (SlotCount - 1)) != 0) || (RecordSize == 0) || (RecordSize > Device->PageSize))
+		return false;
+	if ((SectorCount < 2) || (FirstSector + SectorCount > Device->SectorCount))
+		return false;
+	memset(Queue, 0, sizeof(w25qxx_logqueue_t));
+	Queue->Storage = Storage;
+	Queue->Mask = SlotCount - 1;
+	Queue->Stride = 1 + (RecordSize + 3) / 4;
+	Queue->RecordSize = RecordSize;
+	for (uint32_t i = 0; i < SlotCount; i++)
+		atomic_init(W25qxx_LogAtomic(&Storage[i * Queue->Stride]), i);
+	atomic_init(W25qxx_LogAtomic(&Queue->Head), 0);
+	atomic_init(W25qxx_LogAtomic(&Queue->Pushed), 0);
+	atomic_init(W25qxx_LogAtomic(&Queue->Dropped), 0);
+	atomic_init(W25qxx_LogAtomic(&Queue->Tail), 0);
+	Queue->Device = Device;
+	Queue->FirstSector = FirstSector;
+	Queue->SectorCount = SectorCount;
+	// the log ends in the used sector followed by an erased one
+	for (Sector = FirstSector; Sector < FirstSector + SectorCount; Sector++)
+	{
+		Next = FirstSector + (Sector - FirstSector + 1) % SectorCount;
+		if ((W25qxx_IsEmptyPage(W25qxx_SectorToPage(Sector), 0, RecordSize) == false) && (W25qxx_IsEmptyPage(W25qxx_SectorToPage(Next), 0, RecordSize) == true))
+		{
+			Found = true;
+			break;
+		}
+	}
+	if (Found == true)
+	{
+		Frontier = W25qxx_FindFrontier(Sector * Device->SectorSize, (Sector + 1) * Device->SectorSize, Device->PageSize);
+		Queue->Page = Frontier / Device->PageSize;
+		if (Queue->Page == W25qxx_SectorToPage(FirstSector + SectorCount))
+			Queue->Page = W25qxx_SectorToPage(FirstSector);
+	}
+	else
+	{
+		// blank region, or no erased sector left by a power loss during the erase
+		Queue->Page = W25qxx_SectorToPage(FirstSector);
+		if (W25qxx_IsEmptySector(FirstSector, 0, 0) == false)
+		{
+			W25qxx_EraseSector(FirstSector);
+			Queue->Erases++;
+		}
+	}
+	Next = W25qxx_LogNextSector(Queue);
+	if (W25qxx_IsEmptySector(Next, 0, 0) == false)
+	{
+		W25qxx_EraseSector(Next);
+		Queue->Erases++;
+	}
+	return true;
+}
+//###################################################################################################################
+bool W25qxx_LogPush(w25qxx_logqueue_t *Queue, const void *Record)
+{
+	uint32_t Pos = atomic_load_explicit(W25qxx_LogAtomic(&Queue->Head), memory_order_relaxed);
+	uint32_t *Slot;
+	int32_t Diff;
+	for (;;)
+	{
+		Slot = &Queue->Storage[(Pos & Queue->Mask) * Queue->Stride];
+		Diff = (int32_t)(atomic_load_explicit(W25qxx_LogAtomic(Slot), memory_order_acquire) - Pos);
+		if (Diff == 0)
+		{
+			// claim the slot, a failed exchange loads the new head into Pos
+			if (atomic_compare_exchange_weak_explicit(W25qxx_LogAtomic(&Queue->Head), &Pos, Pos + 1, memory_order_relaxed, memory_order_relaxed))
+				break;
+		}
+		else if (Diff < 0)
+		{
+			// the drain has not freed this slot yet, the ring is full
+			atomic_fetch_add_explicit(W25qxx_LogAtomic(&Queue->Dropped), 1, memory_order_relaxed);
+			return false;
+		}
+		else
+			Pos = atomic_load_explicit(W25qxx_LogAtomic(&Queue->Head), memory_order_relaxed);
+	}
+	memcpy(&Slot[1], Record, Queue->RecordSize);
+	atomic_store_explicit(W25qxx_LogAtomic(Slot), Pos + 1, memory_order_release);
+	atomic_fetch_add_explicit(W25qxx_LogAtomic(&Queue->Pushed), 1, memory_order_relaxed);
+	return true;
+}
+//###################################################################################################################
+uint32_t W25qxx_LogLevel(w25qxx_logqueue_t *Queue)
+{
+	return atomic_load_explicit(W25qxx_LogAtomic(&Queue->Head), memory_order_relaxed) - atomic_load_explicit(W25qxx_LogAtomic(&Queue->Tail), memory_order_relaxed);
+}
+//###################################################################################################################
+uint32_t W25qxx_LogDrain(w25qxx_logqueue_t *Queue, bool Flush)
+{
+	uint32_t Count = 0;
+	uint32_t Waiting = W25qxx_LogLevel(Queue);
+	W25qxx_DeviceAcquire(Queue->Device);
+	if (Waiting > Queue->HighWater)
+		Queue->HighWater = Waiting;
+	// at most one ring full per call, busy producers do not keep the drain here
+	while ((Count <= Queue->Mask) && (W25qxx_LogPop(Queue, &Queue->Buffer[Queue->Used]) == true))
+	{
+		Queue->Used += Queue->RecordSize;
+		Count++;
+		if (Queue->Used + Queue->RecordSize > Queue->Device->PageSize)
+			W25qxx_LogProgram(Queue, true);
+	}
+	if ((Flush == true) && (Queue->Used > Queue->Programmed))
+		W25qxx_LogProgram(Queue, false);
+	Queue->Drained += Count;
+	W25qxx_DeviceRelease();
+	return Count;
+}
+//###################################################################################################################
+void W25qxx_LogQueueStats(w25qxx_logqueue_t *Queue, W25QXX_LogQueueStats_t *Stats, bool Reset)
+{
+	if (Stats != NULL)
+	{
+		Stats->Pushed = atomic_load_explicit(W25qxx_LogAtomic(&Queue->Pushed), memory_order_relaxed);
+		Stats->Dropped = atomic_load_explicit(W25qxx_LogAtomic(&Queue->Dropped), memory_order_relaxed);
+		Stats->Drained = Queue->Drained;
+		Stats->Pages = Queue->Pages;
+		Stats->Erases = Queue->Erases;
+		Stats->HighWater = Queue->HighWater;
+	}
+	if (Reset)
+	{
+		atomic_store_explicit(W25qxx_LogAtomic(&Queue->Pushed), 0, memory_order_relaxed);
+		atomic_store_explicit(W25qxx_LogAtomic(&Queue->Dropped), 0, memory_order_relaxed);
+		Queue->Drained = 0;
+		Queue->Pages = 0;
+		Queue->Erases = 0;
+		Queue->HighWater = 0;
+	}
+}
+//###################################################################################################################
@@ -0,0 +1,89 @@
+#ifndef _W25QXXLOGQUEUE_H
+#define _W25QXXLOGQUEUE_H
+
+/*
+  Log queue for records written from interrupts.
+
+  W25qxx_LogPush() copies a record of RecordSize bytes into a lock-free ring (bounded
+  multi-producer queue, one sequence number per slot). It never blocks or sleeps and can
+  be called from any task or ISR at the same time. When the ring is full the record is
+  dropped and counted.
+
+  W25qxx_LogDrain() is called from one task only. It takes the waiting records in order,
+  packs them into the page buffer and programs whole pages with the normal driver calls.
+  Flush programs a partly filled page as well, the next records go on in the same page.
+  Pages hold whole records, the rest of a page stays 0xFF.
+
+  The region FirstSector .. FirstSector + SectorCount - 1 is written as a ring, the
+  sector after the one being filled is always kept erased. W25qxx_LogQueueInit() finds
+  the end of the log from that. Records must not be all 0xFF.
+
+  C11 atomics: needs a core with LDREX/STREX (Cortex-M3 and up) or lock-free compare
+  and swap on the host. Only w25qxxLogQueue.c uses them, the counters are plain words
+  here so the header builds as C++ as well.
+*/
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "w25qxx.h"
+
+// uint32_t words of ring storage for W25qxx_LogQueueInit()
+#define W25QXX_LOGQ_STORAGE_WORDS(SlotCount, RecordSize) ((SlotCount) * (1 + ((RecordSize) + 3) / 4))
+
+	typedef struct
+	{
+		uint32_t Pushed; // records accepted
+		uint32_t Dropped; // ring full, not accepted
+		uint32_t Drained; // records taken from the ring
+		uint32_t Pages; // page programs, flushes included
+		uint32_t Erases;
+		uint32_t HighWater; // most records waiting seen by a drain
+
+	} W25QXX_LogQueueStats_t;
+
+	typedef struct
+	{
+		// producers, atomic in w25qxxLogQueue.c
+		uint32_t Head;
+		uint32_t Pushed;
+		uint32_t Dropped;
+		// ring, slot = sequence word + record
+		uint32_t *Storage;
+		uint32_t Mask; // SlotCount - 1
+		uint16_t Stride; // words per slot
+		uint16_t RecordSize;
+		// drain task
+		uint32_t Tail; // atomic, also read by W25qxx_LogLevel()
+		w25qxx_t *Device;
+		uint32_t FirstSector;
+		uint32_t SectorCount;
+		uint32_t Page; // page being filled
+		uint16_t Used; // bytes in Buffer
+		uint16_t Programmed; // of them, already programmed by a flush
+		uint32_t Drained;
+		uint32_t Pages;
+		uint32_t Erases;
+		uint32_t HighWater;
+		uint8_t Buffer[256];
+
+	} w25qxx_logqueue_t;
+
+	// SlotCount is a power of 2, Storage holds W25QXX_LOGQ_STORAGE_WORDS(SlotCount, RecordSize) words.
+	// RecordSize up to the page size. works on the selected chip, finds where the log goes on
+	bool W25qxx_LogQueueInit(w25qxx_logqueue_t *Queue, uint32_t *Storage, uint32_t SlotCount, uint16_t RecordSize, uint32_t FirstSector, uint32_t SectorCount);
+	// any context, ISRs included. false when the ring is full, the record is dropped
+	bool W25qxx_LogPush(w25qxx_logqueue_t *Queue, const void *Record);
+	// records waiting in the ring, for producers that want to back off early
+	uint32_t W25qxx_LogLevel(w25qxx_logqueue_t *Queue);
+	// drain task only. programs the full pages, with Flush also the last one. returns the records taken
+	uint32_t W25qxx_LogDrain(w25qxx_logqueue_t *Queue, bool Flush);
+	void W25qxx_LogQueueStats(w25qxx_logqueue_t *Queue, W25QXX_LogQueueStats_t *Stats, bool Reset);
+//############################################################################
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,458 @@
+
+#include "w25qxxLz.h"
+
+#include <string.h>
+
+#define W25QXX_LZ_EMPTY 0xFFFFFFFF
+#define W25QXX_LZ_STORED 0x4000 // index entry flag, chunk is not compressed
+#define W25QXX_LZ_END_MASK 0x1FFF
+
+//###################################################################################################################
+static uint32_t W25qxx_LzRead32(const uint8_t *p)
+{
+	uint32_t Value;
+	memcpy(&Value, p, 4);
+	return Value;
+}
+//###################################################################################################################
+// LZ4 block format, matches of 4 bytes and more, the last 5 bytes are always literals.
+// returns 0 when the result would not be smaller than DstSize
+static uint32_t W25qxx_LzCompress(const uint8_t *Src, uint32_t Size, uint8_t *Dst, uint32_t DstSize, uint16_t *Hash)
+{
+	uint32_t Ip = 0, Anchor = 0, Op = 0;
+	uint32_t Seq, Ref, Len, Lit, h;
+	while (Ip + 12 < Size)
+	{
+		Seq = W25qxx_LzRead32(&Src[Ip]);
+		h = (Seq * 2654435761u) >> (32 - W25QXX_LZ_HASH_BITS);
+		Ref = Hash[h]; // may be left from an older chunk, checked below
+		Hash[h] = Ip;
+		if ((Ref >= Ip) || (W25qxx_LzRead32(&Src[Ref]) != Seq))
+		{
+			Ip++;
+			continue;
+		}
+		Len = 4;
+		while ((Ip + Len < Size - 5) && (Src[Ref + Len] == Src[Ip + Len]))
+			Len++;
+		Lit = Ip - Anchor;
+		if (Op + 1 + Lit / 255 + 1 + Lit + 2 + (Len - 4) / 255 + 1 >= DstSize)
+			return 0;
+		Dst[Op++] = ((Lit < 15 ? Lit : 15) << 4) | ((Len - 4) < 15 ? (Len - 4) : 15);
+		if (Lit >= 15)
+		{
+			for (h = Lit - 15; h >= 255; h -= 255)
+				Dst[Op++] = 255;
+			Dst[Op++] = h;
+		}
+		memcpy(&Dst[Op], &Src[Anchor], Lit);
+		Op += Lit;
+		Dst[Op++] = (Ip - Ref) & 0xFF;
+		Dst[Op++] = (Ip - Ref) >> 8;
+		if (Len - 4 >= 15)
+		{
+			for (h = Len - 4 - 15; h >= 255; h -= 255)
+				Dst[Op++] = 255;
+			Dst[Op++] = h;
+		}
+		Ip += Len;
+		Anchor = Ip;
+	}
+	Lit = Size - Anchor;
+	if (Op + 1 + Lit / 255 + 1 + Lit >= DstSize)
+		return 0;
+	Dst[Op++] = (Lit < 15 ? Lit : 15) << 4;
+	if (Lit >= 15)
+	{
+		for (h = Lit - 15; h >= 255; h -= 255)
+			Dst[Op++] = 255;
+		Dst[Op++] = h;
+	}
+	memcpy(&Dst[Op], &Src[Anchor], Lit);
+	return Op + Lit;
+}
+//###################################################################################################################
+// returns the decompressed size, 0 on broken data
+static uint32_t W25qxx_LzDecompress(const uint8_t *Src, uint32_t Size, uint8_t *Dst, uint32_t DstSize)
+{
+	uint32_t Ip = 0, Op = 0;
+	uint32_t Len, Offset;
+	uint8_t Token, b;
+	while (Ip < Size)
+	{
+		Token = Src[Ip++];
+		Len = Token >> 4;
+		if (Len == 15)
+		{
+			do
+			{
+				if (Ip >= Size)
+					return 0;
+				b = Src[Ip++];
+				Len += b;
+			} while (b == 255);
+		}
+		if ((Ip + Len > Size) || (Op + Len > DstSize))
+			return 0;
+		memcpy(&Dst[Op], &Src[Ip], Len);
+		Ip += Len;
+		Op += Len;
+		if (Ip == Size) // the last sequence has no match
+			break;
+		if (Ip + 2 > Size)
+			return 0;
+		Offset = Src[Ip] | (Src[Ip + 1] << 8);
+		Ip += 2;
+		if ((Offset == 0) || (Offset > Op))
+			return 0;
+		Len = Token & 0x0F;
+		if (Len == 15)
+		{
+			do
+			{
+				if (Ip >= Size)
+					return 0;
+				b = Src[Ip++];
+				Len += b;
+			} while (b == 255);
+		}
+		Len += 4;
+		if (Op + Len > DstSize)
+			return 0;
+		while (Len-- > 0) // may overlap
+		{
+			Dst[Op] = Dst[Op - Offset];
+			Op++;
+		}
+	}
+	return Op;
+}
+//###################################################################################################################
+static uint32_t W25qxx_LzFirstChunk(w25qxx_lz_t *Lz, uint32_t Sector)
+{
+	uint8_t Data[4];
+	W25qxx_ReadBytes(Data, Sector * Lz->Device->SectorSize, 4);
+	return Data[0] | (Data[1] << 8) | (Data[2] << 16) | ((uint32_t)Data[3] << 24);
+}
+//###################################################################################################################
+// reads the header of Sector, returns the number of chunks in it
+static uint8_t W25qxx_LzIndex(w25qxx_lz_t *Lz, uint32_t Sector, uint32_t *First, uint16_t *Start, uint16_t *End)
+{
+	uint8_t Data[W25QXX_LZ_HEADER_SIZE];
+	uint8_t Count;
+	W25qxx_ReadBytes(Data, Sector * Lz->Device->SectorSize, sizeof(Data));
+	*First = Data[0] | (Data[1] << 8) | (Data[2] << 16) | ((uint32_t)Data[3] << 24);
+	*Start = Data[4] | (Data[5] << 8);
+	for (Count = 0; Count < W25QXX_LZ_SECTOR_CHUNKS; Count++)
+	{
+		End[Count] = Data[6 + 2 * Count] | (Data[7 + 2 * Count] << 8);
+		if (End[Count] == 0xFFFF)
+			break;
+	}
+	return Count;
+}
+//###################################################################################################################
+static bool W25qxx_LzErase(w25qxx_lz_t *Lz, uint32_t Sector)
+{
+	if (Sector >= Lz->FirstSector + Lz->SectorCount)
+		return false;
+	if ((Sector < Lz->Erased) && !W25qxx_IsEmptySector(Sector, 0, 0))
+		W25qxx_EraseSector(Sector);
+	return true;
+}
+//###################################################################################################################
+// Start is where the first chunk of the sector begins, after the tail of the previous one
+static void W25qxx_LzHeader(w25qxx_lz_t *Lz, uint32_t Sector, uint32_t First, uint16_t Start)
+{
+	uint8_t Data[6];
+	Data[0] = First;
+	Data[1] = First >> 8;
+	Data[2] = First >> 16;
+	Data[3] = First >> 24;
+	Data[4] = Start;
+	Data[5] = Start >> 8;
+	W25qxx_WriteBytes(Data, Sector * Lz->Device->SectorSize, 6);
+	Lz->Stats.OutBytes += 6;
+}
+//###################################################################################################################
+// packed bytes are collected in the tail page, only full pages are programmed
+static void W25qxx_LzAppend(w25qxx_lz_t *Lz, uint8_t *pBuffer, uint32_t Size)
+{
+	uint8_t *Tail = Lz->Work + (2 << W25QXX_LZ_HASH_BITS) + Lz->ChunkSize;
+	uint32_t PageSize = Lz->Device->PageSize;
+	uint32_t Part;
+	while (Size > 0)
+	{
+		Part = PageSize - (Lz->Used % PageSize);
+		if (Part > Size)
+			Part = Size;
+		memcpy(&Tail[Lz->Used % PageSize], pBuffer, Part);
+		Lz->Used += Part;
+		pBuffer += Part;
+		Size -= Part;
+		if (Lz->Used % PageSize == 0)
+		{
+			W25qxx_WriteBytes(&Tail[Lz->TailFrom % PageSize], Lz->Sector * Lz->Device->SectorSize + Lz->TailFrom, Lz->Used - Lz->TailFrom);
+			Lz->TailFrom = Lz->Used;
+		}
+	}
+}
+//###################################################################################################################
+static void W25qxx_LzFlushTail(w25qxx_lz_t *Lz)
+{
+	uint8_t *Tail = Lz->Work + (2 << W25QXX_LZ_HASH_BITS) + Lz->ChunkSize;
+	if (Lz->Used == Lz->TailFrom)
+		return;
+	W25qxx_WriteBytes(&Tail[Lz->TailFrom % Lz->Device->PageSize], Lz->Sector * Lz->Device->SectorSize + Lz->TailFrom, Lz->Used - Lz->TailFrom);
+	Lz->TailFrom = Lz->Used;
+}
+//###################################################################################################################
+// the entries not programmed yet, in one write
+static void W25qxx_LzFlushIndex(w25qxx_lz_t *Lz, uint32_t Sector)
+{
+	uint8_t Data[2 * W25QXX_LZ_SECTOR_CHUNKS];
+	uint8_t i;
+	if (Lz->Flushed == Lz->Entries)
+		return;
+	for (i = Lz->Flushed; i < Lz->Entries; i++)
+	{
+		Data[2 * i] = Lz->End[i];
+		Data[2 * i + 1] = Lz->End[i] >> 8;
+	}
+	W25qxx_WriteBytes(&Data[2 * Lz->Flushed], Sector * Lz->Device->SectorSize + 6 + 2 * Lz->Flushed, 2 * (Lz->Entries - Lz->Flushed));
+	Lz->Flushed = Lz->Entries;
+}
+//###################################################################################################################
+// a chunk may go on in the next sector, after its header
+static void W25qxx_LzReadPacked(w25qxx_lz_t *Lz, uint8_t *pBuffer, uint32_t Sector, uint16_t Start, uint16_t Length)
+{
+	uint32_t SectorSize = Lz->Device->SectorSize;
+	uint32_t Part = (Start + Length > SectorSize) ? SectorSize - Start : Length;
+	W25qxx_ReadBytes(pBuffer, Sector * SectorSize + Start, Part);
+	if (Part < Length)
+		W25qxx_ReadBytes(pBuffer + Part, (Sector + 1) * SectorSize + W25QXX_LZ_HEADER_SIZE, Length - Part);
+}
+//###################################################################################################################
+bool W25qxx_LzInit(w25qxx_lz_t *Lz, uint32_t FirstSector, uint32_t SectorCount, uint16_t ChunkSize, uint8_t *Work)
+{
+	uint32_t Lo, Hi, Mid;
+	uint16_t Start;
+	w25qxx_t *Device = W25qxx_GetDevice();
+	if ((SectorCount == 0) || (FirstSector + SectorCount > Device->SectorCount))
+		return false;
+	if ((ChunkSize < 16) || (ChunkSize > Device->SectorSize - W25QXX_LZ_HEADER_SIZE))
+		return false;
+	memset(Lz, 0, sizeof(w25qxx_lz_t));
+	Lz->Device = Device;
+	Lz->FirstSector = FirstSector;
+	Lz->SectorCount = SectorCount;
+	Lz->ChunkSize = ChunkSize;
+	Lz->Work = Work;
+	Lz->Erased = FirstSector + SectorCount;
+	memset(Work, 0, 2 << W25QXX_LZ_HASH_BITS);
+	// sectors are started in order, find the first one not started
+	Lo = FirstSector;
+	Hi = FirstSector + SectorCount;
+	while (Lo < Hi)
+	{
+		Mid = Lo + (Hi - Lo) / 2;
+		if (W25qxx_LzFirstChunk(Lz, Mid) != W25QXX_LZ_EMPTY)
+			Lo = Mid + 1;
+		else
+			Hi = Mid;
+	}
+	// power loss after the index entry of a chunk going on in sector Lo, its rest is programmed: start Lo
+	if ((Lo > FirstSector) && (Lo < FirstSector + SectorCount))
+	{
+		Lz->Entries = W25qxx_LzIndex(Lz, Lo - 1, &Lz->SectorFirst, &Start, Lz->End);
+		if ((Lz->Entries > 0) && ((Lz->End[Lz->Entries - 1] & W25QXX_LZ_END_MASK) > Device->SectorSize))
+		{
+			W25qxx_LzHeader(Lz, Lo, Lz->SectorFirst + Lz->Entries, W25QXX_LZ_HEADER_SIZE + (Lz->End[Lz->Entries - 1] & W25QXX_LZ_END_MASK) - Device->SectorSize);
+			Lo++;
+		}
+	}
+	Lz->Sector = Lo;
+	if (Lo == FirstSector)
+		return true;
+	// continue in the last started sector
+	Lz->Sector = Lo - 1;
+	Lz->Entries = W25qxx_LzIndex(Lz, Lz->Sector, &Lz->SectorFirst, &Start, Lz->End);
+	Lz->Flushed = Lz->Entries;
+	Lz->Used = (Lz->Entries > 0) ? (Lz->End[Lz->Entries - 1] & W25QXX_LZ_END_MASK) : Start;
+	Lz->TailFrom = Lz->Used;
+	Lz->ChunkCount = Lz->SectorFirst + Lz->Entries;
+	// data of a chunk without index entry (power loss) is in the way, go on in the next sector
+	if ((Lz->Entries == W25QXX_LZ_SECTOR_CHUNKS) || (Lz->Used >= Device->SectorSize) || !W25qxx_IsEmptySector(Lz->Sector, Lz->Used, Device->SectorSize - Lz->Used))
+	{
+		Lz->Sector++;
+		Lz->Used = 0;
+	}
+	return true;
+}
+//###################################################################################################################
+void W25qxx_LzFormat(w25qxx_lz_t *Lz)
+{
+	uint32_t Sector = Lz->FirstSector;
+	uint32_t End = Lz->FirstSector + Lz->SectorCount;
+	W25qxx_DeviceAcquire(Lz->Device);
+	while (Sector < End)
+	{
+		if ((Sector % 16 == 0) && (Sector + 16 <= End))
+		{
+			W25qxx_EraseBlock(W25qxx_SectorToBlock(Sector));
+			Sector += 16;
+		}
+		else
+			W25qxx_EraseSector(Sector++);
+	}
+	Lz->Erased = Lz->FirstSector;
+	Lz->ChunkCount = 0;
+	Lz->Sector = Lz->FirstSector;
+	Lz->SectorFirst = 0;
+	Lz->Used = 0;
+	Lz->Entries = 0;
+	W25qxx_DeviceRelease();
+}
+//###################################################################################################################
+static uint32_t W25qxx_LzWriteChunk(w25qxx_lz_t *Lz, uint8_t *pBuffer)
+{
+	uint8_t *Packed = Lz->Work + (2 << W25QXX_LZ_HASH_BITS);
+	uint32_t SectorSize = Lz->Device->SectorSize;
+	uint32_t Size, Part;
+	Size = W25qxx_LzCompress(pBuffer, Lz->ChunkSize, Packed, Lz->ChunkSize, (uint16_t *)Lz->Work);
+	if (Size == 0)
+	{
+		Packed = pBuffer;
+		Size = Lz->ChunkSize;
+	}
+	if ((Lz->Used != 0) && ((Lz->Used == SectorSize) || (Lz->Entries == W25QXX_LZ_SECTOR_CHUNKS)))
+	{
+		W25qxx_LzFlush(Lz);
+		Lz->Sector++;
+		Lz->Used = 0;
+	}
+	if (Lz->Used == 0)
+	{
+		if (!W25qxx_LzErase(Lz, Lz->Sector))
+			return W25QXX_LZ_EMPTY;
+		W25qxx_LzHeader(Lz, Lz->Sector, Lz->ChunkCount, W25QXX_LZ_HEADER_SIZE);
+		Lz->SectorFirst = Lz->ChunkCount;
+		Lz->Used = W25QXX_LZ_HEADER_SIZE;
+		Lz->TailFrom = Lz->Used;
+		Lz->Entries = 0;
+		Lz->Flushed = 0;
+	}
+	Part = SectorSize - Lz->Used;
+	if ((Size > Part) && (Lz->Sector + 1 >= Lz->FirstSector + Lz->SectorCount))
+		return W25QXX_LZ_EMPTY;
+	Lz->End[Lz->Entries++] = (Lz->Used + Size) | ((Packed == pBuffer) ? W25QXX_LZ_STORED : 0);
+	if (Size <= Part)
+		W25qxx_LzAppend(Lz, Packed, Size);
+	else
+	{
+		// the sector is programmed to its end and the rest after the header of the next one, then the
+		// index entry and last the header: a sector is not started before the chunk going on in it is complete
+		W25qxx_LzAppend(Lz, Packed, Part);
+		W25qxx_LzErase(Lz, Lz->Sector + 1);
+		Lz->Sector++;
+		Lz->Used = W25QXX_LZ_HEADER_SIZE;
+		Lz->TailFrom = Lz->Used;
+		W25qxx_LzAppend(Lz, Packed + Part, Size - Part);
+		W25qxx_LzFlushTail(Lz);
+		W25qxx_LzFlushIndex(Lz, Lz->Sector - 1);
+		W25qxx_LzHeader(Lz, Lz->Sector, Lz->ChunkCount + 1, W25QXX_LZ_HEADER_SIZE + Size - Part);
+		Lz->SectorFirst = Lz->ChunkCount + 1;
+		Lz->Entries = 0;
+		Lz->Flushed = 0;
+	}
+	Lz->Stats.Chunks++;
+	if (Packed == pBuffer)
+		Lz->Stats.StoredChunks++;
+	Lz->Stats.InBytes += Lz->ChunkSize;
+	Lz->Stats.OutBytes += Size + 2;
+	return Lz->ChunkCount++;
+}
+//###################################################################################################################
+uint32_t W25qxx_LzWrite(w25qxx_lz_t *Lz, uint8_t *pBuffer)
+{
+	uint32_t Chunk;
+	W25qxx_DeviceAcquire(Lz->Device);
+	Chunk = W25qxx_LzWriteChunk(Lz, pBuffer);
+	W25qxx_DeviceRelease();
+	return Chunk;
+}
+//###################################################################################################################
+void W25qxx_LzFlush(w25qxx_lz_t *Lz)
+{
+	if (Lz->Used == 0)
+		return;
+	W25qxx_DeviceAcquire(Lz->Device);
+	W25qxx_LzFlushTail(Lz);
+	W25qxx_LzFlushIndex(Lz, Lz->Sector);
+	// short index writes may wait in the driver write buffer
+	W25qxx_WriteFlush();
+	W25qxx_DeviceRelease();
+}
+//###################################################################################################################
+static bool W25qxx_LzReadChunk(w25qxx_lz_t *Lz, uint32_t Chunk, uint8_t *pBuffer)
+{
+	uint8_t *Packed = Lz->Work + (2 << W25QXX_LZ_HASH_BITS);
+	uint16_t End[W25QXX_LZ_SECTOR_CHUNKS];
+	uint32_t Sector, First, Lo, Hi, Mid;
+	uint16_t Start, Length;
+	uint8_t Count;
+	if (Chunk >= Lz->ChunkCount)
+		return false;
+	if ((Lz->Used != 0) && (Chunk >= Lz->SectorFirst + Lz->Flushed))
+		W25qxx_LzFlush(Lz);
+	if ((Lz->Used != 0) && (Chunk >= Lz->SectorFirst))
+		Sector = Lz->Sector;
+	else
+	{
+		// last started sector with FirstChunk <= Chunk
+		Lo = Lz->FirstSector;
+		Hi = Lz->Sector;
+		while (Hi - Lo > 1)
+		{
+			Mid = Lo + (Hi - Lo) / 2;
+			if (W25qxx_LzFirstChunk(Lz, Mid) <= Chunk)
+				Lo = Mid;
+			else
+				Hi = Mid;
+		}
+		Sector = Lo;
+	}
+	Count = W25qxx_LzIndex(Lz, Sector, &First, &Start, End);
+	if ((Chunk < First) || (Chunk - First >= Count))
+		return false;
+	if (Chunk > First)
+		Start = End[Chunk - First - 1] & W25QXX_LZ_END_MASK;
+	Length = (End[Chunk - First] & W25QXX_LZ_END_MASK) - Start;
+	if (Length > Lz->ChunkSize)
+		return false;
+	if (End[Chunk - First] & W25QXX_LZ_STORED)
+	{
+		W25qxx_LzReadPacked(Lz, pBuffer, Sector, Start, Length);
+		return (Length == Lz->ChunkSize);
+	}
+	W25qxx_LzReadPacked(Lz, Packed, Sector, Start, Length);
+	return (W25qxx_LzDecompress(Packed, Length, pBuffer, Lz->ChunkSize) == Lz->ChunkSize);
+}
+//###################################################################################################################
+bool W25qxx_LzRead(w25qxx_lz_t *Lz, uint32_t Chunk, uint8_t *pBuffer)
+{
+	bool Ok;
+	W25qxx_DeviceAcquire(Lz->Device);
+	Ok = W25qxx_LzReadChunk(Lz, Chunk, pBuffer);
+	W25qxx_DeviceRelease();
+	return Ok;
+}
+//###################################################################################################################
+void W25qxx_LzStats(w25qxx_lz_t *Lz, W25QXX_LzStats_t *Stats, bool Reset)
+{
+	if (Stats != NULL)
+		*Stats = Lz->Stats;
+	if (Reset)
+		memset(&Lz->Stats, 0, sizeof(W25QXX_LzStats_t));
+}
+//###################################################################################################################
@@ -0,0 +1,84 @@
+#ifndef _W25QXXLZ_H
+#define _W25QXXLZ_H
+
+/*
+  Compressed chunk log.
+
+  Data is appended in chunks of ChunkSize bytes. Each chunk is compressed (LZ4 block
+  format) and packed right after the previous one, chunks that do not shrink are stored
+  as they are, a chunk may go on in the next sector. Every sector starts with a small
+  index: the number of its first chunk, where it starts and the end offset of each chunk
+  starting in the sector, so chunk N is found with a few header reads and read back on
+  its own.
+
+  Sector: [FirstChunk 4][Start 2][End 2 x W25QXX_LZ_SECTOR_CHUNKS][packed chunks ...]
+
+  Packed data is programmed in whole pages, the last page and the index entries of the
+  sector are kept in RAM until the sector is full or W25qxx_LzFlush(). Index entries are
+  programmed after their data, chunks not flushed before a power loss are not seen on
+  the next W25qxx_LzInit(). A chunk going on in the next sector is complete before that
+  sector gets its header, W25qxx_LzInit() programs a header missing after a power loss. The region is not wrapped, W25qxx_LzWrite() fails when it
+  is full, W25qxx_LzFormat() starts it over.
+
+  Work is a caller buffer of W25QXX_LZ_WORK_SIZE(ChunkSize) bytes, 2 byte aligned, used
+  for the compressor hash table, the packed chunk and the last page. No malloc.
+*/
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "w25qxx.h"
+
+#define W25QXX_LZ_HASH_BITS 10
+#define W25QXX_LZ_SECTOR_CHUNKS 29
+#define W25QXX_LZ_HEADER_SIZE (6 + 2 * W25QXX_LZ_SECTOR_CHUNKS)
+#define W25QXX_LZ_WORK_SIZE(ChunkSize) ((2 << W25QXX_LZ_HASH_BITS) + (ChunkSize) + 256)
+
+	typedef struct
+	{
+		uint32_t Chunks; // written since init or reset
+		uint32_t StoredChunks; // of them, did not shrink and were stored as they are
+		uint32_t InBytes; // given to W25qxx_LzWrite()
+		uint32_t OutBytes; // programmed, data and index
+
+	} W25QXX_LzStats_t;
+
+	typedef struct
+	{
+		w25qxx_t *Device;
+		uint32_t FirstSector;
+		uint32_t SectorCount;
+		uint16_t ChunkSize; // up to SectorSize - W25QXX_LZ_HEADER_SIZE
+		uint8_t *Work;
+		uint32_t ChunkCount; // chunks in the log
+		uint32_t Sector; // sector being filled
+		uint32_t Erased; // sectors from here on are known to be erased (W25qxx_LzFormat)
+		uint32_t SectorFirst; // number of its first chunk
+		uint16_t Used; // bytes used in it, 0 = not started
+		uint16_t TailFrom; // bytes programmed in it, the rest is in the last page of Work
+		uint8_t Entries; // chunks starting in it
+		uint8_t Flushed; // of them, index entry programmed
+		uint16_t End[W25QXX_LZ_SECTOR_CHUNKS]; // index of the sector
+		W25QXX_LzStats_t Stats;
+
+	} w25qxx_lz_t;
+
+	// finds the end of the log in the region, works on the selected chip
+	bool W25qxx_LzInit(w25qxx_lz_t *Lz, uint32_t FirstSector, uint32_t SectorCount, uint16_t ChunkSize, uint8_t *Work);
+	// erases the region, the log is empty after
+	void W25qxx_LzFormat(w25qxx_lz_t *Lz);
+	// appends ChunkSize bytes, returns the chunk number or 0xFFFFFFFF when the region is full
+	uint32_t W25qxx_LzWrite(w25qxx_lz_t *Lz, uint8_t *pBuffer);
+	// programs the last page and the index entries kept in RAM
+	void W25qxx_LzFlush(w25qxx_lz_t *Lz);
+	// reads chunk number Chunk back into pBuffer (ChunkSize bytes)
+	bool W25qxx_LzRead(w25qxx_lz_t *Lz, uint32_t Chunk, uint8_t *pBuffer);
+	void W25qxx_LzStats(w25qxx_lz_t *Lz, W25QXX_LzStats_t *Stats, bool Reset);
+//############################################################################
+#ifdef __cplusplus
+}
+#endif
+
+#endif
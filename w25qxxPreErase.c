@@ -0,0 +1,107 @@
+
+#include "w25qxxPreErase.h"
+
+#include <string.h>
+
+//###################################################################################################################
+static uint32_t W25qxx_PreEraseAhead(w25qxx_preerase_t *Pool, uint32_t Count)
+{
+	return Pool->FirstSector + (Pool->WriteSector - Pool->FirstSector + Count) % Pool->SectorCount;
+}
+//###################################################################################################################
+bool W25qxx_PreEraseInit(w25qxx_preerase_t *Pool, uint32_t FirstSector, uint32_t SectorCount, uint32_t Depth, uint32_t WriteSector)
+{
+	w25qxx_t *Device = W25qxx_GetDevice();
+	if ((SectorCount < 2) || (Depth >= SectorCount) || (FirstSector + SectorCount > Device->SectorCount))
+		return false;
+	if ((WriteSector < FirstSector) || (WriteSector >= FirstSector + SectorCount))
+		return false;
+	memset(Pool, 0, sizeof(w25qxx_preerase_t));
+	Pool->Device = Device;
+	Pool->FirstSector = FirstSector;
+	Pool->SectorCount = SectorCount;
+	Pool->Depth = Depth;
+	Pool->WriteSector = WriteSector;
+	Pool->Erasing = W25QXX_PREERASE_NONE;
+	Pool->Stats.MinReady = 0xFFFFFFFF;
+	return true;
+}
+//###################################################################################################################
+static bool W25qxx_PreEraseStep(w25qxx_preerase_t *Pool)
+{
+	uint32_t Sector;
+	if (Pool->Erasing != W25QXX_PREERASE_NONE)
+	{
+		W25qxx_EraseResume();
+		// its own erase, programs and erases of others on the chip do not hold the pool up
+		if (W25qxx_IsErasing(Pool->Erasing))
+			return true;
+		Pool->Erasing = W25QXX_PREERASE_NONE;
+		Pool->Ready++;
+		Pool->Stats.Erased++;
+	}
+	if (Pool->Ready >= Pool->Depth)
+		return false;
+	Sector = W25qxx_PreEraseAhead(Pool, Pool->Ready + 1);
+	// after init the sectors ahead are often blank already
+	if (W25qxx_IsEmptySector(Sector, 0, 0))
+	{
+		Pool->Ready++;
+		Pool->Stats.Skipped++;
+		return (Pool->Ready < Pool->Depth);
+	}
+	W25qxx_EraseSectorBackground(Sector);
+	Pool->Erasing = Sector;
+	return true;
+}
+//###################################################################################################################
+bool W25qxx_PreEraseIdle(w25qxx_preerase_t *Pool)
+{
+	W25qxx_DeviceAcquire(Pool->Device);
+	bool More = W25qxx_PreEraseStep(Pool);
+	W25qxx_DeviceRelease();
+	return More;
+}
+//###################################################################################################################
+uint32_t W25qxx_PreEraseNext(w25qxx_preerase_t *Pool)
+{
+	uint32_t Sector = W25qxx_PreEraseAhead(Pool, 1);
+	W25qxx_DeviceAcquire(Pool->Device);
+	Pool->Stats.Advances++;
+	if (Pool->Ready < Pool->Stats.MinReady)
+		Pool->Stats.MinReady = Pool->Ready;
+	if (Pool->Ready == 0)
+	{
+		uint32_t StartTime = HAL_GetTick();
+		if (Pool->Erasing == Sector)
+		{
+			W25qxx_WaitReady();
+			Pool->Erasing = W25QXX_PREERASE_NONE;
+			Pool->Stats.Erased++;
+		}
+		else
+			W25qxx_EraseSector(Sector);
+		Pool->Ready = 1;
+		StartTime = HAL_GetTick() - StartTime;
+		Pool->Stats.Stalls++;
+		Pool->Stats.StallTime += StartTime;
+		if (StartTime > Pool->Stats.StallTimeMax)
+			Pool->Stats.StallTimeMax = StartTime;
+	}
+	Pool->WriteSector = Sector;
+	Pool->Ready--;
+	W25qxx_DeviceRelease();
+	return Sector;
+}
+//###################################################################################################################
+void W25qxx_PreEraseStats(w25qxx_preerase_t *Pool, W25QXX_PreEraseStats_t *Stats, bool Reset)
+{
+	if (Stats != NULL)
+		*Stats = Pool->Stats;
+	if (Reset)
+	{
+		memset(&Pool->Stats, 0, sizeof(W25QXX_PreEraseStats_t));
+		Pool->Stats.MinReady = 0xFFFFFFFF;
+	}
+}
+//###################################################################################################################
@@ -0,0 +1,67 @@
+#ifndef _W25QXXPREERASE_H
+#define _W25QXXPREERASE_H
+
+/*
+  Pre-erase pool for append writers (logs, ring buffers).
+
+  The region FirstSector .. FirstSector + SectorCount - 1 is written as a ring, one sector
+  after the other. W25qxx_PreEraseIdle() keeps up to Depth sectors after the write sector
+  erased, one background erase at a time. W25qxx_PreEraseNext() hands the writer the next
+  sector, it only waits (a stall) when the idle calls did not keep up.
+
+  With _W25QXX_USE_ERASE_SUSPEND the writer's reads and programs suspend the background
+  erase and the next idle call resumes it, so the erase runs in the gaps between writes.
+  Without it, a write during a background erase waits for it, call the idle function
+  where the writer has time (for example right after a burst).
+
+  Call W25qxx_PreEraseIdle() and W25qxx_PreEraseNext() from the same task. The pool
+  selects its chip by itself, like the volume layer.
+*/
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "w25qxx.h"
+
+#define W25QXX_PREERASE_NONE 0xFFFFFFFF
+
+	typedef struct
+	{
+		uint32_t Advances; // W25qxx_PreEraseNext() calls
+		uint32_t Stalls; // of them, had to wait for or run an erase
+		uint32_t StallTime; // ms, summed
+		uint32_t StallTimeMax; // ms
+		uint32_t Erased; // background erases finished
+		uint32_t Skipped; // sectors found blank, not erased
+		uint32_t MinReady; // fewest erased sectors ahead seen on advance
+
+	} W25QXX_PreEraseStats_t;
+
+	typedef struct
+	{
+		w25qxx_t *Device;
+		uint32_t FirstSector;
+		uint32_t SectorCount;
+		uint32_t Depth; // sectors kept erased ahead, can be changed at any time, less than SectorCount
+		uint32_t WriteSector; // sector the writer fills now
+		uint32_t Ready; // erased sectors after WriteSector
+		uint32_t Erasing; // background erase running, W25QXX_PREERASE_NONE if none
+		W25QXX_PreEraseStats_t Stats;
+
+	} w25qxx_preerase_t;
+
+	// WriteSector is where the writer is now (from its own recovery), the sectors after it are not trusted
+	bool W25qxx_PreEraseInit(w25qxx_preerase_t *Pool, uint32_t FirstSector, uint32_t SectorCount, uint32_t Depth, uint32_t WriteSector);
+	// one step, never waits for an erase. returns true while there is work left
+	bool W25qxx_PreEraseIdle(w25qxx_preerase_t *Pool);
+	// the writer is done with WriteSector, returns the next one, already erased
+	uint32_t W25qxx_PreEraseNext(w25qxx_preerase_t *Pool);
+	void W25qxx_PreEraseStats(w25qxx_preerase_t *Pool, W25QXX_PreEraseStats_t *Stats, bool Reset);
+//############################################################################
+#ifdef __cplusplus
+}
+#endif
+
+#endif
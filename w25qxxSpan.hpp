@@ -0,0 +1,282 @@
+#ifndef _W25QXXSPAN_HPP
+#define _W25QXXSPAN_HPP
+
+/*
+  C++ read-only view of a table in flash, so standard algorithms work on it in place:
+
+    w25q::flash_block_cache<1024> Cache;
+    w25q::flash_span<Entry_t> Table(0x100000, EntryCount, Cache);
+    auto It = std::lower_bound(Table.begin(), Table.end(), Key, Less);
+
+  Elements are read through a small cache of lines, each line holds whole elements
+  (LineSize / sizeof(T) of them) and is filled with one Fast Read (W25qxx_ReadV(), no
+  delay after it and not through the driver read cache).
+  An element access is a cache hit or one read of at most LineSize bytes, elements
+  bigger than a line are read alone. Lines are found by hash in sets of 4 and replaced
+  by CLOCK like the driver read cache: new lines start unreferenced, so a std::find_if
+  over the whole table does not push out the lines binary searches keep using.
+
+  Iterators are random access and return elements by value (T is trivially copyable):
+  reference is T, not T &, and It->Field works on a copy held by a proxy. Algorithms that
+  only read, like the searches, take them; ones that write through the iterator or keep
+  the address of *It do not.
+  A cache reads from the chip selected when it was made, every span using it has to be on
+  that chip (asserted when the span is made). The cache does not see writes: call
+  invalidate() after changing the table.
+*/
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+#include "w25qxx.h"
+
+namespace w25q
+{
+	struct flash_cache_stats
+	{
+		uint32_t Hits;
+		uint32_t Misses;
+		uint32_t Bytes; // read from the chip
+
+	};
+
+	class flash_cache
+	{
+	public:
+		static const uint32_t Ways = 4;
+
+		// the line pointers go into the storage of the derived cache, a copy would use the original one
+		flash_cache(const flash_cache &) = delete;
+		flash_cache &operator=(const flash_cache &) = delete;
+
+		uint32_t line_size() const { return LineSize; }
+		// the chip it reads from
+		w25qxx_t *device() const { return Device; }
+
+		// Size bytes at Offset of the line starting at Address, Bytes long (up to line_size())
+		void get(void *pBuffer, uint32_t Address, uint32_t Bytes, uint32_t Offset, uint32_t Size)
+		{
+			// binary search probes share their low address bits, the high bits of the product spread them
+			uint32_t Hash = (Address / LineSize) * 2654435761u;
+			uint32_t Set = (Hash ^ (Hash >> 16)) % Sets;
+			line_t *Line = &Lines[Set * Ways];
+			uint32_t i;
+			for (i = 0; i < Ways; i++)
+			{
+				if ((Line[i].Address == Address) && (Line[i].Bytes == Bytes))
+					break;
+			}
+			if (i < Ways)
+			{
+				Line[i].Ref = 1;
+				Stats.Hits++;
+			}
+			else
+			{
+				// CLOCK in the set
+				while (Line[Hand[Set]].Ref == 1)
+				{
+					Line[Hand[Set]].Ref = 0;
+					Hand[Set] = (Hand[Set] + 1) % Ways;
+				}
+				i = Hand[Set];
+				Hand[Set] = (Hand[Set] + 1) % Ways;
+				read(&Data[(Set * Ways + i) * LineSize], Address, Bytes);
+				Line[i].Address = Address;
+				Line[i].Bytes = Bytes;
+				Line[i].Ref = 0;
+				Stats.Misses++;
+			}
+			memcpy(pBuffer, &Data[(Set * Ways + i) * LineSize + Offset], Size);
+		}
+
+		// not cached, for elements bigger than a line
+		void read(void *pBuffer, uint32_t Address, uint32_t Size)
+		{
+			W25QXX_IoVec_t Iov = {(uint8_t *)pBuffer, Size};
+			W25qxx_DeviceAcquire(Device);
+			W25qxx_ReadV(Address, &Iov, 1);
+			W25qxx_DeviceRelease();
+			Stats.Bytes += Size;
+		}
+
+		void invalidate()
+		{
+			for (uint32_t i = 0; i < Sets * Ways; i++)
+			{
+				Lines[i].Bytes = 0;
+				Lines[i].Ref = 0;
+			}
+			for (uint32_t i = 0; i < Sets; i++)
+				Hand[i] = 0;
+		}
+
+		void stats(flash_cache_stats *pStats, bool Reset)
+		{
+			if (pStats != NULL)
+				*pStats = Stats;
+			if (Reset)
+				memset(&Stats, 0, sizeof(Stats));
+		}
+
+	protected:
+		struct line_t
+		{
+			uint32_t Address;
+			uint16_t Bytes; // 0 = empty
+			uint8_t Ref;
+
+		};
+
+		// works on the chip selected now
+		flash_cache(uint8_t *pData, line_t *pLines, uint8_t *pHand, uint32_t LineCount, uint32_t LineBytes)
+			: Device(W25qxx_GetDevice()), Data(pData), Lines(pLines), Hand(pHand), Sets(LineCount / Ways), LineSize(LineBytes)
+		{
+			memset(&Stats, 0, sizeof(Stats));
+		}
+
+	private:
+		w25qxx_t *Device;
+		uint8_t *Data;
+		line_t *Lines;
+		uint8_t *Hand; // per set
+		uint32_t Sets;
+		uint32_t LineSize;
+		flash_cache_stats Stats;
+	};
+
+	// CacheBytes of line data plus 8 bytes per line, at least 4 lines. binary searches do best
+	// with lines of one or two elements, scans with longer ones
+	template <size_t CacheBytes, size_t LineBytes = 16>
+	class flash_block_cache : public flash_cache
+	{
+		static_assert((LineBytes > 0) && (LineBytes <= 0xFFFF), "line size out of range");
+		static_assert(CacheBytes / LineBytes >= flash_cache::Ways, "room for at least one set of lines");
+
+	public:
+		flash_block_cache() : flash_cache(Storage, Table, Hands, CacheBytes / LineBytes, LineBytes)
+		{
+			invalidate();
+		}
+
+	private:
+		uint8_t Storage[CacheBytes / LineBytes / Ways * Ways * LineBytes];
+		line_t Table[CacheBytes / LineBytes / Ways * Ways];
+		uint8_t Hands[CacheBytes / LineBytes / Ways];
+	};
+
+	template <typename T>
+	class flash_span
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "elements are copied from flash");
+
+	public:
+		typedef T value_type;
+		typedef uint32_t size_type;
+		typedef ptrdiff_t difference_type;
+
+		class iterator
+		{
+		public:
+			typedef std::random_access_iterator_tag iterator_category;
+			typedef T value_type;
+			typedef ptrdiff_t difference_type;
+			typedef T reference; // by value, nothing to point to in RAM
+
+			// It->Field: the element copied, alive until the end of the expression
+			class pointer
+			{
+			public:
+				explicit pointer(const T &Element) : Value(Element) {}
+				const T *operator->() const { return &Value; }
+
+			private:
+				T Value;
+			};
+
+			iterator() : Span(NULL), Index(0) {}
+			iterator(const flash_span *pSpan, uint32_t Position) : Span(pSpan), Index(Position) {}
+
+			T operator*() const { return (*Span)[Index]; }
+			T operator[](difference_type n) const { return (*Span)[Index + n]; }
+			pointer operator->() const { return pointer((*Span)[Index]); }
+
+			iterator &operator++() { Index++; return *this; }
+			iterator operator++(int) { iterator Old = *this; Index++; return Old; }
+			iterator &operator--() { Index--; return *this; }
+			iterator operator--(int) { iterator Old = *this; Index--; return Old; }
+			iterator &operator+=(difference_type n) { Index += n; return *this; }
+			iterator &operator-=(difference_type n) { Index -= n; return *this; }
+			iterator operator+(difference_type n) const { return iterator(Span, Index + n); }
+			iterator operator-(difference_type n) const { return iterator(Span, Index - n); }
+			friend iterator operator+(difference_type n, const iterator &It) { return It + n; }
+			difference_type operator-(const iterator &Other) const { return (difference_type)Index - (difference_type)Other.Index; }
+
+			bool operator==(const iterator &Other) const { return Index == Other.Index; }
+			bool operator!=(const iterator &Other) const { return Index != Other.Index; }
+			bool operator<(const iterator &Other) const { return Index < Other.Index; }
+			bool operator>(const iterator &Other) const { return Index > Other.Index; }
+			bool operator<=(const iterator &Other) const { return Index <= Other.Index; }
+			bool operator>=(const iterator &Other) const { return Index >= Other.Index; }
+
+			// position in the span, for results of algorithms
+			uint32_t index() const { return Index; }
+
+		private:
+			const flash_span *Span;
+			uint32_t Index;
+		};
+		typedef iterator const_iterator;
+
+		// Length elements of T from chip address Start on, on the selected chip: the one of LineCache
+		flash_span(uint32_t Start, uint32_t Length, flash_cache &LineCache)
+			: Address(Start), Count(Length), Cache(&LineCache), PerLine(LineCache.line_size() / sizeof(T))
+		{
+			assert(LineCache.device() == W25qxx_GetDevice());
+		}
+
+		T operator[](uint32_t Index) const
+		{
+			T Value;
+			uint32_t Line, First;
+			if (PerLine == 0)
+			{
+				Cache->read(&Value, Address + Index * sizeof(T), sizeof(T));
+				return Value;
+			}
+			// the last line ends with the span
+			Line = Index / PerLine;
+			First = Line * PerLine;
+			Cache->get(&Value, Address + First * sizeof(T), ((Count - First < PerLine) ? Count - First : PerLine) * sizeof(T),
+					   (Index - First) * sizeof(T), sizeof(T));
+			return Value;
+		}
+
+		iterator begin() const { return iterator(this, 0); }
+		iterator end() const { return iterator(this, Count); }
+		uint32_t size() const { return Count; }
+		bool empty() const { return Count == 0; }
+		T front() const { return (*this)[0]; }
+		T back() const { return (*this)[Count - 1]; }
+		// chip address of element 0
+		uint32_t address() const { return Address; }
+		flash_span subspan(uint32_t Offset, uint32_t Length) const
+		{
+			flash_span Part(*this);
+			Part.Address += Offset * sizeof(T);
+			Part.Count = Length;
+			return Part;
+		}
+
+	private:
+		uint32_t Address;
+		uint32_t Count;
+		flash_cache *Cache;
+		uint32_t PerLine; // elements per cache line, 0 when they do not fit
+	};
+}
+
+#endif
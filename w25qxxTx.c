@@ -0,0 +1,395 @@
+
+#include "w25qxxTx.h"
+
+#include <string.h>
+
+#if (_W25QXX_USE_FREERTOS == 1)
+#include "cmsis_os.h"
+#define W25qxx_TxDelay(delay) osDelay(delay)
+#define W25qxx_TxEnterCritical() taskENTER_CRITICAL()
+#define W25qxx_TxExitCritical() taskEXIT_CRITICAL()
+#else
+#define W25qxx_TxDelay(delay) HAL_Delay(delay)
+#define W25qxx_TxEnterCritical()
+#define W25qxx_TxExitCritical()
+#endif
+
+#define W25QXX_TX_MAGIC 0x58543257 // "W2TX"
+#define W25QXX_TX_HEADER_SIZE 16
+#define W25QXX_TX_APPLIED 252 // offset of the applied mark in the journal page
+
+//###################################################################################################################
+static uint32_t W25qxx_TxCrc(uint32_t Crc, const uint8_t *pData, uint32_t Size)
+{
+	Crc = ~Crc;
+	while (Size-- > 0)
+	{
+		Crc ^= *pData++;
+		for (uint8_t i = 0; i < 8; i++)
+			Crc = (Crc >> 1) ^ (0xEDB88320 & (0 - (Crc & 1)));
+	}
+	return ~Crc;
+}
+//###################################################################################################################
+static uint32_t W25qxx_TxPagesPerSector(w25qxx_txlog_t *Log)
+{
+	return Log->Device->SectorSize / Log->Device->PageSize;
+}
+//###################################################################################################################
+static W25QXX_TxEntry_t *W25qxx_TxFind(w25qxx_tx_t *Tx, uint32_t Home)
+{
+	for (uint8_t i = 0; i < Tx->Count; i++)
+	{
+		if (Tx->Entry[i].Home == Home)
+			return &Tx->Entry[i];
+	}
+	return NULL;
+}
+//###################################################################################################################
+// shadows are taken by writing tasks and given back by the one writing the journal
+static uint32_t W25qxx_TxShadowTake(w25qxx_txlog_t *Log)
+{
+	uint32_t Index, Shadow = 0xFFFFFFFF;
+	W25qxx_TxEnterCritical();
+	for (uint32_t i = 0; i < Log->ShadowCount; i++)
+	{
+		Index = (Log->ShadowNext + i) % Log->ShadowCount;
+		if ((Log->ShadowUsed & (1UL << Index)) == 0)
+		{
+			Log->ShadowUsed |= (1UL << Index);
+			Log->ShadowNext = (Index + 1) % Log->ShadowCount;
+			Shadow = Log->ShadowSector + Index;
+			break;
+		}
+	}
+	W25qxx_TxExitCritical();
+	return Shadow;
+}
+//###################################################################################################################
+static void W25qxx_TxShadowGive(w25qxx_txlog_t *Log, uint32_t Shadow)
+{
+	W25qxx_TxEnterCritical();
+	Log->ShadowUsed &= ~(1UL << (Shadow - Log->ShadowSector));
+	W25qxx_TxExitCritical();
+}
+//###################################################################################################################
+// copies sector From to sector To page by page, returns the crc of the content
+static uint32_t W25qxx_TxCopy(w25qxx_txlog_t *Log, uint32_t From, uint32_t To, bool Program)
+{
+	uint32_t Crc = 0;
+	uint32_t Pages = W25qxx_TxPagesPerSector(Log);
+	uint32_t i;
+	for (uint32_t Page = 0; Page < Pages; Page++)
+	{
+		W25qxx_ReadPage(Log->Buffer, W25qxx_SectorToPage(From) + Page, 0, 0);
+		Crc = W25qxx_TxCrc(Crc, Log->Buffer, Log->Device->PageSize);
+		if (Program == false)
+			continue;
+		for (i = 0; (i < Log->Device->PageSize) && (Log->Buffer[i] == 0xFF); i++)
+			;
+		if (i < Log->Device->PageSize)
+			W25qxx_WritePage(Log->Buffer, W25qxx_SectorToPage(To) + Page, 0, 0);
+	}
+	return Crc;
+}
+//###################################################################################################################
+// the new content of one sector: Source (home or an older shadow) with the written bytes on top
+static bool W25qxx_TxStage(w25qxx_txlog_t *Log, w25qxx_tx_t *Tx, uint32_t Home, uint32_t Offset, uint8_t *pBuffer, uint32_t Size)
+{
+	W25QXX_TxEntry_t *Entry = W25qxx_TxFind(Tx, Home);
+	uint32_t Source = (Entry != NULL) ? Entry->Shadow : Home;
+	uint32_t Pages = W25qxx_TxPagesPerSector(Log);
+	uint32_t PageSize = Log->Device->PageSize;
+	uint32_t Shadow, Crc = 0, From, To, i;
+	if ((Entry == NULL) && (Tx->Count == W25QXX_TX_MAX_SECTORS))
+		return false;
+	if ((Home - Log->JournalSector < Log->JournalCount) || (Home - Log->ShadowSector < Log->ShadowCount))
+		return false;
+	Shadow = W25qxx_TxShadowTake(Log);
+	if (Shadow == 0xFFFFFFFF)
+		return false;
+	W25qxx_EraseSector(Shadow);
+	for (uint32_t Page = 0; Page < Pages; Page++)
+	{
+		W25qxx_ReadPage(Log->Buffer, W25qxx_SectorToPage(Source) + Page, 0, 0);
+		From = (Offset > Page * PageSize) ? Offset : Page * PageSize;
+		To = ((Offset + Size) < (Page + 1) * PageSize) ? (Offset + Size) : (Page + 1) * PageSize;
+		if (From < To)
+			memcpy(&Log->Buffer[From - Page * PageSize], &pBuffer[From - Offset], To - From);
+		Crc = W25qxx_TxCrc(Crc, Log->Buffer, PageSize);
+		for (i = 0; (i < PageSize) && (Log->Buffer[i] == 0xFF); i++)
+			;
+		if (i < PageSize)
+			W25qxx_WritePage(Log->Buffer, W25qxx_SectorToPage(Shadow) + Page, 0, 0);
+	}
+	if (Entry != NULL)
+		W25qxx_TxShadowGive(Log, Entry->Shadow);
+	else
+	{
+		Entry = &Tx->Entry[Tx->Count++];
+		Entry->Home = Home;
+	}
+	Entry->Shadow = Shadow;
+	Entry->Crc = Crc;
+	return true;
+}
+//###################################################################################################################
+static void W25qxx_TxApply(w25qxx_txlog_t *Log, W25QXX_TxEntry_t *Entry)
+{
+	W25qxx_EraseSector(Entry->Home);
+	W25qxx_TxCopy(Log, Entry->Shadow, Entry->Home, true);
+}
+//###################################################################################################################
+static void W25qxx_TxMarkApplied(uint32_t Page)
+{
+	uint32_t Applied = 0;
+	W25qxx_WritePage((uint8_t *)&Applied, Page, W25QXX_TX_APPLIED, sizeof(Applied));
+}
+//###################################################################################################################
+// reads the journal page into Buffer, true if it is a complete record
+static bool W25qxx_TxReadRecord(w25qxx_txlog_t *Log, uint32_t Page, uint32_t *Header)
+{
+	W25qxx_ReadBytes((uint8_t *)Header, Page * Log->Device->PageSize, W25QXX_TX_HEADER_SIZE);
+	if ((Header[0] != W25QXX_TX_MAGIC) || (Header[2] == 0) || (Header[2] > W25QXX_TX_RECORD_ENTRIES))
+		return false;
+	W25qxx_ReadPage(Log->Buffer, Page, 0, 0);
+	return (W25qxx_TxCrc(W25qxx_TxCrc(0, Log->Buffer, 12), &Log->Buffer[W25QXX_TX_HEADER_SIZE], Header[2] * sizeof(W25QXX_TxEntry_t)) == Header[3]);
+}
+//###################################################################################################################
+bool W25qxx_TxMount(w25qxx_txlog_t *Log, uint32_t JournalSector, uint32_t JournalCount, uint32_t ShadowSector, uint32_t ShadowCount)
+{
+	w25qxx_t *Device = W25qxx_GetDevice();
+	uint32_t Header[4];
+	uint32_t First, Pages, Last = 0xFFFFFFFF, Applied, Damaged = 0;
+	W25QXX_TxEntry_t Entry;
+	if ((JournalCount < 2) || (ShadowCount == 0) || (ShadowCount > 32) || (Device->PageSize != sizeof(Log->Buffer)))
+		return false;
+	if ((JournalSector + JournalCount > Device->SectorCount) || (ShadowSector + ShadowCount > Device->SectorCount))
+		return false;
+	memset(Log, 0, sizeof(w25qxx_txlog_t));
+	Log->Device = Device;
+	Log->JournalSector = JournalSector;
+	Log->JournalCount = JournalCount;
+	Log->ShadowSector = ShadowSector;
+	Log->ShadowCount = ShadowCount;
+	First = W25qxx_SectorToPage(JournalSector);
+	Pages = JournalCount * W25qxx_TxPagesPerSector(Log);
+	// newest complete record
+	for (uint32_t Page = First; Page < First + Pages; Page++)
+	{
+		if (W25qxx_TxReadRecord(Log, Page, Header) == false)
+			continue;
+		if ((Last == 0xFFFFFFFF) || ((int32_t)(Header[1] - Log->Sequence) > 0))
+		{
+			Last = Page;
+			Log->Sequence = Header[1];
+		}
+	}
+	Log->Page = First;
+	if (Last == 0xFFFFFFFF)
+		return true;
+	W25qxx_TxReadRecord(Log, Last, Header);
+	W25qxx_ReadBytes((uint8_t *)&Applied, Last * Device->PageSize + W25QXX_TX_APPLIED, sizeof(Applied));
+	// any bit of the mark programmed: the copies were done before
+	if (Applied == 0xFFFFFFFF)
+	{
+		// all shadows or none: a damaged one leaves the record as it is
+		for (uint32_t i = 0; i < Header[2]; i++)
+		{
+			W25qxx_TxReadRecord(Log, Last, Header);
+			memcpy(&Entry, &Log->Buffer[W25QXX_TX_HEADER_SIZE + i * sizeof(W25QXX_TxEntry_t)], sizeof(Entry));
+			if (W25qxx_TxCopy(Log, Entry.Shadow, 0, false) != Entry.Crc)
+				Damaged++;
+		}
+		if (Damaged > 0)
+		{
+			Log->Stats.CrcErrors += Damaged;
+			return false;
+		}
+		for (uint32_t i = 0; i < Header[2]; i++)
+		{
+			W25qxx_TxReadRecord(Log, Last, Header);
+			memcpy(&Entry, &Log->Buffer[W25QXX_TX_HEADER_SIZE + i * sizeof(W25QXX_TxEntry_t)], sizeof(Entry));
+			W25qxx_TxApply(Log, &Entry);
+		}
+		W25qxx_TxMarkApplied(Last);
+		Log->Stats.Recovered++;
+	}
+	// after the record, pages a power loss left half programmed are skipped
+	Log->Page = First + (Last - First + 1) % Pages;
+	while (((Log->Page % W25qxx_TxPagesPerSector(Log)) != 0) && (W25qxx_IsEmptyPage(Log->Page, 0, 0) == false))
+		Log->Page = First + (Log->Page - First + 1) % Pages;
+	return true;
+}
+//###################################################################################################################
+void W25qxx_TxBegin(w25qxx_txlog_t *Log, w25qxx_tx_t *Tx)
+{
+	(void)Log;
+	Tx->State = W25QXX_TX_OPEN;
+	Tx->Count = 0;
+	Tx->Next = NULL;
+}
+//###################################################################################################################
+bool W25qxx_TxWrite(w25qxx_txlog_t *Log, w25qxx_tx_t *Tx, uint8_t *pBuffer, uint32_t WriteAddr, uint32_t NumByteToWrite)
+{
+	uint32_t SectorSize = Log->Device->SectorSize;
+	uint32_t Chunk;
+	bool Ok = true;
+	if (Tx->State != W25QXX_TX_OPEN)
+		return false;
+	W25qxx_DeviceAcquire(Log->Device);
+	while ((NumByteToWrite > 0) && (Ok == true))
+	{
+		Chunk = SectorSize - (WriteAddr % SectorSize);
+		if (Chunk > NumByteToWrite)
+			Chunk = NumByteToWrite;
+		Ok = W25qxx_TxStage(Log, Tx, WriteAddr / SectorSize, WriteAddr % SectorSize, pBuffer, Chunk);
+		pBuffer += Chunk;
+		WriteAddr += Chunk;
+		NumByteToWrite -= Chunk;
+	}
+	W25qxx_DeviceRelease();
+	return Ok;
+}
+//###################################################################################################################
+void W25qxx_TxRead(w25qxx_txlog_t *Log, w25qxx_tx_t *Tx, uint8_t *pBuffer, uint32_t ReadAddr, uint32_t NumByteToRead)
+{
+	uint32_t SectorSize = Log->Device->SectorSize;
+	W25QXX_TxEntry_t *Entry;
+	uint32_t Chunk;
+	W25qxx_DeviceAcquire(Log->Device);
+	while (NumByteToRead > 0)
+	{
+		Chunk = SectorSize - (ReadAddr % SectorSize);
+		if (Chunk > NumByteToRead)
+			Chunk = NumByteToRead;
+		Entry = W25qxx_TxFind(Tx, ReadAddr / SectorSize);
+		if (Entry != NULL)
+			W25qxx_ReadBytes(pBuffer, Entry->Shadow * SectorSize + ReadAddr % SectorSize, Chunk);
+		else
+			W25qxx_ReadBytes(pBuffer, ReadAddr, Chunk);
+		pBuffer += Chunk;
+		ReadAddr += Chunk;
+		NumByteToRead -= Chunk;
+	}
+	W25qxx_DeviceRelease();
+}
+//###################################################################################################################
+void W25qxx_TxAbort(w25qxx_txlog_t *Log, w25qxx_tx_t *Tx)
+{
+	if (Tx->State != W25QXX_TX_OPEN)
+		return;
+	for (uint8_t i = 0; i < Tx->Count; i++)
+		W25qxx_TxShadowGive(Log, Tx->Entry[i].Shadow);
+	Tx->Count = 0;
+	Tx->State = W25QXX_TX_IDLE;
+}
+//###################################################################################################################
+bool W25qxx_TxCommit(w25qxx_txlog_t *Log, w25qxx_tx_t *Tx, bool Wait)
+{
+	w25qxx_tx_t **Link = &Log->Queue;
+	if (Tx->State != W25QXX_TX_OPEN)
+		return false;
+	if (Tx->Count == 0)
+	{
+		Tx->State = W25QXX_TX_DONE;
+		return true;
+	}
+	Tx->Next = NULL;
+	Tx->State = W25QXX_TX_READY;
+	W25qxx_TxEnterCritical();
+	while (*Link != NULL)
+		Link = &(*Link)->Next;
+	*Link = Tx;
+	W25qxx_TxExitCritical();
+	if (Wait == false)
+		return true;
+	// the task writing the journal takes this one along, or this task writes it
+	while (Tx->State == W25QXX_TX_READY)
+	{
+		if (Log->Busy == 0)
+			W25qxx_TxSync(Log);
+		else
+			W25qxx_TxDelay(1);
+	}
+	return true;
+}
+//###################################################################################################################
+void W25qxx_TxSync(w25qxx_txlog_t *Log)
+{
+	w25qxx_tx_t *Tx, *Group, *End, *Next;
+	uint32_t Count, Header[4];
+	uint32_t First = W25qxx_SectorToPage(Log->JournalSector);
+	uint32_t Pages = Log->JournalCount * W25qxx_TxPagesPerSector(Log);
+	W25qxx_TxEnterCritical();
+	if (Log->Busy == 1)
+	{
+		W25qxx_TxExitCritical();
+		return;
+	}
+	Log->Busy = 1;
+	W25qxx_TxExitCritical();
+	W25qxx_DeviceAcquire(Log->Device);
+	for (;;)
+	{
+		// as many queued transactions as fit in one journal page. the group ends at End, commits
+		// from other tasks are appended to the queue while this one is written
+		W25qxx_TxEnterCritical();
+		Group = Log->Queue;
+		if (Group == NULL)
+		{
+			Log->Busy = 0;
+			W25qxx_TxExitCritical();
+			break;
+		}
+		Count = 0;
+		memset(Log->Buffer, 0xFF, sizeof(Log->Buffer));
+		for (Tx = Group; (Tx != NULL) && (Count + Tx->Count <= W25QXX_TX_RECORD_ENTRIES); Tx = Tx->Next)
+		{
+			memcpy(&Log->Buffer[W25QXX_TX_HEADER_SIZE + Count * sizeof(W25QXX_TxEntry_t)], Tx->Entry, Tx->Count * sizeof(W25QXX_TxEntry_t));
+			Count += Tx->Count;
+		}
+		End = Tx;
+		Log->Queue = End;
+		W25qxx_TxExitCritical();
+		Header[0] = W25QXX_TX_MAGIC;
+		Header[1] = Log->Sequence + 1;
+		Header[2] = Count;
+		memcpy(Log->Buffer, Header, 12);
+		Header[3] = W25qxx_TxCrc(W25qxx_TxCrc(0, Log->Buffer, 12), &Log->Buffer[W25QXX_TX_HEADER_SIZE], Count * sizeof(W25QXX_TxEntry_t));
+		memcpy(&Log->Buffer[12], &Header[3], 4);
+		// a new journal sector only holds applied records
+		if ((Log->Page % W25qxx_TxPagesPerSector(Log)) == 0)
+			W25qxx_EraseSector(W25qxx_PageToSector(Log->Page));
+		// the commit point
+		W25qxx_WritePage(Log->Buffer, Log->Page, 0, W25QXX_TX_APPLIED);
+		Log->Sequence++;
+		Log->Stats.Records++;
+		for (w25qxx_tx_t *Done = Group; Done != End; Done = Done->Next)
+		{
+			for (uint8_t i = 0; i < Done->Count; i++)
+				W25qxx_TxApply(Log, &Done->Entry[i]);
+		}
+		W25qxx_TxMarkApplied(Log->Page);
+		Log->Page = First + (Log->Page - First + 1) % Pages;
+		// the owner may begin the next transaction on Tx once it is done
+		for (Tx = Group; Tx != End; Tx = Next)
+		{
+			Next = Tx->Next;
+			for (uint8_t i = 0; i < Tx->Count; i++)
+				W25qxx_TxShadowGive(Log, Tx->Entry[i].Shadow);
+			Tx->State = W25QXX_TX_DONE;
+			Log->Stats.Transactions++;
+		}
+	}
+	W25qxx_DeviceRelease();
+}
+//###################################################################################################################
+void W25qxx_TxStats(w25qxx_txlog_t *Log, W25QXX_TxStats_t *Stats, bool Reset)
+{
+	if (Stats != NULL)
+		*Stats = Log->Stats;
+	if (Reset)
+		memset(&Log->Stats, 0, sizeof(W25QXX_TxStats_t));
+}
+//###################################################################################################################
@@ -0,0 +1,106 @@
+#ifndef _W25QXXTX_H
+#define _W25QXXTX_H
+
+/*
+  Power-fail-atomic updates of several sectors.
+
+  W25qxx_TxWrite() does not touch the sector it writes to (home). The new content of the
+  whole sector goes to a free shadow sector: old content, the written bytes on top.
+  W25qxx_TxCommit() appends one journal page listing home -> shadow for the transaction,
+  then copies every shadow to its home and marks the journal page applied. After a power
+  loss W25qxx_TxMount() copies again if the last journal page is not marked applied, so
+  every transaction is seen completely or not at all.
+
+  Journal page: [Magic 4][Sequence 4][Count 4][Crc 4][Home 4, Shadow 4, Crc 4 x Count] ... [Applied 4]
+
+  Group commit: commits queued with Wait = false, and commits from other tasks arriving
+  while one task writes the journal, go into the same journal page (up to
+  W25QXX_TX_RECORD_ENTRIES sectors). Transactions in flight must not write the same sector.
+
+  Journal: JournalCount sectors (2 or more) written as a ring. Shadows: ShadowCount
+  sectors (up to 32) in turn. Keep home sectors out of both regions.
+*/
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "w25qxx.h"
+
+#define W25QXX_TX_MAX_SECTORS 8 // per transaction
+#define W25QXX_TX_RECORD_ENTRIES 19 // per journal page, all transactions of a group
+
+	typedef enum
+	{
+		W25QXX_TX_IDLE = 0,
+		W25QXX_TX_OPEN,
+		W25QXX_TX_READY, // committed, waiting for the journal
+		W25QXX_TX_DONE,
+
+	} W25QXX_TxState_t;
+
+	typedef struct
+	{
+		uint32_t Home;
+		uint32_t Shadow;
+		uint32_t Crc; // of the shadow content
+
+	} W25QXX_TxEntry_t;
+
+	typedef struct w25qxx_tx_s
+	{
+		W25QXX_TxState_t State;
+		uint8_t Count;
+		W25QXX_TxEntry_t Entry[W25QXX_TX_MAX_SECTORS];
+		struct w25qxx_tx_s *Next; // queued for the journal
+
+	} w25qxx_tx_t;
+
+	typedef struct
+	{
+		uint32_t Transactions; // committed
+		uint32_t Records; // journal pages, one per group
+		uint32_t Recovered; // journal pages applied again by W25qxx_TxMount()
+		uint32_t CrcErrors; // shadows found damaged by W25qxx_TxMount(), the record is not applied
+
+	} W25QXX_TxStats_t;
+
+	typedef struct
+	{
+		w25qxx_t *Device;
+		uint32_t JournalSector;
+		uint32_t JournalCount;
+		uint32_t ShadowSector;
+		uint32_t ShadowCount;
+		uint32_t ShadowUsed; // bit per shadow sector
+		uint32_t ShadowNext; // shadows are taken in turn
+		uint32_t Sequence; // of the last journal page
+		uint32_t Page; // next journal page
+		uint8_t Busy; // a task is writing the journal
+		w25qxx_tx_t *Queue; // committed, oldest first
+		uint8_t Buffer[256];
+		W25QXX_TxStats_t Stats;
+
+	} w25qxx_txlog_t;
+
+	// finds the last journal page and finishes it after a power loss. works on the selected chip.
+	// false when a shadow of the unfinished page is damaged, nothing of it is applied then
+	bool W25qxx_TxMount(w25qxx_txlog_t *Log, uint32_t JournalSector, uint32_t JournalCount, uint32_t ShadowSector, uint32_t ShadowCount);
+	void W25qxx_TxBegin(w25qxx_txlog_t *Log, w25qxx_tx_t *Tx);
+	// any size, may cross sectors. false when the transaction or the shadow sectors are full
+	bool W25qxx_TxWrite(w25qxx_txlog_t *Log, w25qxx_tx_t *Tx, uint8_t *pBuffer, uint32_t WriteAddr, uint32_t NumByteToWrite);
+	// reads as the transaction sees it, its own writes included
+	void W25qxx_TxRead(w25qxx_txlog_t *Log, w25qxx_tx_t *Tx, uint8_t *pBuffer, uint32_t ReadAddr, uint32_t NumByteToRead);
+	// Wait = false only queues it, it is durable after the next waiting commit or W25qxx_TxSync()
+	bool W25qxx_TxCommit(w25qxx_txlog_t *Log, w25qxx_tx_t *Tx, bool Wait);
+	void W25qxx_TxAbort(w25qxx_txlog_t *Log, w25qxx_tx_t *Tx);
+	// writes all queued transactions, one journal page per group
+	void W25qxx_TxSync(w25qxx_txlog_t *Log);
+	void W25qxx_TxStats(w25qxx_txlog_t *Log, W25QXX_TxStats_t *Stats, bool Reset);
+//############################################################################
+#ifdef __cplusplus
+}
+#endif
+
+#endif
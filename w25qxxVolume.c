@@ -0,0 +1,201 @@
+
+#include "w25qxxVolume.h"
+
+//###################################################################################################################
+// volume address -> device index and address inside that device, Length = bytes until the next device boundary
+static uint8_t W25qxx_VolumeMap(w25qxx_volume_t *Volume, uint32_t Address, uint32_t *DeviceAddr, uint32_t *Length)
+{
+	uint8_t Index = 0;
+	if (Volume->Mode == W25QXX_VOLUME_STRIPE)
+	{
+		uint32_t Stripe = Address / Volume->StripeSize;
+		Index = Stripe % Volume->DeviceCount;
+		*DeviceAddr = (Stripe / Volume->DeviceCount) * Volume->StripeSize + (Address % Volume->StripeSize);
+		*Length = Volume->StripeSize - (Address % Volume->StripeSize);
+		return Index;
+	}
+	while (Address >= Volume->Device[Index]->SectorCount * Volume->Device[Index]->SectorSize)
+	{
+		Address -= Volume->Device[Index]->SectorCount * Volume->Device[Index]->SectorSize;
+		Index++;
+	}
+	*DeviceAddr = Address;
+	*Length = Volume->Device[Index]->SectorCount * Volume->Device[Index]->SectorSize - Address;
+	return Index;
+}
+//###################################################################################################################
+static bool W25qxx_VolumeInRange(w25qxx_volume_t *Volume, uint32_t Address, uint32_t Length)
+{
+	return (Address <= Volume->Capacity) && (Length <= Volume->Capacity - Address);
+}
+//###################################################################################################################
+// waits for the programs/erases started on every chip
+static void W25qxx_VolumeWaitReady(w25qxx_volume_t *Volume)
+{
+	for (uint8_t Index = 0; Index < Volume->DeviceCount; Index++)
+	{
+		W25qxx_DeviceAcquire(Volume->Device[Index]);
+		W25qxx_WaitReady();
+		W25qxx_DeviceRelease();
+	}
+}
+//###################################################################################################################
+bool W25qxx_VolumeInit(w25qxx_volume_t *Volume, w25qxx_t **Devices, uint8_t DeviceCount, W25QXX_VolumeMode_t Mode, uint32_t StripeSize)
+{
+	uint32_t Smallest = 0xFFFFFFFF;
+	if ((DeviceCount == 0) || (DeviceCount > W25QXX_VOLUME_MAX_DEVICES))
+		return false;
+	Volume->DeviceCount = DeviceCount;
+	Volume->Mode = Mode;
+	Volume->StripeSize = StripeSize;
+	Volume->SectorSize = Devices[0]->SectorSize;
+	Volume->SectorCount = 0;
+	for (uint8_t i = 0; i < DeviceCount; i++)
+	{
+		if ((Devices[i]->SectorCount == 0) || (Devices[i]->SectorSize != Volume->SectorSize))
+			return false;
+		Volume->Device[i] = Devices[i];
+		Volume->SectorCount += Devices[i]->SectorCount;
+		if (Devices[i]->SectorCount < Smallest)
+			Smallest = Devices[i]->SectorCount;
+	}
+	if (Mode == W25QXX_VOLUME_STRIPE)
+	{
+		if ((StripeSize == 0) || (StripeSize % Volume->SectorSize != 0))
+			return false;
+		// every chip holds the same number of whole stripes
+		Smallest -= Smallest % (StripeSize / Volume->SectorSize);
+		Volume->SectorCount = Smallest * DeviceCount;
+	}
+	Volume->Capacity = Volume->SectorCount * Volume->SectorSize;
+	return true;
+}
+//###################################################################################################################
+bool W25qxx_VolumeRead(w25qxx_volume_t *Volume, uint8_t *pBuffer, uint32_t ReadAddr, uint32_t NumByteToRead)
+{
+	uint32_t DeviceAddr, Length;
+	uint8_t Index;
+	W25QXX_IoVec_t Iov;
+	if (W25qxx_VolumeInRange(Volume, ReadAddr, NumByteToRead) == false)
+		return false;
+	while (NumByteToRead > 0)
+	{
+		Index = W25qxx_VolumeMap(Volume, ReadAddr, &DeviceAddr, &Length);
+		if (Length > NumByteToRead)
+			Length = NumByteToRead;
+		// one Fast Read per stripe, without the delay of ReadBytes
+		Iov.Buffer = pBuffer;
+		Iov.Length = Length;
+		W25qxx_DeviceAcquire(Volume->Device[Index]);
+		W25qxx_ReadV(DeviceAddr, &Iov, 1);
+		W25qxx_DeviceRelease();
+		pBuffer += Length;
+		ReadAddr += Length;
+		NumByteToRead -= Length;
+	}
+	return true;
+}
+//###################################################################################################################
+bool W25qxx_VolumeWrite(w25qxx_volume_t *Volume, uint8_t *pBuffer, uint32_t WriteAddr, uint32_t NumByteToWrite)
+{
+	uint32_t DeviceAddr, Length, PageSize;
+	uint32_t Row, RowSize, Offset, Address, End;
+	uint8_t Index;
+	if (W25qxx_VolumeInRange(Volume, WriteAddr, NumByteToWrite) == false)
+		return false;
+	if (Volume->Mode == W25QXX_VOLUME_CONCAT)
+	{
+		while (NumByteToWrite > 0)
+		{
+			Index = W25qxx_VolumeMap(Volume, WriteAddr, &DeviceAddr, &Length);
+			PageSize = Volume->Device[Index]->PageSize;
+			if (Length > PageSize - (DeviceAddr % PageSize))
+				Length = PageSize - (DeviceAddr % PageSize);
+			if (Length > NumByteToWrite)
+				Length = NumByteToWrite;
+			W25qxx_DeviceAcquire(Volume->Device[Index]);
+			W25qxx_ProgramStart(pBuffer, DeviceAddr, Length);
+			W25qxx_DeviceRelease();
+			pBuffer += Length;
+			WriteAddr += Length;
+			NumByteToWrite -= Length;
+		}
+	}
+	else
+	{
+		// walk one row of stripes (one stripe per chip) page by page across the chips,
+		// each chip gets its next page while the others are still programming
+		PageSize = Volume->Device[0]->PageSize;
+		RowSize = Volume->StripeSize * Volume->DeviceCount;
+		End = WriteAddr + NumByteToWrite;
+		for (Row = WriteAddr / RowSize; Row * RowSize < End; Row++)
+		{
+			for (Offset = 0; Offset < Volume->StripeSize; Offset += PageSize)
+			{
+				for (Index = 0; Index < Volume->DeviceCount; Index++)
+				{
+					Address = Row * RowSize + Index * Volume->StripeSize + Offset;
+					uint32_t From = (Address > WriteAddr) ? Address : WriteAddr;
+					uint32_t To = (Address + PageSize < End) ? Address + PageSize : End;
+					if (From >= To)
+						continue;
+					W25qxx_DeviceAcquire(Volume->Device[Index]);
+					W25qxx_ProgramStart(&pBuffer[From - WriteAddr], Row * Volume->StripeSize + Offset + (From - Address), To - From);
+					W25qxx_DeviceRelease();
+				}
+			}
+		}
+	}
+	W25qxx_VolumeWaitReady(Volume);
+	return true;
+}
+//###################################################################################################################
+bool W25qxx_VolumeEraseSector(w25qxx_volume_t *Volume, uint32_t SectorAddr)
+{
+	if (SectorAddr >= Volume->SectorCount)
+		return false;
+	return W25qxx_VolumeErase(Volume, SectorAddr * Volume->SectorSize, Volume->SectorSize);
+}
+//###################################################################################################################
+bool W25qxx_VolumeErase(w25qxx_volume_t *Volume, uint32_t EraseAddr, uint32_t NumByteToErase)
+{
+	uint32_t DeviceAddr, Length, Sector, Row, RowSize, Offset, Address;
+	uint32_t First = EraseAddr - (EraseAddr % Volume->SectorSize);
+	uint32_t End = EraseAddr + NumByteToErase;
+	uint8_t Index;
+	if (W25qxx_VolumeInRange(Volume, EraseAddr, NumByteToErase) == false)
+		return false;
+	if (Volume->Mode == W25QXX_VOLUME_CONCAT)
+	{
+		for (Sector = First / Volume->SectorSize; Sector * Volume->SectorSize < End; Sector++)
+		{
+			Index = W25qxx_VolumeMap(Volume, Sector * Volume->SectorSize, &DeviceAddr, &Length);
+			W25qxx_DeviceAcquire(Volume->Device[Index]);
+			W25qxx_EraseSectorStart(DeviceAddr / Volume->SectorSize);
+			W25qxx_DeviceRelease();
+		}
+	}
+	else
+	{
+		// same order as VolumeWrite, every chip gets one sector erase started before the first one is waited for
+		RowSize = Volume->StripeSize * Volume->DeviceCount;
+		for (Row = First / RowSize; Row * RowSize < End; Row++)
+		{
+			for (Offset = 0; Offset < Volume->StripeSize; Offset += Volume->SectorSize)
+			{
+				for (Index = 0; Index < Volume->DeviceCount; Index++)
+				{
+					Address = Row * RowSize + Index * Volume->StripeSize + Offset;
+					if ((Address < First) || (Address >= End))
+						continue;
+					W25qxx_DeviceAcquire(Volume->Device[Index]);
+					W25qxx_EraseSectorStart((Row * Volume->StripeSize + Offset) / Volume->SectorSize);
+					W25qxx_DeviceRelease();
+				}
+			}
+		}
+	}
+	W25qxx_VolumeWaitReady(Volume);
+	return true;
+}
+//###################################################################################################################
@@ -0,0 +1,56 @@
+#ifndef _W25QXXVOLUME_H
+#define _W25QXXVOLUME_H
+
+/*
+  Several w25qxx chips as one address space.
+
+  Concat: the chips follow each other, capacity adds up.
+  Stripe: StripeSize bytes (multiple of 4KB) go to each chip in turn, programs and
+          erases are started on every chip before waiting, so their busy times overlap.
+
+  Init every chip with W25qxx_InitDevice() first. The volume selects the chips by
+  itself (W25qxx_DeviceAcquire()), after a call the one of W25qxx_SelectDevice() is selected again.
+  Ranges past the capacity are rejected, the calls return false.
+*/
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "w25qxx.h"
+
+#define W25QXX_VOLUME_MAX_DEVICES 4
+
+	typedef enum
+	{
+		W25QXX_VOLUME_CONCAT = 0,
+		W25QXX_VOLUME_STRIPE,
+
+	} W25QXX_VolumeMode_t;
+
+	typedef struct
+	{
+		w25qxx_t *Device[W25QXX_VOLUME_MAX_DEVICES];
+		uint8_t DeviceCount;
+		W25QXX_VolumeMode_t Mode;
+		uint32_t StripeSize;
+		uint32_t SectorSize;
+		uint32_t SectorCount;
+		uint32_t Capacity; // in bytes
+
+	} w25qxx_volume_t;
+
+	bool W25qxx_VolumeInit(w25qxx_volume_t *Volume, w25qxx_t **Devices, uint8_t DeviceCount, W25QXX_VolumeMode_t Mode, uint32_t StripeSize);
+	bool W25qxx_VolumeRead(w25qxx_volume_t *Volume, uint8_t *pBuffer, uint32_t ReadAddr, uint32_t NumByteToRead);
+	// like WritePage, the range must be erased before
+	bool W25qxx_VolumeWrite(w25qxx_volume_t *Volume, uint8_t *pBuffer, uint32_t WriteAddr, uint32_t NumByteToWrite);
+	bool W25qxx_VolumeEraseSector(w25qxx_volume_t *Volume, uint32_t SectorAddr);
+	// erases every sector touched by [EraseAddr, EraseAddr + NumByteToErase)
+	bool W25qxx_VolumeErase(w25qxx_volume_t *Volume, uint32_t EraseAddr, uint32_t NumByteToErase);
+//############################################################################
+#ifdef __cplusplus
+}
+#endif
+
+#endif